@@ -0,0 +1,154 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Times core_import_programs() on two program sets of 10,000 lines each:
+ * 20 programs of 500 lines, and one program of 10,000 lines. The programs
+ * are generated, pasted, and exported to a temporary raw file, which is then
+ * imported into a freshly initialized core, 20 times; the best time is
+ * reported.
+ *
+ * Usage: import_bench [rawfile]
+ * With a file name, the 20-program set is also written to that file, so it
+ * can be used with free42batchbin -r.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+
+#define RUNS 20
+
+static char *generate(int prgm_no, int lines) {
+    /* A mix of numbers, strings, local labels, register and stack
+     * arithmetic, branches, and calls to the other programs.
+     */
+    char *buf = (char *) malloc(lines * 24 + 64);
+    char *p = buf;
+    int n;
+    if (buf == NULL)
+        return NULL;
+    p += sprintf(p, "1 LBL \"P%d\"\n", prgm_no);
+    for (n = 2; n < lines; n++) {
+        p += sprintf(p, "%d ", n);
+        switch (n % 8) {
+            case 0: p += sprintf(p, "%d.%d\n", n, prgm_no); break;
+            case 1: p += sprintf(p, "STO %02d\n", n % 100); break;
+            case 2: p += sprintf(p, "RCL+ %02d\n", (n / 8) % 100); break;
+            case 3: p += sprintf(p, "LBL %02d\n", (n / 8) % 100); break;
+            case 4: p += sprintf(p, "\"S%d\"\n", n); break;
+            case 5: p += sprintf(p, "SIN\n"); break;
+            case 6: p += sprintf(p, "GTO %02d\n", (n / 8) % 100); break;
+            case 7: p += sprintf(p, "XEQ \"P%d\"\n", (prgm_no + 1) % 20); break;
+        }
+    }
+    strcpy(p, "END\n");
+    return buf;
+}
+
+static bool make_raw(const char *name, int programs, int lines) {
+    int *indexes = (int *) malloc(programs * sizeof(int));
+    int i;
+    if (indexes == NULL)
+        return false;
+    core_init(0, 0, NULL, 0);
+    flags.f.prgm_mode = 1;
+    for (i = 0; i < programs; i++) {
+        char *text = generate(i, lines);
+        if (text == NULL) {
+            free(indexes);
+            return false;
+        }
+        goto_dot_dot(false);
+        core_paste(text);
+        free(text);
+        indexes[i] = current_prgm;
+    }
+    flags.f.prgm_mode = 0;
+    core_export_programs(programs, indexes, name);
+    core_cleanup();
+    free(indexes);
+    return true;
+}
+
+static int4 count_lines() {
+    int4 lines = 0;
+    int i;
+    for (i = 0; i < prgms_count; i++) {
+        int4 p = 0;
+        current_prgm = i;
+        while (p < prgms[i].size) {
+            int command;
+            arg_struct arg;
+            get_next_command(&p, &command, &arg, 0);
+            lines++;
+        }
+    }
+    return lines;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *what, int programs, int lines,
+                  const char *keep_name) {
+    char name[] = "/tmp/import_bench.XXXXXX";
+    int fd = mkstemp(name);
+    double best = 0;
+    int r;
+    int4 imported = 0;
+    if (fd == -1) {
+        fprintf(stderr, "Can't create a temporary file\n");
+        exit(1);
+    }
+    close(fd);
+    if (!make_raw(keep_name != NULL ? keep_name : name, programs, lines)) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    if (keep_name != NULL) {
+        unlink(name);
+        strcpy(name, keep_name);
+    }
+    for (r = 0; r < RUNS; r++) {
+        core_init(0, 0, NULL, 0);
+        double t = now();
+        core_import_programs(0, name);
+        t = now() - t;
+        imported = count_lines();
+        core_cleanup();
+        if (r == 0 || t < best)
+            best = t;
+    }
+    if (keep_name == NULL)
+        unlink(name);
+    printf("%-30s %8.2f ms  (%d lines imported)\n", what, best * 1000,
+           (int) imported);
+}
+
+int main(int argc, char *argv[]) {
+    bench("20 programs of 500 lines:", 20, 500, argc > 1 ? argv[1] : NULL);
+    bench("one program of 10,000 lines:", 1, 10000, NULL);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Times the basic phloat operations in three loops: a pivot search, as done
+ * by the LU decomposition, finding the largest |a[i]| in an array of
+ * two-decimal values; sums of products of small integers, as in loop
+ * counters and index arithmetic; and sums of values with different
+ * exponents, which the decimal build can't handle without the Intel
+ * library. This is mostly of interest in the decimal build
+ * (make BCD_MATH=1), where these operations are Phloat operators.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "core_phloat.h"
+
+#define N 1000
+#define RUNS 20
+
+static phloat a[N], b[N];
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int4 pivot_search(int reps) {
+    int4 idx = 0;
+    for (int r = 0; r < reps; r++) {
+        phloat max = 0;
+        for (int4 i = 0; i < N; i++) {
+            phloat t = fabs(a[i]);
+            if (t > max) {
+                max = t;
+                idx = i;
+            }
+        }
+    }
+    return idx;
+}
+
+static phloat int_sum(int reps) {
+    phloat sum = 0;
+    for (int r = 0; r < reps; r++)
+        for (int4 i = 0; i < N; i++)
+            sum = sum + b[i] * b[N - 1 - i];
+    return sum;
+}
+
+static phloat mixed_sum(int reps) {
+    phloat sum = 0;
+    for (int r = 0; r < reps; r++)
+        for (int4 i = 0; i < N; i++)
+            sum = sum + a[i];
+    return sum;
+}
+
+static void report(const char *what, double secs, int reps) {
+    printf("%-34s %8.2f ns per element\n", what,
+           secs * 1e9 / ((double) reps * N));
+}
+
+int main(int argc, char *argv[]) {
+    const int reps = 2000;
+    double t, best;
+    int r;
+
+    phloat_init();
+    for (int4 i = 0; i < N; i++) {
+        /* Values like 12.34 and -5.6, which have different exponents */
+        a[i] = phloat((int4) ((i * 7919) % 20011 - 10000)) / 100;
+        b[i] = phloat((int4) (i % 100));
+    }
+
+    #ifdef BCD_MATH
+        printf("Decimal build\n");
+    #else
+        printf("Binary build\n");
+    #endif
+
+    volatile int4 sink_idx = 0;
+    volatile double sink = 0;
+
+    best = 0;
+    for (r = 0; r < RUNS; r++) {
+        t = now();
+        sink_idx = pivot_search(reps);
+        t = now() - t;
+        if (r == 0 || t < best)
+            best = t;
+    }
+    report("pivot search, max |a[i]|:", best, reps);
+
+    best = 0;
+    for (r = 0; r < RUNS; r++) {
+        t = now();
+        sink = to_double(int_sum(reps));
+        t = now() - t;
+        if (r == 0 || t < best)
+            best = t;
+    }
+    report("small integers, sum + x * y:", best, reps);
+
+    best = 0;
+    for (r = 0; r < RUNS; r++) {
+        t = now();
+        sink = to_double(mixed_sum(reps));
+        t = now() - t;
+        if (r == 0 || t < best)
+            best = t;
+    }
+    report("mixed exponents, sum + a[i]:", best, reps);
+
+    (void) sink_idx;
+    (void) sink;
+    return 0;
+}
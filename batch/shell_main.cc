@@ -0,0 +1,456 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Headless batch runner. This is a shell without a display or a keyboard:
+ * it loads a state file and/or raw program files, runs a global label with
+ * the given stack inputs, and prints the stack and ALPHA when the program
+ * stops. See README for the command line syntax.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shell.h"
+#include "core_main.h"
+#include "shell_spool.h"
+
+#define FILENAMELEN 1024
+#define LINELEN 1024
+
+static bool quit_flag = false;
+static int timeout3_delay = -1;
+static bool print_to_stderr = false;
+static bool mem_report = false;
+static bool profile = false;
+static const char *profile_file_name = NULL;
+static int slice_ms = -1;
+static int slice_lines = -1;
+
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-f statefile] [-r rawfile]... [-i] [-q] [-m]\n"
+        "       %*s [-p] [-P pathfile] [-s ms] [-l lines] label [value...]\n"
+        "\n"
+        "  -f statefile  load the core state from statefile (a *.f42 file);\n"
+        "                the file itself is not modified\n"
+        "  -r rawfile    import the programs in rawfile (may be repeated)\n"
+        "  -i            read stack inputs from standard input, one line of\n"
+        "                space-separated values per run; the stack is not\n"
+        "                cleared between runs\n"
+        "  -q            send printer output to standard error instead of\n"
+        "                standard output\n"
+        "  -m            report the core's memory usage on standard error\n"
+        "                when done\n"
+        "  -p            profile the run, and report the instruction counts\n"
+        "                per line and per global label on standard error\n"
+        "  -P pathfile   profile the run, and write the instruction counts\n"
+        "                per call path to pathfile, in the collapsed stack\n"
+        "                format used by flame graph tools\n"
+        "  -s ms         let running programs go about ms milliseconds\n"
+        "                between event checks (default 10; 0 checks before\n"
+        "                every line)\n"
+        "  -l lines      let running programs go a fixed number of lines\n"
+        "                between event checks; overrides -s\n"
+        "  label         the global label to run\n"
+        "  value...      stack inputs, entered in the order given, so the\n"
+        "                last one ends up in X; complex numbers and strings\n"
+        "                are accepted, in the same formats as Paste\n",
+        argv0, (int) strlen(argv0), "");
+    exit(2);
+}
+
+static int read_state_header(FILE *in, int4 *version, int *offset) {
+    /* Works out where the core state starts, and which version to pass to
+     * core_init(). A portable state file (version 26 and up), like the ones
+     * written by Export State, starts with the magic number and version,
+     * and the core reads those itself. Older 'state' files written by the
+     * GTK shell have the shell state between the version and the core
+     * state, which we skip. The GTK 'state' file from version 26 onward
+     * only holds the shell state, with the core state kept in a separate
+     * *.f42 file; for that, we return -1.
+     */
+    int4 magic, state_size, state_version;
+    if (fread(&magic, 1, sizeof(int4), in) != sizeof(int4)
+            || magic != FREE42_MAGIC
+            || fread(version, 1, sizeof(int4), in) != sizeof(int4)
+            || *version < 0)
+        return 0;
+    if (*version == 0) {
+        /* No shell state */
+        *offset = 2 * sizeof(int4);
+        return 1;
+    }
+    if (*version > 27) {
+        *version = 26;
+        *offset = 0;
+        return 1;
+    }
+    if (fread(&state_size, 1, sizeof(int4), in) != sizeof(int4)
+            || fread(&state_version, 1, sizeof(int4), in) != sizeof(int4))
+        return 0;
+    if (*version > 25) {
+        /* Versions 26 and 27 are used both for portable state files and
+         * for the GTK shell state; the latter is recognizable by containing
+         * nothing but the shell state.
+         */
+        if (state_size > 0 && state_version >= 0
+                && fseek(in, 0, SEEK_END) == 0
+                && ftell(in) == 4 * sizeof(int4) + state_size)
+            return -1;
+        *version = 26;
+        *offset = 0;
+        return 1;
+    }
+    if (state_size < 0 || fseek(in, state_size, SEEK_CUR) != 0)
+        return 0;
+    *offset = ftell(in);
+    return 1;
+}
+
+static int load_state_copy(const char *state_file_name, char *copy_name,
+                           int4 *version, int *offset) {
+    /* The core renames the state file while it is loading it, so that a
+     * crash during loading won't leave it stuck in a crash loop; that would
+     * get in the way of multiple batch jobs sharing the same state file, so
+     * we give it a private copy instead.
+     * Returns 1 on success, 0 if the file can't be read, and -1 if it is
+     * a GTK shell state file without core state.
+     */
+    FILE *in = fopen(state_file_name, "rb");
+    if (in == NULL)
+        return 0;
+    int res = read_state_header(in, version, offset);
+    if (res != 1 || fseek(in, 0, SEEK_SET) != 0) {
+        fclose(in);
+        return res == 1 ? 0 : res;
+    }
+    const char *tmpdir = getenv("TMPDIR");
+    if (tmpdir == NULL || tmpdir[0] == 0)
+        tmpdir = "/tmp";
+    snprintf(copy_name, FILENAMELEN, "%s/free42batch.XXXXXX", tmpdir);
+    int fd = mkstemp(copy_name);
+    if (fd == -1) {
+        fclose(in);
+        return 0;
+    }
+    FILE *out = fdopen(fd, "wb");
+    char buf[8192];
+    size_t n;
+    int ok = out != NULL;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+        ok = fwrite(buf, 1, n, out) == n;
+    fclose(in);
+    if (out != NULL)
+        fclose(out);
+    else
+        close(fd);
+    if (!ok) {
+        unlink(copy_name);
+        return 0;
+    }
+    return 1;
+}
+
+static bool run(const char *label) {
+    int enqueued, repeat;
+    if (!core_run_label(label)) {
+        fprintf(stderr, "Label \"%s\" not found\n", label);
+        return false;
+    }
+    while (!quit_flag) {
+        if (core_keydown(0, &enqueued, &repeat))
+            continue;
+        /* PSE: the program resumes when the timeout fires; since we have
+         * no display to show the pause on, we don't actually wait.
+         */
+        if (timeout3_delay == -1)
+            break;
+        timeout3_delay = -1;
+        if (!core_timeout3(0))
+            break;
+    }
+    return true;
+}
+
+static void print_results() {
+    static const char regs[] = "TZYXA";
+    for (int i = 0; i < 5; i++) {
+        char *text = core_copy_reg(regs[i]);
+        if (regs[i] == 'A')
+            printf("ALPHA: %s\n", text == NULL ? "" : text);
+        else
+            printf("%c: %s\n", regs[i], text == NULL ? "" : text);
+        free(text);
+    }
+    fflush(stdout);
+}
+
+static bool write_profile(FILE *out, bool collapsed) {
+    char *report = core_profiler_report(collapsed);
+    if (report == NULL)
+        return false;
+    bool ok = fputs(report, out) >= 0;
+    free(report);
+    return ok;
+}
+
+static int parse_count(const char *argv0, const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (end == s || *end != 0 || n < 0 || n > 1000000000)
+        usage(argv0);
+    return (int) n;
+}
+
+static void enter_values(char *line) {
+    /* Values are separated by whitespace; strings containing spaces can't
+     * be entered this way, but then, neither can they be entered on the
+     * command line without quoting, and Paste doesn't do quotes.
+     */
+    char *tok = strtok(line, " \t\r\n");
+    while (tok != NULL) {
+        core_paste(tok);
+        tok = strtok(NULL, " \t\r\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *state_file_name = NULL;
+    const char **raw_file_names = (const char **) malloc(argc * sizeof(char *));
+    int raw_count = 0;
+    bool from_stdin = false;
+    int status = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:r:iqmpP:s:l:")) != -1) {
+        switch (c) {
+            case 'f': state_file_name = optarg; break;
+            case 'r': raw_file_names[raw_count++] = optarg; break;
+            case 'i': from_stdin = true; break;
+            case 'q': print_to_stderr = true; break;
+            case 'm': mem_report = true; break;
+            case 'p': profile = true; break;
+            case 'P': profile_file_name = optarg; break;
+            case 's': slice_ms = parse_count(argv[0], optarg); break;
+            case 'l': slice_lines = parse_count(argv[0], optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+    const char *label = argv[optind++];
+
+    char state_copy_name[FILENAMELEN];
+    if (state_file_name != NULL) {
+        int4 version;
+        int offset;
+        int res = load_state_copy(state_file_name, state_copy_name,
+                                  &version, &offset);
+        if (res == -1) {
+            fprintf(stderr, "\"%s\" contains only the GTK shell's settings; "
+                    "use the *.f42 file for the calculator state instead\n",
+                    state_file_name);
+            return 1;
+        } else if (res == 0) {
+            fprintf(stderr, "Can't read state file \"%s\"\n", state_file_name);
+            return 1;
+        }
+        core_init(1, version, state_copy_name, offset);
+        unlink(state_copy_name);
+    } else
+        core_init(0, 0, NULL, 0);
+    /* core_init() sets the defaults, so these have to come after it */
+    if (slice_ms != -1)
+        core_settings.cpu_slice_ms = slice_ms;
+    if (slice_lines != -1)
+        core_settings.cpu_slice_lines = slice_lines;
+
+    for (int i = 0; i < raw_count; i++)
+        core_import_programs(0, raw_file_names[i]);
+    free(raw_file_names);
+
+    if (profile || profile_file_name != NULL)
+        core_profiler_start();
+
+    if (from_stdin) {
+        char line[LINELEN];
+        while (!quit_flag && fgets(line, LINELEN, stdin) != NULL) {
+            enter_values(line);
+            if (!run(label)) {
+                status = 1;
+                break;
+            }
+            print_results();
+        }
+    } else {
+        for (int i = optind; i < argc; i++)
+            core_paste(argv[i]);
+        if (run(label))
+            print_results();
+        else
+            status = 1;
+    }
+
+    if (profile || profile_file_name != NULL) {
+        core_profiler_stop();
+        if (profile) {
+            if (!write_profile(stderr, false))
+                status = 1;
+            fprintf(stderr, "CPU slice: %d lines (cpu_slice_ms %d, "
+                    "cpu_slice_lines %d)\n", core_get_cpu_slice_lines(),
+                    core_settings.cpu_slice_ms, core_settings.cpu_slice_lines);
+        }
+        if (profile_file_name != NULL) {
+            FILE *out = fopen(profile_file_name, "w");
+            if (out == NULL || !write_profile(out, true)) {
+                fprintf(stderr, "Can't write profile to \"%s\"\n",
+                        profile_file_name);
+                status = 1;
+            }
+            if (out != NULL)
+                fclose(out);
+        }
+    }
+
+    if (mem_report) {
+        char *report = core_mem_report();
+        if (report != NULL) {
+            fputs(report, stderr);
+            free(report);
+        }
+    }
+
+    core_cleanup();
+    return status;
+}
+
+
+/********************************************/
+/* Callbacks used by the emulator core, see */
+/* shell.h for their specifications.        */
+/********************************************/
+
+const char *shell_platform() {
+    return VERSION " " VERSION_PLATFORM " batch";
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    // No display
+}
+
+void shell_beeper(int frequency, int duration) {
+    // No sound
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    // No display
+}
+
+int shell_wants_cpu() {
+    // No events, so never interrupt the program
+    return 0;
+}
+
+void shell_delay(int duration) {
+    // Only used to make things visible on the display, which we don't have
+}
+
+void shell_request_timeout3(int delay) {
+    timeout3_delay = delay;
+}
+
+uint4 shell_get_mem() {
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    char line[1024];
+    uint4 bytes = 0;
+    if (meminfo == NULL)
+        return 0;
+    while (fgets(line, 1024, meminfo) != NULL) {
+        if (strncmp(line, "MemFree:", 8) == 0) {
+            unsigned int kbytes;
+            if (sscanf(line + 8, "%u", &kbytes) == 1)
+                bytes = 1024 * kbytes;
+            break;
+        }
+    }
+    fclose(meminfo);
+    return bytes;
+}
+
+int shell_low_battery() {
+    return 0;
+}
+
+void shell_powerdown() {
+    quit_flag = true;
+}
+
+int8 shell_random_seed() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+int shell_decimal_point() {
+    return 1;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    FILE *out = print_to_stderr ? stderr : stdout;
+    char *buf = (char *) malloc(5 * length + 1);
+    if (buf == NULL)
+        return;
+    int len = hp2ascii(buf, text, length);
+    buf[len] = 0;
+    fprintf(out, "%s\n", buf);
+    free(buf);
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct tm tms;
+    localtime_r(&tv.tv_sec, &tms);
+    if (time != NULL)
+        *time = ((tms.tm_hour * 100 + tms.tm_min) * 100 + tms.tm_sec) * 100 + tv.tv_usec / 10000;
+    if (date != NULL)
+        *date = ((tms.tm_year + 1900) * 100 + tms.tm_mon + 1) * 100 + tms.tm_mday;
+    if (weekday != NULL)
+        *weekday = tms.tm_wday;
+}
+
+void shell_message(const char *message) {
+    fprintf(stderr, "%s\n", message);
+}
+
+void shell_log(const char *message) {
+    fprintf(stderr, "%s\n", message);
+}
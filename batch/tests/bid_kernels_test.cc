@@ -0,0 +1,519 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Checks the decimal kernels that bypass the Intel library -- the dot
+ * product accumulator, the element-wise array kernels, the integer paths of
+ * phloat_trunc_int8(), floor(), and fmod(), and the ISG/DSE fast path --
+ * against a reference computed exactly with GMP, and rounded to 34 digits,
+ * ties to even, as the library would. Random operands are decoded straight
+ * from their BID128 encoding, and the results are compared bit for bit,
+ * exponent included.
+ * Decimal builds only; see the Makefile.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <gmp.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+#include "core_commands2.h"
+#include "core_variables.h"
+
+static uint4 seed = 4242;
+static int failures = 0;
+
+static int rand_below(int n) {
+    seed = seed * 1103515245 + 12345;
+    return (int) ((seed >> 8) % n);
+}
+
+static bool is_negative(const Phloat &p) {
+    return (BID128_HI(p.val) & BID128_SIGN_MASK) != 0;
+}
+
+static int exponent_of(const Phloat &p) {
+    return phloat_exponent(p.val) - BID128_EXP_BIAS;
+}
+
+static void set_uint8(mpz_t z, uint8 u) {
+    mpz_import(z, 1, 1, sizeof(u), 0, 0, &u);
+}
+
+/* The signed coefficient of p; only finite values are generated */
+static void coefficient(mpz_t z, const Phloat &p) {
+    mpz_t lo;
+    mpz_init(lo);
+    set_uint8(z, BID128_HI(p.val) & BID128_COEF_MASK);
+    mpz_mul_2exp(z, z, 64);
+    set_uint8(lo, BID128_LO(p.val));
+    mpz_add(z, z, lo);
+    if (is_negative(p))
+        mpz_neg(z, z);
+    mpz_clear(lo);
+}
+
+/* z * 10^e, rounded to 34 digits. The tests keep the exponents well inside
+ * the range of Phloat, so there is no overflow or underflow to handle.
+ */
+static Phloat make(const mpz_t z, int e, bool negative_zero) {
+    mpz_t c, p, q, r;
+    mpz_inits(c, p, q, r, NULL);
+    bool negative = mpz_sgn(z) < 0 || (mpz_sgn(z) == 0 && negative_zero);
+    mpz_abs(c, z);
+    mpz_ui_pow_ui(p, 10, 34);
+    if (mpz_cmp(c, p) >= 0) {
+        /* mpz_sizeinbase() may be one too high, so start low */
+        int k = (int) mpz_sizeinbase(c, 10) - 35;
+        if (k < 0)
+            k = 0;
+        while (true) {
+            mpz_ui_pow_ui(r, 10, k);
+            mpz_tdiv_q(q, c, r);
+            if (mpz_cmp(q, p) < 0)
+                break;
+            k++;
+        }
+        mpz_tdiv_r(c, c, r);
+        mpz_mul_2exp(c, c, 1);
+        int half = mpz_cmp(c, r);
+        if (half > 0 || (half == 0 && mpz_odd_p(q)))
+            mpz_add_ui(q, q, 1);
+        if (mpz_cmp(q, p) == 0) {
+            mpz_tdiv_q_ui(q, q, 10);
+            k++;
+        }
+        mpz_swap(c, q);
+        e += k;
+    }
+    uint8 w[2] = { 0, 0 };
+    mpz_export(w, NULL, -1, sizeof(uint8), 0, 0, c);
+    BID_UINT128 v;
+    BID128_HI(v) = (negative ? BID128_SIGN_MASK : 0)
+                    | ((uint8) (e + BID128_EXP_BIAS) << 49) | w[1];
+    BID128_LO(v) = w[0];
+    mpz_clears(c, p, q, r, NULL);
+    return Phloat(v);
+}
+
+/* A random value with up to 'digits' digits, and an exponent between emin
+ * and emax; one in six is a zero, of either sign.
+ */
+static Phloat random_value(int digits, int emin, int emax) {
+    mpz_t z;
+    mpz_init(z);
+    int n = rand_below(6) == 0 ? 0 : 1 + rand_below(digits);
+    for (int i = 0; i < n; i++) {
+        mpz_mul_ui(z, z, 10);
+        mpz_add_ui(z, z, rand_below(10));
+    }
+    bool negative = rand_below(2) != 0;
+    if (negative)
+        mpz_neg(z, z);
+    Phloat p = make(z, emin + rand_below(emax - emin + 1), negative);
+    mpz_clear(z);
+    return p;
+}
+
+/* Brings x * 10^ex and y * 10^ey to their common exponent, which is
+ * returned
+ */
+static int align(mpz_t x, int ex, mpz_t y, int ey) {
+    mpz_t p;
+    mpz_init(p);
+    if (ex > ey) {
+        mpz_ui_pow_ui(p, 10, ex - ey);
+        mpz_mul(x, x, p);
+        ex = ey;
+    } else if (ey > ex) {
+        mpz_ui_pow_ui(p, 10, ey - ex);
+        mpz_mul(y, y, p);
+    }
+    mpz_clear(p);
+    return ex;
+}
+
+static bool same(const Phloat &a, const Phloat &b) {
+    return memcmp(&a.val, &b.val, sizeof(a.val)) == 0;
+}
+
+static void print(const Phloat &p) {
+    mpz_t z;
+    mpz_init(z);
+    coefficient(z, p);
+    gmp_printf("%s%Zd E%d", mpz_sgn(z) == 0 && is_negative(p) ? "-" : "",
+               z, exponent_of(p));
+    mpz_clear(z);
+}
+
+static void fail(const char *what, const Phloat &expected, const Phloat &got) {
+    if (failures++ >= 10)
+        return;
+    printf("FAIL %s: expected ", what);
+    print(expected);
+    printf(", got ");
+    print(got);
+    printf("\n");
+}
+
+
+/* phloat_array_add() and phloat_array_mul(), with scalar operands, and
+ * with coefficients that do and don't fit in 64 bits
+ */
+static void test_arrays() {
+    mpz_t a, b;
+    mpz_inits(a, b, NULL);
+    for (int t = 0; t < 20000; t++) {
+        int digits = t % 4 == 0 ? 34 : t % 4 == 1 ? 5 : t % 4 == 2 ? 12 : 19;
+        int spread = t % 3 == 0 ? 0 : t % 3 == 1 ? 4 : 25;
+        int n = 1 + rand_below(8);
+        int xinc = rand_below(3) != 0 ? 1 : 0;
+        int yinc = xinc == 0 || rand_below(3) != 0 ? 1 : 0;
+        Phloat x[8], y[8], z[8];
+        for (int i = 0; i < n; i++) {
+            x[i] = random_value(digits, -spread, spread);
+            y[i] = random_value(digits, -spread, spread);
+        }
+        int op = rand_below(3);
+        if (op == 2)
+            phloat_array_mul(x, xinc, y, yinc, z, n);
+        else
+            phloat_array_add(x, xinc, y, yinc, z, n, op == 1);
+        for (int i = 0; i < n; i++) {
+            const Phloat &u = y[i * yinc], &v = x[i * xinc];
+            coefficient(a, u);
+            coefficient(b, v);
+            Phloat expected;
+            if (op == 2) {
+                mpz_mul(a, a, b);
+                expected = make(a, exponent_of(u) + exponent_of(v),
+                                is_negative(u) != is_negative(v));
+            } else {
+                int e = align(a, exponent_of(u), b, exponent_of(v));
+                bool vneg = is_negative(v) != (op == 1);
+                if (op == 1)
+                    mpz_sub(a, a, b);
+                else
+                    mpz_add(a, a, b);
+                expected = make(a, e, is_negative(u) && vneg);
+            }
+            if (!same(expected, z[i]))
+                fail(op == 0 ? "array add" : op == 1 ? "array sub"
+                                                     : "array mul",
+                     expected, z[i]);
+        }
+    }
+    mpz_clears(a, b, NULL);
+}
+
+
+/* The dot product accumulator: the exact sum of the products, rounded
+ * once. Sums that had to spill terms into 'rest' are rounded more than
+ * once, and are only required to be within 5 units in the last place.
+ */
+static int digits(const mpz_t z) {
+    /* mpz_sizeinbase() may be one too high */
+    int n = (int) mpz_sizeinbase(z, 10);
+    mpz_t p;
+    mpz_init(p);
+    mpz_ui_pow_ui(p, 10, n - 1);
+    if (n > 1 && mpz_cmpabs(z, p) < 0)
+        n--;
+    mpz_clear(p);
+    return n;
+}
+
+static bool within_5_ulp(const mpz_t sum, int e, const Phloat &got) {
+    if (mpz_sgn(sum) == 0)
+        return true;
+    int ulp = e + digits(sum) - 34;
+    mpz_t g, x, lim;
+    mpz_inits(g, x, lim, NULL);
+    coefficient(g, got);
+    mpz_set(x, sum);
+    int m = align(g, exponent_of(got), x, e);
+    mpz_sub(g, g, x);
+    mpz_set_ui(lim, 5);
+    align(g, m, lim, ulp);
+    bool ok = mpz_cmpabs(g, lim) <= 0;
+    mpz_clears(g, x, lim, NULL);
+    return ok;
+}
+
+static void add_term(mpz_t sum, int *e, bool *empty, const Phloat &x,
+                     const Phloat &y, bool sub) {
+    mpz_t a, b;
+    mpz_inits(a, b, NULL);
+    coefficient(a, x);
+    coefficient(b, y);
+    mpz_mul(a, a, b);
+    if (sub)
+        mpz_neg(a, a);
+    int te = exponent_of(x) + exponent_of(y);
+    /* Zero terms are skipped, and don't affect the exponent */
+    if (mpz_sgn(a) != 0) {
+        if (*empty) {
+            mpz_set(sum, a);
+            *e = te;
+            *empty = false;
+        } else {
+            *e = align(sum, *e, a, te);
+            mpz_add(sum, sum, a);
+        }
+    }
+    mpz_clears(a, b, NULL);
+}
+
+static void test_dot() {
+    mpz_t sum;
+    mpz_init(sum);
+    for (int t = 0; t < 5000; t++) {
+        int digits = t % 3 == 0 ? 34 : t % 3 == 1 ? 5 : 20;
+        int spread = t % 4 == 0 ? 0 : t % 4 == 1 ? 3 : t % 4 == 2 ? 12 : 40;
+        int n = 1 + rand_below(12);
+        int e = 0;
+        bool empty = true;
+        dot_acc acc;
+        Phloat init = rand_below(2) != 0 ? random_value(digits, -spread, spread)
+                                         : Phloat(0);
+        dot_init(&acc, init);
+        add_term(sum, &e, &empty, init, 1, false);
+        for (int i = 0; i < n; i++) {
+            Phloat x = random_value(digits, -spread, spread);
+            Phloat y = random_value(digits, -spread, spread);
+            /* Encourage cancellation */
+            if (t % 5 == 0 && i % 2 == 1) {
+                x = -x;
+                y = -y;
+            }
+            bool sub = rand_below(3) == 0;
+            if (sub)
+                dot_sub(&acc, x, y);
+            else
+                dot_add(&acc, x, y);
+            add_term(sum, &e, &empty, x, y, sub);
+        }
+        Phloat got = dot_result(&acc);
+        Phloat expected = empty ? Phloat(0) : make(sum, e, false);
+        if (acc.has_rest ? !within_5_ulp(sum, e, got) : !same(expected, got))
+            fail(acc.has_rest ? "dot (spilled)" : "dot", expected, got);
+    }
+    mpz_clear(sum);
+}
+
+
+/* phloat_trunc_int8(), floor() (which truncates), and fmod() */
+static void truncate(mpz_t z, const Phloat &p, bool *exact) {
+    mpz_t q;
+    mpz_init(q);
+    coefficient(z, p);
+    int e = exponent_of(p);
+    if (e >= 0) {
+        mpz_ui_pow_ui(q, 10, e);
+        mpz_mul(z, z, q);
+        *exact = true;
+    } else {
+        mpz_ui_pow_ui(q, 10, -e);
+        *exact = mpz_divisible_p(z, q) != 0;
+        mpz_tdiv_q(z, z, q);
+    }
+    mpz_clear(q);
+}
+
+static void test_integers() {
+    mpz_t z, c, lim, x, y;
+    mpz_inits(z, c, lim, x, y, NULL);
+    mpz_ui_pow_ui(lim, 2, 63);
+    for (int t = 0; t < 50000; t++) {
+        Phloat p = random_value(t % 3 != 0 ? 12 : 34, -25, 20);
+        bool exact;
+        truncate(z, p, &exact);
+
+        /* phloat_trunc_int8() must handle everything with a coefficient
+         * below 2^63, whose integer part fits
+         */
+        coefficient(c, p);
+        mpz_abs(c, c);
+        bool fits = mpz_cmp(c, lim) < 0 && mpz_cmpabs(z, lim) < 0;
+        int8 res;
+        bool ex;
+        bool ok = phloat_trunc_int8(p, &res, &ex);
+        if (ok) {
+            set_uint8(c, res < 0 ? 0 - (uint8) res : (uint8) res);
+            if (res < 0)
+                mpz_neg(c, c);
+        }
+        if (ok != fits || (ok && (mpz_cmp(c, z) != 0 || ex != exact))) {
+            failures++;
+            if (failures <= 10) {
+                printf("FAIL trunc_int8: ");
+                print(p);
+                printf("\n");
+            }
+        }
+
+        /* floor() keeps integers as they are, and truncates the rest to
+         * an integer with exponent 0, keeping the sign
+         */
+        Phloat expected = exponent_of(p) >= 0 ? p
+                                : make(z, 0, is_negative(p));
+        Phloat got = floor(p);
+        if (!same(expected, got))
+            fail("floor", expected, got);
+
+        /* fmod(): the exact remainder of truncating division, with the
+         * sign of x, and the smaller of the two exponents; divisors whose
+         * aligned coefficient doesn't fit in 34 digits are skipped, since
+         * the remainder might then be rounded
+         */
+        Phloat q = random_value(t % 2 != 0 ? 6 : 18, t % 4 != 0 ? 0 : -3,
+                                t % 4 != 0 ? 0 : 3);
+        Phloat r = t % 2 != 0 ? p : random_value(18, -3, 3);
+        coefficient(x, r);
+        coefficient(y, q);
+        if (mpz_sgn(y) == 0)
+            continue;
+        int e = align(x, exponent_of(r), y, exponent_of(q));
+        mpz_ui_pow_ui(c, 10, 34);
+        if (mpz_cmpabs(y, c) >= 0)
+            continue;
+        mpz_tdiv_r(x, x, y);
+        expected = make(x, e, is_negative(r));
+        got = fmod(r, q);
+        if (!same(expected, got))
+            fail("fmod", expected, got);
+    }
+
+    /* floor() on 20-digit coefficients, which still fit in 64 bits, with
+     * exponents around -19, where the quotient goes from 1 digit to 0
+     */
+    for (int t = 0; t < 2000; t++) {
+        mpz_set_ui(c, 1 + rand_below(8));
+        for (int i = 0; i < 3; i++) {
+            mpz_mul_ui(c, c, 1000000);
+            mpz_add_ui(c, c, rand_below(1000000));
+        }
+        mpz_ui_pow_ui(x, 10, 19);
+        mpz_add(c, c, x);
+        bool negative = rand_below(2) != 0;
+        if (negative)
+            mpz_neg(c, c);
+        Phloat p = make(c, -18 - rand_below(4), negative);
+        bool exact;
+        truncate(z, p, &exact);
+        Phloat expected = make(z, 0, negative);
+        Phloat got = floor(p);
+        if (!same(expected, got))
+            fail("floor", expected, got);
+    }
+    mpz_clears(z, c, lim, x, y, NULL);
+}
+
+
+/* ISG and DSE on iiiii.jjjkk values, covering the fast path for small
+ * coefficients as well as the general case. The coefficients are kept
+ * below 10^33, so that every step of the update is exact.
+ */
+static void test_loops() {
+    mpz_t n, i, f, scale, kk, t;
+    mpz_inits(n, i, f, scale, kk, t, NULL);
+    arg_struct arg;
+    arg.type = ARGTYPE_STR;
+    arg.length = 1;
+    arg.val.text[0] = 'L';
+    for (int tc = 0; tc < 50000; tc++) {
+        int s = rand_below(tc % 7 == 0 ? 21 : 16);
+        Phloat x = random_value(tc % 5 == 0 ? 33 : tc % 2 != 0 ? 10 : 18,
+                                -s, -s);
+        bool isg = rand_below(2) != 0;
+
+        /* The reference: x = n * 10^-s, split into i, j, and k */
+        coefficient(n, x);
+        mpz_ui_pow_ui(scale, 10, s);
+        mpz_abs(t, n);
+        mpz_tdiv_qr(i, f, t, scale);
+        mpz_mul_ui(f, f, 100000);
+        mpz_tdiv_q(f, f, scale);
+        int k = (int) mpz_get_ui(f);
+        int j = k / 100;
+        k -= j * 100;
+        if (k == 0)
+            k = 1;
+        mpz_mul_ui(kk, scale, k);
+        bool neg = mpz_sgn(n) < 0;
+        if (isg) {
+            mpz_neg(t, kk);
+            if (neg && mpz_cmp(n, t) > 0) {
+                mpz_neg(n, n);
+                mpz_add(n, n, kk);
+                mpz_mul(t, i, scale);
+                mpz_submul_ui(n, t, 2);
+            } else
+                mpz_add(n, n, kk);
+        } else {
+            if (mpz_sgn(n) > 0 && mpz_cmp(n, kk) < 0) {
+                mpz_neg(n, n);
+                mpz_sub(n, n, kk);
+                mpz_mul(t, i, scale);
+                mpz_addmul_ui(n, t, 2);
+            } else
+                mpz_sub(n, n, kk);
+        }
+        Phloat expected = make(n, -s, false);
+        int expected_err;
+        if (isg) {
+            if (neg)
+                mpz_ui_sub(i, k, i);
+            else
+                mpz_add_ui(i, i, k);
+            expected_err = mpz_cmp_si(i, j) > 0 ? ERR_NO : ERR_YES;
+        } else {
+            if (neg) {
+                mpz_neg(i, i);
+                mpz_sub_ui(i, i, k);
+            } else
+                mpz_sub_ui(i, i, k);
+            expected_err = mpz_cmp_si(i, j) <= 0 ? ERR_NO : ERR_YES;
+        }
+
+        store_var("L", 1, new_real(x));
+        int err = isg ? docmd_isg(&arg) : docmd_dse(&arg);
+        Phloat got = ((vartype_real *) recall_var("L", 1))->x;
+        if (!same(expected, got))
+            fail(isg ? "ISG" : "DSE", expected, got);
+        else if (err != expected_err) {
+            failures++;
+            if (failures <= 10) {
+                printf("FAIL %s: wrong test result for ", isg ? "ISG" : "DSE");
+                print(x);
+                printf("\n");
+            }
+        }
+    }
+    mpz_clears(n, i, f, scale, kk, t, NULL);
+}
+
+int main(int argc, char *argv[]) {
+    core_init(0, 0, NULL, 0);
+    test_arrays();
+    test_dot();
+    test_integers();
+    test_loops();
+    if (failures == 0)
+        printf("bid_kernels_test: all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
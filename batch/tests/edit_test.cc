@@ -0,0 +1,105 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Checks that the line index and the local label index, which are adjusted
+ * in place when program lines are inserted or deleted, stay in agreement
+ * with the program text. After every edit, the indexes are compared against
+ * a plain scan of the program.
+ */
+
+#include <stdio.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+
+static const char *test_prgm =
+    "01 LBL \"T\"\n"
+    "02 LBL 01\n"
+    "03 1\n"
+    "04 LBL A\n"
+    "05 2\n"
+    "06 LBL 02\n"
+    "07 GTO 01\n"
+    "08 END\n";
+
+static int failures = 0;
+
+static void check(const char *what) {
+    prgm_struct *prgm = prgms + current_prgm;
+    int4 p = 0, line = 1, labels = 0;
+    int bad = 0;
+    while (true) {
+        int4 nextpc = p;
+        int command;
+        arg_struct arg;
+        if (pc2line(p) != line || line2pc(line) != p)
+            bad = 1;
+        get_next_command(&nextpc, &command, &arg, 0);
+        if (command == CMD_LBL && arg.type != ARGTYPE_STR) {
+            int4 savedpc = pc;
+            pc = -1;
+            if (find_local_label(&arg) != p)
+                bad = 1;
+            pc = savedpc;
+            labels++;
+        }
+        if (command == CMD_END)
+            break;
+        p = nextpc;
+        line++;
+    }
+    if (prgm->line_pcs != NULL && prgm->line_count != line)
+        bad = 1;
+    if (prgm->lclbl_hash != NULL && prgm->lclbls_count != labels)
+        bad = 1;
+    if (bad) {
+        printf("FAIL %s: %d lines, line index has %d; %d labels, "
+               "label index has %d\n", what, line, prgm->line_count,
+               labels, prgm->lclbls_count);
+        failures++;
+    }
+}
+
+static void del(int4 line, int4 count, const char *what) {
+    pc = line2pc(line);
+    clear_prgm_lines(count);
+    check(what);
+}
+
+int main(int argc, char *argv[]) {
+    core_init(0, 0, NULL, 0);
+    flags.f.prgm_mode = 1;
+    core_paste(test_prgm);
+    flags.f.prgm_mode = 0;
+    goto_dot_dot(false);
+    current_prgm = 0;
+    check("initial");
+
+    /* DEL with a count of 0, and DEL at .END., delete nothing */
+    del(0, 0, "DEL 0000 at line 00");
+    del(3, 0, "DEL 0000 at line 03");
+    del(8, 1, "DEL 0001 at .END.");
+    del(8, 5, "DEL 0005 at .END.");
+
+    del(3, 2, "DEL 0002 at line 03");
+    del(2, 1, "DEL 0001 at line 02");
+    del(1, 10, "DEL 0010 at line 01");
+
+    if (failures == 0)
+        printf("edit_test: all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,458 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Checks the string flags of real matrices, which are kept as a bitmap with
+ * a count of the bits set, after the commands that move elements around or
+ * change their type: STOEL, PUTM, GETM, INSR, DELR, and GROW. The edits hit
+ * elements 31, 32, 63, and 64, on either side of the bitmap's byte
+ * boundaries at 32 and 64, and the matrix is always shared with another
+ * variable first, so the copy made before writing is checked too.
+ * Each matrix is compared against a plain model of its contents.
+ * Finally, a larger shared matrix checks that a STOEL only copies the
+ * chunk of MATRIX_CHUNK elements it writes to, and that the rest is still
+ * read from the other matrix's array, until both are purged.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+#include "core_variables.h"
+
+/* Each test program shares M with C, edits M, and stores 1 in OK once it
+ * gets to the end, so an error along the way is caught as well.
+ */
+static const char *test_prgm =
+    "01 LBL \"STOEL\"\n"
+    "02 RCL \"M\"\n"
+    "03 STO \"C\"\n"
+    "04 INDEX \"M\"\n"
+    "05 7\n"
+    "06 ENTER\n"
+    "07 2\n"
+    "08 STOIJ\n"
+    "09 \"AB\"\n"
+    "10 ASTO ST X\n"
+    "11 STOEL\n"
+    "12 7\n"
+    "13 ENTER\n"
+    "14 3\n"
+    "15 STOIJ\n"
+    "16 100\n"
+    "17 STOEL\n"
+    "18 13\n"
+    "19 ENTER\n"
+    "20 4\n"
+    "21 STOIJ\n"
+    "22 \"CD\"\n"
+    "23 ASTO ST X\n"
+    "24 STOEL\n"
+    "25 13\n"
+    "26 ENTER\n"
+    "27 5\n"
+    "28 STOIJ\n"
+    "29 101\n"
+    "30 STOEL\n"
+    "31 1\n"
+    "32 STO \"OK\"\n"
+    "33 RTN\n"
+    "34 LBL \"PUTM\"\n"
+    "35 RCL \"M\"\n"
+    "36 STO \"C\"\n"
+    "37 INDEX \"M\"\n"
+    "38 7\n"
+    "39 ENTER\n"
+    "40 2\n"
+    "41 STOIJ\n"
+    "42 RCL \"S\"\n"
+    "43 PUTM\n"
+    "44 13\n"
+    "45 ENTER\n"
+    "46 4\n"
+    "47 STOIJ\n"
+    "48 RCL \"T\"\n"
+    "49 PUTM\n"
+    "50 1\n"
+    "51 STO \"OK\"\n"
+    "52 RTN\n"
+    "53 LBL \"GETM\"\n"
+    "54 RCL \"M\"\n"
+    "55 STO \"C\"\n"
+    "56 INDEX \"M\"\n"
+    "57 7\n"
+    "58 ENTER\n"
+    "59 2\n"
+    "60 STOIJ\n"
+    "61 2\n"
+    "62 ENTER\n"
+    "63 4\n"
+    "64 GETM\n"
+    "65 STO \"G\"\n"
+    "66 13\n"
+    "67 ENTER\n"
+    "68 4\n"
+    "69 STOIJ\n"
+    "70 1\n"
+    "71 ENTER\n"
+    "72 2\n"
+    "73 GETM\n"
+    "74 STO \"H\"\n"
+    "75 1\n"
+    "76 STO \"OK\"\n"
+    "77 RTN\n"
+    "78 LBL \"INSR\"\n"
+    "79 RCL \"M\"\n"
+    "80 STO \"C\"\n"
+    "81 INDEX \"M\"\n"
+    "82 7\n"
+    "83 ENTER\n"
+    "84 1\n"
+    "85 STOIJ\n"
+    "86 INSR\n"
+    "87 13\n"
+    "88 ENTER\n"
+    "89 1\n"
+    "90 STOIJ\n"
+    "91 INSR\n"
+    "92 1\n"
+    "93 STO \"OK\"\n"
+    "94 RTN\n"
+    "95 LBL \"DELR\"\n"
+    "96 RCL \"M\"\n"
+    "97 STO \"C\"\n"
+    "98 INDEX \"M\"\n"
+    "99 7\n"
+    "100 ENTER\n"
+    "101 1\n"
+    "102 STOIJ\n"
+    "103 DELR\n"
+    "104 12\n"
+    "105 ENTER\n"
+    "106 1\n"
+    "107 STOIJ\n"
+    "108 DELR\n"
+    "109 1\n"
+    "110 STO \"OK\"\n"
+    "111 RTN\n"
+    "112 LBL \"GROW\"\n"
+    "113 RCL \"M\"\n"
+    "114 STO \"C\"\n"
+    "115 INDEX \"M\"\n"
+    "116 13\n"
+    "117 ENTER\n"
+    "118 5\n"
+    "119 STOIJ\n"
+    "120 GROW\n"
+    "121 J+\n"
+    "122 \"Q\"\n"
+    "123 ASTO ST X\n"
+    "124 STOEL\n"
+    "125 1\n"
+    "126 STO \"OK\"\n"
+    "127 RTN\n"
+    "128 LBL \"COW\"\n"
+    "129 RCL \"M\"\n"
+    "130 STO \"C\"\n"
+    "131 INDEX \"M\"\n"
+    "132 27\n"
+    "133 ENTER\n"
+    "134 1\n"
+    "135 STOIJ\n"
+    "136 \"X\"\n"
+    "137 ASTO ST X\n"
+    "138 STOEL\n"
+    "139 1\n"
+    "140 STO \"OK\"\n"
+    "141 END\n";
+
+/* The model: one entry per element, holding either a number or a string
+ * of up to two characters
+ */
+#define MAX_ELEMENTS 200
+#define COLUMNS 5
+
+typedef struct {
+    bool str;
+    char text[3];
+    int num;
+} element;
+
+typedef struct {
+    int rows, columns;
+    element e[MAX_ELEMENTS];
+} model;
+
+static int failures = 0;
+
+static void set_num(model *m, int i, int num) {
+    m->e[i].str = false;
+    m->e[i].num = num;
+}
+
+static void set_str(model *m, int i, const char *text) {
+    m->e[i].str = true;
+    strcpy(m->e[i].text, text);
+}
+
+static void initial_model(model *m, int rows) {
+    /* Numbers at 31 and 63, strings at 32 and 64, and a scattering of
+     * strings elsewhere, so each byte of the bitmap has something in it
+     */
+    m->rows = rows;
+    m->columns = COLUMNS;
+    for (int i = 0; i < m->rows * m->columns; i++) {
+        if (i == 32 || i == 64 || (i % 7 == 3 && i != 31 && i != 63)) {
+            char text[2] = { (char) ('A' + i % 26), 0 };
+            set_str(m, i, text);
+        } else
+            set_num(m, i, i);
+    }
+}
+
+static vartype *new_matrix(const model *m) {
+    vartype_realmatrix *rm = (vartype_realmatrix *)
+            new_realmatrix(m->rows, m->columns);
+    if (rm == NULL)
+        return NULL;
+    for (int i = 0; i < m->rows * m->columns; i++) {
+        if (m->e[i].str) {
+            int len = (int) strlen(m->e[i].text);
+            set_is_string(rm->array, i, true);
+            phloat_length(rm->array->data[i]) = len;
+            memcpy(phloat_text(rm->array->data[i]), m->e[i].text, len);
+        } else
+            rm->array->data[i] = m->e[i].num;
+    }
+    return (vartype *) rm;
+}
+
+static void check(const char *test, const char *name, const model *m) {
+    vartype *v = recall_var(name, (int) strlen(name));
+    if (v == NULL || v->type != TYPE_REALMATRIX) {
+        printf("FAIL %s: %s is not a real matrix\n", test, name);
+        failures++;
+        return;
+    }
+    vartype_realmatrix *rm = (vartype_realmatrix *) v;
+    if (rm->rows != m->rows || rm->columns != m->columns) {
+        printf("FAIL %s: %s is %dx%d, expected %dx%d\n", test, name,
+               rm->rows, rm->columns, m->rows, m->columns);
+        failures++;
+        return;
+    }
+    int4 strings = 0;
+    for (int i = 0; i < m->rows * m->columns; i++) {
+        const element *e = m->e + i;
+        phloat d = *matrix_element(rm->array, i);
+        bool ok;
+        if (IS_STRING(rm->array, i) != (e->str ? 1 : 0))
+            ok = false;
+        else if (e->str)
+            ok = phloat_length(d) == (int) strlen(e->text)
+                    && memcmp(phloat_text(d), e->text, phloat_length(d)) == 0;
+        else
+            ok = d == e->num;
+        if (!ok) {
+            printf("FAIL %s: %s element %d is wrong; expected %s%s\n",
+                   test, name, i, e->str ? "string " : "number",
+                   e->str ? e->text : "");
+            failures++;
+            return;
+        }
+        if (e->str)
+            strings++;
+    }
+    if (rm->array->string_count != strings) {
+        printf("FAIL %s: %s string count is %d, expected %d\n", test, name,
+               rm->array->string_count, strings);
+        failures++;
+    }
+}
+
+static void insert_row(model *m, int row) {
+    int at = row * m->columns;
+    int n = m->rows * m->columns;
+    memmove(m->e + at + m->columns, m->e + at, (n - at) * sizeof(element));
+    for (int j = 0; j < m->columns; j++)
+        set_num(m, at + j, 0);
+    m->rows++;
+}
+
+static void delete_row(model *m, int row) {
+    int at = row * m->columns;
+    int n = m->rows * m->columns;
+    memmove(m->e + at, m->e + at + m->columns,
+            (n - at - m->columns) * sizeof(element));
+    m->rows--;
+}
+
+static void submatrix(const model *src, int row, int col, int rows, int cols,
+                      model *dst) {
+    dst->rows = rows;
+    dst->columns = cols;
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            dst->e[i * cols + j] =
+                    src->e[(row + i) * src->columns + col + j];
+}
+
+static void putmatrix(model *dst, int row, int col, const model *src) {
+    for (int i = 0; i < src->rows; i++)
+        for (int j = 0; j < src->columns; j++)
+            dst->e[(row + i) * dst->columns + col + j] =
+                    src->e[i * src->columns + j];
+}
+
+static void run(const char *label, const model *m) {
+    /* Stores M as given by the model, and runs the test program */
+    store_var("M", 1, new_matrix(m));
+    purge_var("OK", 2);
+    if (!core_run_label(label)) {
+        printf("FAIL %s: label not found\n", label);
+        failures++;
+        return;
+    }
+    int enqueued, repeat;
+    while (core_keydown(0, &enqueued, &repeat))
+        ;
+    if (recall_var("OK", 2) == NULL) {
+        printf("FAIL %s: the program stopped early\n", label);
+        failures++;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    core_init(0, 0, NULL, 0);
+    flags.f.prgm_mode = 1;
+    core_paste(test_prgm);
+    flags.f.prgm_mode = 0;
+
+    model orig, m, s, t, g;
+    initial_model(&orig, 13);
+
+    /* STOEL: flip the types of 31, 32, 63, and 64 */
+    m = orig;
+    run("STOEL", &m);
+    set_str(&m, 31, "AB");
+    set_num(&m, 32, 100);
+    set_str(&m, 63, "CD");
+    set_num(&m, 64, 101);
+    check("STOEL", "M", &m);
+    check("STOEL", "C", &orig);
+
+    /* PUTM: a 2x4 block over 31-34 and 36-39, and a 1x2 one over 63-64 */
+    s.rows = 2;
+    s.columns = 4;
+    for (int i = 0; i < 8; i++) {
+        if (i % 2 == 0)
+            set_str(&s, i, i < 4 ? "S" : "s");
+        else
+            set_num(&s, i, 200 + i);
+    }
+    t.rows = 1;
+    t.columns = 2;
+    set_str(&t, 0, "T");
+    set_num(&t, 1, 300);
+    store_var("S", 1, new_matrix(&s));
+    store_var("T", 1, new_matrix(&t));
+    m = orig;
+    run("PUTM", &m);
+    putmatrix(&m, 6, 1, &s);
+    putmatrix(&m, 12, 3, &t);
+    check("PUTM", "M", &m);
+    check("PUTM", "C", &orig);
+
+    /* GETM: the same blocks, read back */
+    m = orig;
+    run("GETM", &m);
+    submatrix(&orig, 6, 1, 2, 4, &g);
+    check("GETM", "G", &g);
+    submatrix(&orig, 12, 3, 1, 2, &g);
+    check("GETM", "H", &g);
+    check("GETM", "M", &orig);
+
+    /* INSR: rows before rows 7 and 12 of the original, moving 31 and 32 to
+     * 36 and 37, and 63 and 64 to 73 and 74
+     */
+    m = orig;
+    run("INSR", &m);
+    insert_row(&m, 6);
+    insert_row(&m, 12);
+    check("INSR", "M", &m);
+    check("INSR", "C", &orig);
+
+    /* DELR: rows 7 and 13 of the original, moving 35-39 down to 30-34,
+     * and deleting 60-64
+     */
+    m = orig;
+    run("DELR", &m);
+    delete_row(&m, 6);
+    delete_row(&m, 11);
+    check("DELR", "M", &m);
+    check("DELR", "C", &orig);
+
+    /* GROW: J+ past 64 adds a row, and the STOEL goes to 65 */
+    m = orig;
+    run("GROW", &m);
+    insert_row(&m, 13);
+    set_str(&m, 65, "Q");
+    check("GROW", "M", &m);
+    check("GROW", "C", &orig);
+
+    /* COW: 40x5, so four chunks; the STOEL goes to element 130, in the
+     * third one, which should be the only one copied
+     */
+    purge_var("C", 1);
+    int4 blocks, blocks_before;
+    int8 bytes;
+    get_matrix_data_stats(&blocks_before, &bytes);
+    initial_model(&orig, 40);
+    m = orig;
+    run("COW", &m);
+    set_str(&m, 130, "X");
+    check("COW", "M", &m);
+    check("COW", "C", &orig);
+    vartype_realmatrix *cm = (vartype_realmatrix *) recall_var("C", 1);
+    vartype_realmatrix *mm = (vartype_realmatrix *) recall_var("M", 1);
+    if (mm->array->source != cm->array || mm->array->chunks_left != 3) {
+        printf("FAIL COW: M is not a copy in progress of C with one chunk "
+               "copied\n");
+        failures++;
+    }
+    /* Purging C leaves its array alive as M's source */
+    purge_var("C", 1);
+    check("COW", "M", &m);
+    /* Which goes away once M no longer needs it */
+    matrix_data(mm->array);
+    check("COW", "M", &m);
+    if (mm->array->source != NULL) {
+        printf("FAIL COW: matrix_data() did not finish the copy\n");
+        failures++;
+    }
+    purge_var("M", 1);
+    get_matrix_data_stats(&blocks, &bytes);
+    if (blocks != blocks_before - 1) {
+        printf("FAIL COW: %d matrix blocks left, expected %d\n",
+               blocks, blocks_before - 1);
+        failures++;
+    }
+
+    if (failures == 0)
+        printf("matrix_flags_test: all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Minimal shell for the tests: no display, no keyboard, no printer. The
+ * tests drive the core directly, so none of these callbacks need to do
+ * anything beyond returning something sensible.
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "shell.h"
+
+
+const char *shell_platform() {
+    return VERSION " " VERSION_PLATFORM " test";
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {}
+void shell_beeper(int frequency, int duration) {}
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {}
+int shell_wants_cpu() { return 0; }
+void shell_delay(int duration) {}
+void shell_request_timeout3(int delay) {}
+uint4 shell_get_mem() { return 0; }
+int shell_low_battery() { return 0; }
+void shell_powerdown() {}
+int8 shell_random_seed() { return 42; }
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+int shell_decimal_point() { return 1; }
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    if (time != NULL)
+        *time = 0;
+    if (date != NULL)
+        *date = 20200101;
+    if (weekday != NULL)
+        *weekday = 3;
+}
+
+void shell_message(const char *message) {
+    fprintf(stderr, "%s\n", message);
+}
+
+void shell_log(const char *message) {
+    fprintf(stderr, "%s\n", message);
+}
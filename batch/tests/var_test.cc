@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* Checks that the variable index, which is updated in place as variables
+ * are created, purged, hidden, and unhidden, stays in agreement with the
+ * variable table. A random sequence of global and local stores, purges,
+ * calls, and returns is run, and after every step, lookup_var() is compared
+ * against a plain scan of the table for every name in use.
+ */
+
+#include <stdio.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_variables.h"
+
+/* Enough names to make the index grow and leave tombstones behind, and
+ * short ones, so that some of them share hash slots.
+ */
+#define NAMES 80
+#define STEPS 20000
+#define MAX_DEPTH 8
+
+static char names[NAMES][8];
+static int lengths[NAMES];
+static uint4 seed = 12345;
+static int failures = 0;
+
+static int next_random(int n) {
+    seed = seed * 1103515245 + 12345;
+    return (int) ((seed >> 16) % n);
+}
+
+static int scan(int n) {
+    for (int i = vars_count - 1; i >= 0; i--)
+        if (!vars[i].hidden
+                && string_equals(vars[i].name, vars[i].length,
+                                 names[n], lengths[n]))
+            return i;
+    return -1;
+}
+
+static void check(int step, const char *what, int n) {
+    for (int i = 0; i < NAMES; i++) {
+        int expected = scan(i);
+        int actual = lookup_var(names[i], lengths[i]);
+        int visible = 0;
+        for (int j = 0; j < vars_count; j++)
+            if (!vars[j].hidden
+                    && string_equals(vars[j].name, vars[j].length,
+                                     names[i], lengths[i]))
+                visible++;
+        if (actual != expected || visible > 1) {
+            printf("FAIL step %d (%s %.*s): \"%.*s\" found at %d, "
+                   "expected %d, %d visible\n", step, what, lengths[n],
+                   names[n], lengths[i], names[i], actual, expected, visible);
+            failures++;
+            return;
+        }
+    }
+    for (int j = 0; j < vars_count; j++)
+        if (vars[j].level > get_rtn_level()) {
+            printf("FAIL step %d (%s): local \"%.*s\" outlived level %d\n",
+                   step, what, vars[j].length, vars[j].name, vars[j].level);
+            failures++;
+            return;
+        }
+}
+
+int main(int argc, char *argv[]) {
+    core_init(0, 0, NULL, 0);
+    for (int i = 0; i < NAMES; i++) {
+        lengths[i] = i % 7 + 1;
+        for (int j = 0; j < lengths[i]; j++)
+            names[i][j] = (char) ('A' + (i * 7 + j * 3) % 26);
+    }
+
+    for (int step = 0; step < STEPS && failures == 0; step++) {
+        int n = next_random(NAMES);
+        int op = next_random(100);
+        /* XEQ at the maximum depth, and RTN at level 0, are skipped */
+        if ((op >= 80 && op < 90 && get_rtn_level() == MAX_DEPTH)
+                || (op >= 90 && get_rtn_level() == 0))
+            continue;
+        const char *what;
+        if (op < 35) {
+            what = "STO";
+            store_var(names[n], lengths[n], new_real(step));
+        } else if (op < 60) {
+            what = "LSTO";
+            store_var(names[n], lengths[n], new_real(step), true);
+        } else if (op < 80) {
+            what = "PURGE";
+            purge_var(names[n], lengths[n]);
+        } else if (op < 90) {
+            what = "XEQ";
+            push_rtn_addr(0, 0);
+        } else {
+            int prgm;
+            int4 pc;
+            bool stop;
+            what = "RTN";
+            pop_rtn_addr(&prgm, &pc, &stop);
+        }
+        check(step, what, n);
+    }
+
+    /* Return all the way up, which unhides everything hidden by locals
+     * created below level 0
+     */
+    while (failures == 0 && get_rtn_level() > 0) {
+        int prgm;
+        int4 pc;
+        bool stop;
+        pop_rtn_addr(&prgm, &pc, &stop);
+        check(STEPS, "RTN", 0);
+    }
+
+    if (failures == 0)
+        printf("var_test: all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -40,10 +40,16 @@ int docmd_clx(arg_struct *arg) {
 }
 
 int docmd_enter(arg_struct *arg) {
-    vartype *v = dup_vartype(reg_x);
-    if (v == NULL)
-        return ERR_INSUFFICIENT_MEMORY;
-    free_vartype(reg_t);
+    vartype *v;
+    if (overwrite_scalar(reg_t, reg_x))
+        /* T is about to be discarded, so it can hold the copy of X */
+        v = reg_t;
+    else {
+        v = dup_vartype(reg_x);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        free_vartype(reg_t);
+    }
     reg_t = reg_z;
     reg_z = reg_y;
     reg_y = v;
@@ -87,14 +93,11 @@ int docmd_chs(arg_struct *arg) {
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) reg_x;
             int4 sz = rm->rows * rm->columns;
-            int4 i;
-            for (i = 0; i < sz; i++)
-                if (rm->array->is_string[i])
-                    return ERR_ALPHA_DATA_IS_INVALID;
+            if (!contains_no_strings(rm))
+                return ERR_ALPHA_DATA_IS_INVALID;
             if (!disentangle((vartype *) rm))
                 return ERR_INSUFFICIENT_MEMORY;
-            for (i = 0; i < sz; i++)
-                rm->array->data[i] = -(rm->array->data[i]);
+            array_chs_r(matrix_data(rm->array), matrix_data(rm->array), sz);
             break;
         }
         case TYPE_COMPLEXMATRIX: {
@@ -104,7 +107,7 @@ int docmd_chs(arg_struct *arg) {
             if (!disentangle((vartype *) cm))
                 return ERR_INSUFFICIENT_MEMORY;
             for (i = 0; i < sz; i++)
-                cm->array->data[i] = -(cm->array->data[i]);
+                matrix_data(cm->array)[i] = -(matrix_data(cm->array)[i]);
             break;
         }
         case TYPE_STRING:
@@ -121,6 +124,8 @@ static void docmd_div_completion(int error, vartype *res) {
 }
 
 int docmd_div(arg_struct *arg) {
+    if (reg_x->type == TYPE_REAL && reg_y->type == TYPE_REAL)
+        return binary_real_result(div_rr);
     return generic_div(reg_x, reg_y, docmd_div_completion);
 }
 
@@ -130,10 +135,14 @@ static void docmd_mul_completion(int error, vartype *res) {
 }
 
 int docmd_mul(arg_struct *arg) {
+    if (reg_x->type == TYPE_REAL && reg_y->type == TYPE_REAL)
+        return binary_real_result(mul_rr);
     return generic_mul(reg_x, reg_y, docmd_mul_completion);
 }
 
 int docmd_sub(arg_struct *arg) {
+    if (reg_x->type == TYPE_REAL && reg_y->type == TYPE_REAL)
+        return binary_real_result(sub_rr);
     vartype *res;
     int error = generic_sub(reg_x, reg_y, &res);
     if (error == ERR_NONE)
@@ -142,6 +151,8 @@ int docmd_sub(arg_struct *arg) {
 }
 
 int docmd_add(arg_struct *arg) {
+    if (reg_x->type == TYPE_REAL && reg_y->type == TYPE_REAL)
+        return binary_real_result(add_rr);
     vartype *res;
     int error = generic_add(reg_x, reg_y, &res);
     if (error == ERR_NONE)
@@ -150,11 +161,7 @@ int docmd_add(arg_struct *arg) {
 }
 
 int docmd_lastx(arg_struct *arg) {
-    vartype *v = dup_vartype(reg_lastx);
-    if (v == NULL)
-        return ERR_INSUFFICIENT_MEMORY;
-    recall_result(v);
-    return ERR_NONE;
+    return recall_copy(reg_lastx);
 }
 
 int docmd_complex(arg_struct *arg) {
@@ -235,12 +242,8 @@ int docmd_complex(arg_struct *arg) {
                     return ERR_DIMENSION_ERROR;
 
                 sz = re_m->rows * re_m->columns;
-                for (i = 0; i < sz; i++)
-                    if (re_m->array->is_string[i])
-                        return ERR_ALPHA_DATA_IS_INVALID;
-                for (i = 0; i < sz; i++)
-                    if (im_m->array->is_string[i])
-                        return ERR_ALPHA_DATA_IS_INVALID;
+                if (!contains_no_strings(re_m) || !contains_no_strings(im_m))
+                    return ERR_ALPHA_DATA_IS_INVALID;
 
                 cm = (vartype_complexmatrix *)
                                 new_complexmatrix(re_m->rows, re_m->columns);
@@ -248,15 +251,17 @@ int docmd_complex(arg_struct *arg) {
                     return ERR_INSUFFICIENT_MEMORY;
                 if (flags.f.polar) {
                     for (i = 0; i < sz; i++) {
-                        generic_p2r(re_m->array->data[i],
-                                    im_m->array->data[i],
-                                    &cm->array->data[2 * i],
-                                    &cm->array->data[2 * i + 1]);
+                        generic_p2r(matrix_data(re_m->array)[i],
+                                    matrix_data(im_m->array)[i],
+                                    &matrix_data(cm->array)[2 * i],
+                                    &matrix_data(cm->array)[2 * i + 1]);
                     }
                 } else {
                     for (i = 0; i < sz; i++) {
-                        cm->array->data[2 * i] = re_m->array->data[i];
-                        cm->array->data[2 * i + 1] = im_m->array->data[i];
+                        matrix_data(cm->array)[2 * i] =
+                                matrix_data(re_m->array)[i];
+                        matrix_data(cm->array)[2 * i + 1] =
+                                matrix_data(im_m->array)[i];
                     }
                 }
                 free_vartype(reg_lastx);
@@ -287,8 +292,8 @@ int docmd_complex(arg_struct *arg) {
             if (flags.f.polar) {
                 for (i = 0; i < sz; i++) {
                     phloat r, phi;
-                    generic_r2p(cm->array->data[2 * i],
-                                cm->array->data[2 * i + 1], &r, &phi);
+                    generic_r2p(matrix_data(cm->array)[2 * i],
+                                matrix_data(cm->array)[2 * i + 1], &r, &phi);
                     if (p_isinf(r) != 0)
                         if (flags.f.range_error_ignore)
                             r = POS_HUGE_PHLOAT;
@@ -297,13 +302,14 @@ int docmd_complex(arg_struct *arg) {
                             free_vartype((vartype *) im_m);
                             return ERR_OUT_OF_RANGE;
                         }
-                    re_m->array->data[i] = r;
-                    im_m->array->data[i] = phi;
+                    matrix_data(re_m->array)[i] = r;
+                    matrix_data(im_m->array)[i] = phi;
                 }
             } else {
                 for (i = 0; i < sz; i++) {
-                    re_m->array->data[i] = cm->array->data[2 * i];
-                    im_m->array->data[i] = cm->array->data[2 * i + 1];
+                    matrix_data(re_m->array)[i] = matrix_data(cm->array)[2 * i];
+                    matrix_data(im_m->array)[i] =
+                            matrix_data(cm->array)[2 * i + 1];
                 }
             }
             free_vartype(reg_lastx);
@@ -345,7 +351,12 @@ int docmd_sto_add(arg_struct *arg) {
 
 int docmd_rcl(arg_struct *arg) {
     vartype *v;
-    int err = generic_rcl(arg, &v);
+    int err = rcl_source(arg, &v);
+    if (err != ERR_NONE)
+        return err;
+    if (v != NULL)
+        return recall_copy(v);
+    err = generic_rcl(arg, &v);
     if (err == ERR_NONE)
         recall_result(v);
     return err;
@@ -661,10 +672,9 @@ int docmd_clsigma(arg_struct *arg) {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
-    for (i = first; i < last; i++) {
-        r->array->is_string[i] = 0;
-        r->array->data[i] = 0;
-    }
+    clear_is_string(r->array, first, last - first);
+    for (i = first; i < last; i++)
+        matrix_data(r->array)[i] = 0;
     flags.f.log_fit_invalid = 0;
     flags.f.exp_fit_invalid = 0;
     flags.f.pwr_fit_invalid = 0;
@@ -721,9 +731,8 @@ int docmd_clrg(arg_struct *arg) {
         rm = (vartype_realmatrix *) regs;
         sz = rm->rows * rm->columns;
         for (i = 0; i < sz; i++)
-            rm->array->data[i] = 0;
-        for (i = 0; i < sz; i++)
-            rm->array->is_string[i] = 0;
+            matrix_data(rm->array)[i] = 0;
+        clear_is_string(rm->array, 0, sz);
         return ERR_NONE;
     } else if (regs->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm;
@@ -733,7 +742,7 @@ int docmd_clrg(arg_struct *arg) {
         cm = (vartype_complexmatrix *) regs;
         sz = 2 * cm->rows * cm->columns;
         for (i = 0; i < sz; i++)
-            cm->array->data[i] = 0;
+            matrix_data(cm->array)[i] = 0;
         return ERR_NONE;
     } else {
         /* Should not happen; STO does not allow anything other
@@ -1271,19 +1280,14 @@ int docmd_abs(arg_struct *arg) {
                 return ERR_ALPHA_DATA_IS_INVALID;
             vartype_realmatrix *src;
             vartype_realmatrix *dst;
-            int4 size, i;
+            int4 size;
             src = (vartype_realmatrix *) reg_x;
             dst = (vartype_realmatrix *)
                                 new_realmatrix(src->rows, src->columns);
             if (dst == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
             size = src->rows * src->columns;
-            for (i = 0; i < size; i++) {
-                phloat x = src->array->data[i];
-                if (x < 0)
-                    x = -x;
-                dst->array->data[i] = x;
-            }
+            array_abs_r(matrix_data(src->array), matrix_data(dst->array), size);
             unary_result((vartype *) dst);
             return ERR_NONE;
         }
@@ -1349,10 +1353,11 @@ int docmd_sign(arg_struct *arg) {
                 return ERR_INSUFFICIENT_MEMORY;
             size = src->rows * src->columns;
             for (i = 0; i < size; i++) {
-                if (src->array->is_string[i])
-                    dst->array->data[i] = 0;
+                if (IS_STRING(src->array, i))
+                    matrix_data(dst->array)[i] = 0;
                 else
-                    dst->array->data[i] = src->array->data[i] < 0 ? -1 : 1;
+                    matrix_data(dst->array)[i] =
+                            matrix_data(src->array)[i] < 0 ? -1 : 1;
             }
             unary_result((vartype *) dst);
             return ERR_NONE;
@@ -578,7 +578,75 @@ int docmd_pse(arg_struct *arg) {
     return ERR_NONE;
 }
 
+#ifdef BCD_MATH
+/* Fast path for loop control values of the form C * 10^e, with e between
+ * -15 and 0 and a coefficient below 2^62, which covers any sensible
+ * ccccccc.fffii. All the steps of the general case below are exact for such
+ * values, so they can be done on the integer C instead, giving the same
+ * result, down to the exponent of the updated value. Returns false if the
+ * general case has to handle it.
+ */
+static bool generic_loop_fast(phloat *x, bool isg, int *err) {
+    uint8 c;
+    int e;
+    if (!phloat_unpack(x->val, &c, &e) || (c >> 62) != 0)
+        return false;
+    e = BID128_EXP_BIAS - e;
+    if (e < 0 || e > 15)
+        return false;
+    uint8 scale = phloat_pow10[e];
+    int8 i = (int8) (c / scale);
+    uint8 f = c % scale;
+    int4 j, k;
+    if (e <= 5)
+        k = (int4) (f * phloat_pow10[5 - e]);
+    else
+        k = (int4) (f / phloat_pow10[e - 5]);
+    j = k / 100;
+    k -= j * 100;
+    if (k == 0)
+        k = 1;
+
+    int8 n = (BID128_HI(x->val) & BID128_SIGN_MASK) != 0 ? -(int8) c : c;
+    int s = n < 0 ? -1 : 1;
+    int8 ks = k * scale;
+    if (isg) {
+        if (n < 0 && n > -ks)
+            n = -n + ks - 2 * i * (int8) scale;
+        else
+            n += ks;
+    } else {
+        if (n > 0 && n < ks)
+            n = -n - ks + 2 * i * (int8) scale;
+        else
+            n -= ks;
+    }
+    phloat_set_int(&x->val, n < 0, n < 0 ? -n : n);
+    BID128_HI(x->val) -= (uint8) e << 49;
+
+    if (isg) {
+        if (s == -1)
+            i = k - i;
+        else
+            i = k + i;
+        *err = i > j ? ERR_NO : ERR_YES;
+    } else {
+        if (s == -1)
+            i = -i - k;
+        else
+            i = i - k;
+        *err = i <= j ? ERR_NO : ERR_YES;
+    }
+    return true;
+}
+#endif
+
 static int generic_loop_helper(phloat *x, bool isg) {
+    #ifdef BCD_MATH
+        int err;
+        if (generic_loop_fast(x, isg, &err))
+            return err;
+    #endif
     phloat t;
     #ifdef BCD_MATH
         phloat i;
@@ -683,12 +751,13 @@ static int generic_loop(arg_struct *arg, bool isg) {
                 int4 index = arg->val.num;
                 if (index >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[index])
+                if (IS_STRING(rm->array, index))
                     return ERR_ALPHA_DATA_IS_INVALID;
                 else {
-                    if (!disentangle(regs))
+                    if (!disentangle_element(regs, index))
                         return ERR_INSUFFICIENT_MEMORY;
-                    return generic_loop_helper(&rm->array->data[index], isg);
+                    return generic_loop_helper(matrix_element(rm->array, index),
+                                               isg);
                 }
             } else if (regs->type == TYPE_COMPLEXMATRIX) {
                 return ERR_INVALID_TYPE;
@@ -770,15 +839,16 @@ int docmd_xtoa(arg_struct *arg) {
         char buf[44];
         int buflen = 0;
         for (i = size - 1; i >= 0; i--) {
-            if (m->array->is_string[i]) {
+            phloat *e = matrix_element(m->array, i);
+            if (IS_STRING(m->array, i)) {
                 int j;
-                for (j = phloat_length(m->array->data[i]) - 1; j >= 0; j--) {
-                    buf[buflen++] = phloat_text(m->array->data[i])[j];
+                for (j = phloat_length(*e) - 1; j >= 0; j--) {
+                    buf[buflen++] = phloat_text(*e)[j];
                     if (buflen == 44)
                         goto done;
                 }
             } else {
-                phloat d = m->array->data[i];
+                phloat d = *e;
                 if (d < 0)
                     d = -d;
                 if (d >= 256)
@@ -825,8 +895,9 @@ int docmd_agraph(arg_struct *arg) {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) reg_x;
             int4 size = 2 * cm->rows * cm->columns;
             int4 i;
+            phloat *data = matrix_data(cm->array);
             for (i = 0; i < size; i += 2)
-                draw_pattern(cm->array->data[i], cm->array->data[i + 1],
+                draw_pattern(data[i], data[i + 1],
                              reg_alpha, reg_alpha_length);
             flush_display();
             flags.f.message = flags.f.two_line_message = 1;
@@ -886,8 +957,9 @@ int docmd_pixel(arg_struct *arg) {
         vartype_complexmatrix *m = (vartype_complexmatrix *) reg_x;
         int4 size = 2 * m->rows * m->columns;
         int4 i;
+        phloat *data = matrix_data(m->array);
         for (i = 0; i < size; i += 2)
-            pixel_helper(m->array->data[i], m->array->data[i + 1]);
+            pixel_helper(data[i], data[i + 1]);
         flush_display();
         flags.f.message = flags.f.two_line_message = 1;
         return ERR_NONE;
@@ -1036,18 +1108,18 @@ int docmd_x_eq_y(arg_struct *arg) {
                 return ERR_NO;
             sz = x->rows * x->columns;
             for (i = 0; i < sz; i++) {
-                int xstr = x->array->is_string[i];
-                int ystr = y->array->is_string[i];
+                int xstr = IS_STRING(x->array, i);
+                int ystr = IS_STRING(y->array, i);
                 if (xstr != ystr)
                     return ERR_NO;
                 if (xstr) {
-                    if (!string_equals(phloat_text(x->array->data[i]),
-                                       phloat_length(x->array->data[i]),
-                                       phloat_text(y->array->data[i]),
-                                       phloat_length(y->array->data[i])))
+                    if (!string_equals(phloat_text(matrix_data(x->array)[i]),
+                                       phloat_length(matrix_data(x->array)[i]),
+                                       phloat_text(matrix_data(y->array)[i]),
+                                       phloat_length(matrix_data(y->array)[i])))
                         return ERR_NO;
                 } else {
-                    if (x->array->data[i] != y->array->data[i])
+                    if (matrix_data(x->array)[i] != matrix_data(y->array)[i])
                         return ERR_NO;
                 }
             }
@@ -1061,7 +1133,7 @@ int docmd_x_eq_y(arg_struct *arg) {
                 return ERR_NO;
             sz = 2 * x->rows * x->columns;
             for (i = 0; i < sz; i++)
-                if (x->array->data[i] != y->array->data[i])
+                if (matrix_data(x->array)[i] != matrix_data(y->array)[i])
                     return ERR_NO;
             return ERR_YES;
         }
@@ -1215,14 +1287,14 @@ int docmd_prsigma(arg_struct *arg) {
     print_text(NULL, 0, 1);
     for (i = 0; i < nr; i++) {
         int4 j = i + mode_sigma_reg;
-        if (rm->array->is_string[j]) {
+        phloat *d = matrix_element(rm->array, j);
+        if (IS_STRING(rm->array, j)) {
             bufptr = 0;
             char2buf(buf, 100, &bufptr, '"');
-            string2buf(buf, 100, &bufptr, phloat_text(rm->array->data[j]),
-                                          phloat_length(rm->array->data[j]));
+            string2buf(buf, 100, &bufptr, phloat_text(*d), phloat_length(*d));
             char2buf(buf, 100, &bufptr, '"');
         } else
-            bufptr = easy_phloat2string(rm->array->data[j], buf, 100, 0);
+            bufptr = easy_phloat2string(*d, buf, 100, 0);
         print_wide(sigma_labels[i].text, sigma_labels[i].length, buf, bufptr);
     }
     shell_annunciators(-1, -1, 0, -1, -1, -1);
@@ -1310,15 +1382,14 @@ static int prv_worker(int interrupted) {
         char2buf(lbuf, 32, &llen, ':');
         llen += int2string(j + 1, lbuf + llen, 32 - llen);
         char2buf(lbuf, 32, &llen, '=');
-        if (rm->array->is_string[prv_index]) {
+        phloat *d = matrix_element(rm->array, prv_index);
+        if (IS_STRING(rm->array, prv_index)) {
             rlen = 0;
             char2buf(rbuf, 100, &rlen, '"');
-            string2buf(rbuf, 100, &rlen, phloat_text(rm->array->data[prv_index]),
-                                    phloat_length(rm->array->data[prv_index]));
+            string2buf(rbuf, 100, &rlen, phloat_text(*d), phloat_length(*d));
             char2buf(rbuf, 100, &rlen, '"');
         } else
-            rlen = easy_phloat2string(rm->array->data[prv_index],
-                                        rbuf, 100, 0);
+            rlen = easy_phloat2string(*d, rbuf, 100, 0);
         print_wide(lbuf, llen, rbuf, rlen);
     } else /* prv_var->type == TYPE_COMPLEXMATRIX) */ {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) prv_var;
@@ -1331,8 +1402,8 @@ static int prv_worker(int interrupted) {
         char2buf(lbuf, 32, &llen, ':');
         llen += int2string(j + 1, lbuf + llen, 32 - llen);
         char2buf(lbuf, 32, &llen, '=');
-        cpx.re = cm->array->data[2 * prv_index];
-        cpx.im = cm->array->data[2 * prv_index + 1];
+        cpx.re = matrix_element(cm->array, prv_index)[0];
+        cpx.im = matrix_element(cm->array, prv_index)[1];
         rlen = vartype2string((vartype *) &cpx, rbuf, 100);
         print_wide(lbuf, llen, rbuf, rlen);
     }
@@ -1609,6 +1680,7 @@ int docmd_gto(arg_struct *arg) {
             current_prgm = new_prgm;
             pc = new_pc;
             prgm_highlight_row = 1;
+            profile_call();
             return ERR_NONE;
         } else
             return ERR_LABEL_NOT_FOUND;
@@ -1635,6 +1707,7 @@ int docmd_gto(arg_struct *arg) {
                 current_prgm = newprgm;
                 pc = newpc;
                 prgm_highlight_row = 1;
+                profile_call();
                 return ERR_NONE;
             } else
                 return ERR_LABEL_NOT_FOUND;
@@ -1646,6 +1719,7 @@ int docmd_gto(arg_struct *arg) {
         current_prgm = labels[labelindex].prgm;
         pc = labels[labelindex].pc;
         prgm_highlight_row = 1;
+        profile_call();
         return ERR_NONE;
     }
 
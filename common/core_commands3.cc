@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core_commands1.h"
 #include "core_commands2.h"
@@ -304,28 +305,25 @@ int docmd_cross(arg_struct *arg) {
         vartype_realmatrix *right = (vartype_realmatrix *) reg_x;
         int4 ls = left->rows * left->columns;
         int4 rs = right->rows * right->columns;
-        int4 i;
         int inf;
         phloat xl, yl = 0, zl = 0, xr, yr = 0, zr = 0;
         phloat xres, yres, zres;
         vartype_realmatrix *res;
         if (ls > 3 || rs > 3)
             return ERR_DIMENSION_ERROR;
-        for (i = 0; i < ls; i++)
-            if (left->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < rs; i++)
-            if (right->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
+        if (!contains_no_strings(left))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        if (!contains_no_strings(right))
+            return ERR_ALPHA_DATA_IS_INVALID;
         switch (ls) {
-            case 3: zl = left->array->data[2];
-            case 2: yl = left->array->data[1];
-            case 1: xl = left->array->data[0];
+            case 3: zl = matrix_data(left->array)[2];
+            case 2: yl = matrix_data(left->array)[1];
+            case 1: xl = matrix_data(left->array)[0];
         }
         switch (rs) {
-            case 3: zr = right->array->data[2];
-            case 2: yr = right->array->data[1];
-            case 1: xr = right->array->data[0];
+            case 3: zr = matrix_data(right->array)[2];
+            case 2: yr = matrix_data(right->array)[1];
+            case 1: xr = matrix_data(right->array)[0];
         }
         xres = yl * zr - zl * yr;
         if ((inf = p_isinf(xres)) != 0) {
@@ -351,9 +349,9 @@ int docmd_cross(arg_struct *arg) {
         res = (vartype_realmatrix *) new_realmatrix(1, 3);
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        res->array->data[0] = xres;
-        res->array->data[1] = yres;
-        res->array->data[2] = zres;
+        matrix_data(res->array)[0] = xres;
+        matrix_data(res->array)[1] = yres;
+        matrix_data(res->array)[2] = zres;
         binary_result((vartype *) res);
         return ERR_NONE;
     } else
@@ -430,14 +428,14 @@ int docmd_delr(arg_struct *arg) {
     interactive = matedit_mode == 2 || matedit_mode == 3;
     if (interactive) {
         if (m->type == TYPE_REALMATRIX) {
-            if (rm->array->is_string[n])
-                newx = new_string(phloat_text(rm->array->data[n]),
-                                  phloat_length(rm->array->data[n]));
+            if (IS_STRING(rm->array, n))
+                newx = new_string(phloat_text(matrix_data(rm->array)[n]),
+                                  phloat_length(matrix_data(rm->array)[n]));
             else
-                newx = new_real(rm->array->data[n]);
+                newx = new_real(matrix_data(rm->array)[n]);
         } else
-            newx = new_complex(cm->array->data[2 * n],
-                               cm->array->data[2 * n + 1]);
+            newx = new_complex(matrix_data(cm->array)[2 * n],
+                               matrix_data(cm->array)[2 * n + 1]);
 
         if (newx == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -451,56 +449,56 @@ int docmd_delr(arg_struct *arg) {
          * of all, no temporary memory allocations needed!
          */
         if (m->type == TYPE_REALMATRIX) {
+            phloat *data = matrix_data(rm->array);
             for (j = 0; j < columns; j++) {
-                phloat tempd = rm->array->data[matedit_i * columns + j];
-                char tempc = rm->array->is_string[matedit_i * columns + j];
+                phloat tempd = data[matedit_i * columns + j];
+                char tempc = IS_STRING(rm->array, matedit_i * columns + j);
                 for (i = matedit_i; i < rows - 1; i++) {
-                    rm->array->data[i * columns + j] =
-                                rm->array->data[(i + 1) * columns + j];
-                    rm->array->is_string[i * columns + j] =
-                                rm->array->is_string[(i + 1) * columns + j];
+                    data[i * columns + j] = data[(i + 1) * columns + j];
+                    set_is_string(rm->array, i * columns + j,
+                            IS_STRING(rm->array, (i + 1) * columns + j));
                 }
-                rm->array->data[(rows - 1) * columns + j] = tempd;
-                rm->array->is_string[(rows - 1) * columns + j] = tempc;
+                data[(rows - 1) * columns + j] = tempd;
+                set_is_string(rm->array, (rows - 1) * columns + j, tempc);
             }
             err = dimension_array_ref(m, rows - 1, columns);
             if (err != ERR_NONE) {
                 /* Dang! Now we have to rotate everything back to where
                  * it was before. */
                 for (j = 0; j < columns; j++) {
-                    phloat tempd = rm->array->data[(rows - 1) * columns + j];
-                    char tempc = rm->array->is_string[(rows - 1) * columns + j];
+                    phloat tempd = data[(rows - 1) * columns + j];
+                    char tempc = IS_STRING(rm->array, (rows - 1) * columns + j);
                     for (i = rows - 1; i > matedit_i; i--) {
-                        rm->array->data[i * columns + j] =
-                                    rm->array->data[(i - 1) * columns + j];
-                        rm->array->is_string[i * columns + j] =
-                                    rm->array->is_string[(i - 1) * columns + j];
+                        data[i * columns + j] = data[(i - 1) * columns + j];
+                        set_is_string(rm->array, i * columns + j,
+                                IS_STRING(rm->array, (i - 1) * columns + j));
                     }
-                    rm->array->data[matedit_i * columns + j] = tempd;
-                    rm->array->is_string[matedit_i * columns + j] = tempc;
+                    data[matedit_i * columns + j] = tempd;
+                    set_is_string(rm->array, matedit_i * columns + j, tempc);
                 }
                 if (interactive)
                     free_vartype(newx);
                 return err;
             }
         } else {
+            phloat *data = matrix_data(cm->array);
             for (j = 0; j < 2 * columns; j++) {
-                phloat tempd = cm->array->data[matedit_i * 2 * columns + j];
+                phloat tempd = data[matedit_i * 2 * columns + j];
                 for (i = matedit_i; i < rows - 1; i++)
-                    cm->array->data[i * 2 * columns + j] =
-                                cm->array->data[(i + 1) * 2 * columns + j];
-                cm->array->data[(rows - 1) * 2 * columns + j] = tempd;
+                    data[i * 2 * columns + j] =
+                                data[(i + 1) * 2 * columns + j];
+                data[(rows - 1) * 2 * columns + j] = tempd;
             }
             err = dimension_array_ref(m, rows - 1, columns);
             if (err != ERR_NONE) {
                 /* Dang! Now we have to rotate everything back to where
                  * it was before. */
                 for (j = 0; j < 2 * columns; j++) {
-                    phloat tempd = cm->array->data[(rows - 1) * 2 * columns + j];
+                    phloat tempd = data[(rows - 1) * 2 * columns + j];
                     for (i = rows - 1; i > matedit_i; i--)
-                        cm->array->data[i * 2 * columns + j] =
-                                    cm->array->data[(i - 1) * 2 * columns + j];
-                    cm->array->data[matedit_i * 2 * columns + j] = tempd;
+                        data[i * 2 * columns + j] =
+                                    data[(i - 1) * 2 * columns + j];
+                    data[matedit_i * 2 * columns + j] = tempd;
                 }
                 if (interactive)
                     free_vartype(newx);
@@ -512,60 +510,32 @@ int docmd_delr(arg_struct *arg) {
          * does not deal with resizing. */
         int4 newsize = (rows - 1) * columns;
         if (m->type == TYPE_REALMATRIX) {
-            realmatrix_data *array = (realmatrix_data *)
-                                malloc(sizeof(realmatrix_data));
+            realmatrix_data *array = new_realmatrix_data(newsize);
             if (array == NULL) {
                 if (interactive)
                     free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->data = (phloat *) malloc(newsize * sizeof(phloat));
-            if (array->data == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            array->is_string = (char *) malloc(newsize);
-            if (array->is_string == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array->data);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
-                array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i + columns];
-                array->data[i] = rm->array->data[i + columns];
-            }
-            array->refcount = 1;
+            i = matedit_i * columns;
+            memcpy(array->data, matrix_data(rm->array), i * sizeof(phloat));
+            copy_is_string(array, 0, rm->array, 0, i);
+            memcpy(array->data + i, matrix_data(rm->array) + i + columns,
+                   (newsize - i) * sizeof(phloat));
+            copy_is_string(array, i, rm->array, i + columns, newsize - i);
             rm->array->refcount--;
             rm->array = array;
             rm->rows--;
         } else {
-            complexmatrix_data *array = (complexmatrix_data *)
-                                malloc(sizeof(complexmatrix_data));
+            complexmatrix_data *array = new_complexmatrix_data(newsize);
             if (array == NULL) {
                 if (interactive)
                     free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->data = (phloat *) malloc(2 * newsize * sizeof(phloat));
-            if (array->data == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            for (i = 0; i < 2 * matedit_i * columns; i++)
-                array->data[i] = cm->array->data[i];
-            for (i = 2 * matedit_i * columns; i < 2 * newsize; i++)
-                array->data[i] = cm->array->data[i + 2 * columns];
-            array->refcount = 1;
+            i = 2 * matedit_i * columns;
+            memcpy(array->data, matrix_data(cm->array), i * sizeof(phloat));
+            memcpy(array->data + i, matrix_data(cm->array) + i + 2 * columns,
+                   (2 * newsize - i) * sizeof(phloat));
             cm->array->refcount--;
             cm->array = array;
             cm->rows--;
@@ -633,10 +603,10 @@ int docmd_dim(arg_struct *arg) {
 
 int docmd_dot(arg_struct *arg) {
     /* TODO: look for range errors in intermediate results.
-     * Right now, 1e6000+1e6000i DOT 1e6000-1e6000i returns NaN
-     * in the Decimal build, because two infinities of opposite
-     * signs are added. 1e300+1e300i DOT 1e300-1e300i probably
-     * does the same in the Binary build.
+     * In the Decimal build, the products are accumulated exactly, so
+     * 1e6000+1e6000i DOT 1e6000-1e6000i is fine, but in the Binary
+     * build, 1e300+1e300i DOT 1e300-1e300i probably returns NaN,
+     * because two infinities of opposite signs are added.
      */
     vartype *v;
     if (reg_x->type == TYPE_STRING || reg_y->type == TYPE_STRING)
@@ -646,15 +616,19 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm2 = (vartype_realmatrix *) reg_y;
         int4 size = rm1->rows * rm1->columns;
         int4 i;
-        phloat dot = 0;
+        dot_acc acc;
+        phloat dot;
         int inf;
         if (size != rm2->rows * rm2->columns)
             return ERR_DIMENSION_ERROR;
+        if (!contains_no_strings(rm1) || !contains_no_strings(rm2))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        dot_init(&acc);
+        phloat *data1 = matrix_data(rm1->array);
+        phloat *data2 = matrix_data(rm2->array);
         for (i = 0; i < size; i++)
-            if (rm1->array->is_string[i] || rm2->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++)
-            dot += rm1->array->data[i] * rm2->array->data[i];
+            dot_add(&acc, data1[i], data2[i]);
+        dot = dot_result(&acc);
         if ((inf = p_isinf(dot)) != 0) {
             if (flags.f.range_error_ignore)
                 dot = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -670,7 +644,8 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm;
         vartype_complexmatrix *cm;
         int4 size, i;
-        phloat dot_re = 0, dot_im = 0;
+        dot_acc acc_re, acc_im;
+        phloat dot_re, dot_im;
         int inf;
         if (reg_x->type == TYPE_REALMATRIX) {
             rm = (vartype_realmatrix *) reg_x;
@@ -682,13 +657,18 @@ int docmd_dot(arg_struct *arg) {
         size = rm->rows * rm->columns;
         if (size != cm->rows * cm->columns)
             return ERR_DIMENSION_ERROR;
-        for (i = 0; i < size; i++)
-            if (rm->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
+        if (!contains_no_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        dot_init(&acc_re);
+        dot_init(&acc_im);
+        phloat *rdata = matrix_data(rm->array);
+        phloat *cdata = matrix_data(cm->array);
         for (i = 0; i < size; i++) {
-            dot_re += rm->array->data[i] * cm->array->data[2 * i];
-            dot_im += rm->array->data[i] * cm->array->data[2 * i + 1];
+            dot_add(&acc_re, rdata[i], cdata[2 * i]);
+            dot_add(&acc_im, rdata[i], cdata[2 * i + 1]);
         }
+        dot_re = dot_result(&acc_re);
+        dot_im = dot_result(&acc_im);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -707,20 +687,24 @@ int docmd_dot(arg_struct *arg) {
         vartype_complexmatrix *cm1 = (vartype_complexmatrix *) reg_x;
         vartype_complexmatrix *cm2 = (vartype_complexmatrix *) reg_y;
         int4 size, i;
-        phloat dot_re = 0, dot_im = 0;
+        dot_acc acc_re, acc_im;
+        phloat dot_re, dot_im;
         int inf;
         size = cm1->rows * cm1->columns;
         if (size != cm2->rows * cm2->columns)
             return ERR_DIMENSION_ERROR;
         size *= 2;
+        dot_init(&acc_re);
+        dot_init(&acc_im);
         for (i = 0; i < size; i += 2) {
-            phloat re1 = cm1->array->data[i];
-            phloat im1 = cm1->array->data[i + 1];
-            phloat re2 = cm2->array->data[i];
-            phloat im2 = cm2->array->data[i + 1];
-            dot_re += re1 * re2 - im1 * im2;
-            dot_im += re1 * im2 + re2 * im1;
+            phloat re1 = matrix_data(cm1->array)[i];
+            phloat im1 = matrix_data(cm1->array)[i + 1];
+            phloat re2 = matrix_data(cm2->array)[i];
+            phloat im2 = matrix_data(cm2->array)[i + 1];
+            dot_add_complex(&acc_re, &acc_im, re1, im1, re2, im2);
         }
+        dot_re = dot_result(&acc_re);
+        dot_im = dot_result(&acc_im);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -868,14 +852,15 @@ int docmd_edit(arg_struct *arg) {
         vartype *v;
         if (reg_x->type == TYPE_REALMATRIX) {
             vartype_realmatrix *rm = (vartype_realmatrix *) reg_x;
-            if (rm->array->is_string[0])
-                v = new_string(phloat_text(rm->array->data[0]),
-                               phloat_length(rm->array->data[0]));
+            phloat *d = matrix_element(rm->array, 0);
+            if (IS_STRING(rm->array, 0))
+                v = new_string(phloat_text(*d), phloat_length(*d));
             else
-                v = new_real(rm->array->data[0]);
+                v = new_real(*d);
         } else {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) reg_x;
-            v = new_complex(cm->array->data[0], cm->array->data[1]);
+            phloat *d = matrix_element(cm->array, 0);
+            v = new_complex(d[0], d[1]);
         }
         if (v == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -926,14 +911,15 @@ int docmd_editn(arg_struct *arg) {
         int i;
         if (m->type == TYPE_REALMATRIX) {
             vartype_realmatrix *rm = (vartype_realmatrix *) m;
-            if (rm->array->is_string[0])
-                v = new_string(phloat_text(rm->array->data[0]),
-                               phloat_length(rm->array->data[0]));
+            phloat *d = matrix_element(rm->array, 0);
+            if (IS_STRING(rm->array, 0))
+                v = new_string(phloat_text(*d), phloat_length(*d));
             else
-                v = new_real(rm->array->data[0]);
+                v = new_real(*d);
         } else {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
-            v = new_complex(cm->array->data[0], cm->array->data[1]);
+            phloat *d = matrix_element(cm->array, 0);
+            v = new_complex(d[0], d[1]);
         }
         if (v == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -996,15 +982,17 @@ static int fnrm(vartype *m, phloat *norm) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 size = rm->rows * rm->columns;
         int4 i;
-        phloat nrm = 0;
-        for (i = 0; i < size; i++)
-            if (rm->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
+        dot_acc acc;
+        phloat nrm;
+        if (!contains_no_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        dot_init(&acc);
         for (i = 0; i < size; i++) {
             /* TODO -- overflows in intermediaries */
-            phloat x = rm->array->data[i];
-            nrm += x * x;
+            phloat x = matrix_data(rm->array)[i];
+            dot_add(&acc, x, x);
         }
+        nrm = dot_result(&acc);
         if (p_isinf(nrm)) {
             if (flags.f.range_error_ignore)
                 nrm = POS_HUGE_PHLOAT;
@@ -1018,12 +1006,15 @@ static int fnrm(vartype *m, phloat *norm) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         int4 size = 2 * cm->rows * cm->columns;
         int4 i;
-        phloat nrm = 0;
+        dot_acc acc;
+        phloat nrm;
+        dot_init(&acc);
         for (i = 0; i < size; i++) {
             /* TODO -- overflows in intermediaries */
-            phloat x = cm->array->data[i];
-            nrm += x * x;
+            phloat x = matrix_data(cm->array)[i];
+            dot_add(&acc, x, x);
         }
+        nrm = dot_result(&acc);
         if (p_isinf(nrm)) {
             if (flags.f.range_error_ignore)
                 nrm = POS_HUGE_PHLOAT;
@@ -1119,8 +1110,8 @@ int docmd_getm(arg_struct *arg) {
             for (j = 0; j < x; j++) {
                 int4 n1 = (i + matedit_i) * src->columns + j + matedit_j;
                 int4 n2 = i * dst->columns + j;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                dst->array->data[n2] = src->array->data[n1];
+                set_is_string(dst->array, n2, IS_STRING(src->array, n1));
+                dst->array->data[n2] = *matrix_element(src->array, n1);
             }
         binary_result((vartype *) dst);
         return ERR_NONE;
@@ -1137,8 +1128,9 @@ int docmd_getm(arg_struct *arg) {
             for (j = 0; j < x; j++) {
                 int4 n1 = (i + matedit_i) * src->columns + j + matedit_j;
                 int4 n2 = i * dst->columns + j;
-                dst->array->data[n2 * 2] = src->array->data[n1 * 2];
-                dst->array->data[n2 * 2 + 1] = src->array->data[n1 * 2 + 1];
+                phloat *d = matrix_element(src->array, n1);
+                dst->array->data[n2 * 2] = d[0];
+                dst->array->data[n2 * 2 + 1] = d[1];
             }
         binary_result((vartype *) dst);
         return ERR_NONE;
@@ -1445,7 +1437,7 @@ int docmd_uvec(arg_struct *arg) {
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < size; i++)
-            dst->array->data[i] = src->array->data[i] / norm;
+            matrix_data(dst->array)[i] = matrix_data(src->array)[i] / norm;
         v = (vartype *) dst;
     }
     unary_result(v);
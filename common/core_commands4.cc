@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core_commands2.h"
 #include "core_commands3.h"
@@ -102,20 +103,21 @@ int docmd_insr(arg_struct *arg) {
         rows++;
         if (m->type == TYPE_REALMATRIX) {
             for (i = rows * columns - 1; i >= (matedit_i + 1) * columns; i--) {
-                rm->array->is_string[i] = rm->array->is_string[i - columns];
-                rm->array->data[i] = rm->array->data[i - columns];
+                set_is_string(rm->array, i, IS_STRING(rm->array, i - columns));
+                matrix_data(rm->array)[i] = matrix_data(rm->array)[i - columns];
             }
             for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                rm->array->is_string[i] = 0;
-                rm->array->data[i] = 0;
+                set_is_string(rm->array, i, false);
+                matrix_data(rm->array)[i] = 0;
             }
         } else {
+            phloat *data = matrix_data(cm->array);
             for (i = 2 * rows * columns - 1;
                             i >= 2 * (matedit_i + 1) * columns; i--)
-                cm->array->data[i] = cm->array->data[i - 2 * columns];
+                data[i] = data[i - 2 * columns];
             for (i = 2 * matedit_i * columns;
                             i < 2 * (matedit_i + 1) * columns; i++)
-                cm->array->data[i] = 0;
+                data[i] = 0;
         }
     } else {
         /* Make sure the new array is less than 2 GB,
@@ -130,67 +132,35 @@ int docmd_insr(arg_struct *arg) {
          * does not deal with resizing. */
         int4 newsize = (rows + 1) * columns;
         if (m->type == TYPE_REALMATRIX) {
-            realmatrix_data *array = (realmatrix_data *)
-                                malloc(sizeof(realmatrix_data));
+            realmatrix_data *array = new_realmatrix_data(newsize);
             if (array == NULL) {
                 if (interactive)
                     free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->data = (phloat *) malloc(newsize * sizeof(phloat));
-            if (array->data == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            array->is_string = (char *) malloc(newsize);
-            if (array->is_string == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array->data);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
-                array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                array->is_string[i] = 0;
-                array->data[i] = 0;
-            }
-            for (i = (matedit_i + 1) * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i - columns];
-                array->data[i] = rm->array->data[i - columns];
-            }
-            array->refcount = 1;
+            i = matedit_i * columns;
+            memcpy(array->data, matrix_data(rm->array), i * sizeof(phloat));
+            copy_is_string(array, 0, rm->array, 0, i);
+            clear_phloats(array->data + i, columns);
+            memcpy(array->data + i + columns, matrix_data(rm->array) + i,
+                   (newsize - i - columns) * sizeof(phloat));
+            copy_is_string(array, i + columns, rm->array, i,
+                           newsize - i - columns);
             rm->array->refcount--;
             rm->array = array;
             rm->rows++;
         } else {
-            complexmatrix_data *array = (complexmatrix_data *)
-                                malloc(sizeof(complexmatrix_data));
+            complexmatrix_data *array = new_complexmatrix_data(newsize);
             if (array == NULL) {
                 if (interactive)
                     free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->data = (phloat *) malloc(2 * newsize * sizeof(phloat));
-            if (array->data == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            for (i = 0; i < 2 * matedit_i * columns; i++)
-                array->data[i] = cm->array->data[i];
-            for (i = 2 * matedit_i * columns;
-                                i < 2 * (matedit_i + 1) * columns; i++)
-                array->data[i] = 0;
-            for (i = 2 * (matedit_i + 1) * columns; i < 2 * newsize; i++)
-                array->data[i] = cm->array->data[i - 2 * columns];
-            array->refcount = 1;
+            i = 2 * matedit_i * columns;
+            memcpy(array->data, matrix_data(cm->array), i * sizeof(phloat));
+            clear_phloats(array->data + i, 2 * columns);
+            memcpy(array->data + i + 2 * columns, matrix_data(cm->array) + i,
+                   (2 * newsize - i - 2 * columns) * sizeof(phloat));
             cm->array->refcount--;
             cm->array = array;
             cm->rows++;
@@ -377,14 +347,18 @@ int docmd_putm(arg_struct *arg) {
         if (src->rows + matedit_i > dst->rows
                 || src->columns + matedit_j > dst->columns)
             return ERR_DIMENSION_ERROR;
-        if (!disentangle(m))
+        /* Only the chunks being written are copied, if m is shared; after
+         * the first disentangle_element(), the others can't fail.
+         */
+        if (!disentangle_element(m, matedit_i * dst->columns + matedit_j))
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < src->rows; i++)
             for (j = 0; j < src->columns; j++) {
                 int4 n1 = i * src->columns + j;
                 int4 n2 = (i + matedit_i) * dst->columns + j + matedit_j;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                dst->array->data[n2] = src->array->data[n1];
+                disentangle_element(m, n2);
+                set_is_string(dst->array, n2, IS_STRING(src->array, n1));
+                *matrix_element(dst->array, n2) = matrix_data(src->array)[n1];
             }
         return ERR_NONE;
     } else if (reg_x->type == TYPE_REALMATRIX) {
@@ -394,16 +368,18 @@ int docmd_putm(arg_struct *arg) {
                 || src->columns + matedit_j > dst->columns)
             return ERR_DIMENSION_ERROR;
         for (i = 0; i < src->rows * src->columns; i++)
-            if (src->array->is_string[i])
+            if (IS_STRING(src->array, i))
                 return ERR_ALPHA_DATA_IS_INVALID;
-        if (!disentangle(m))
+        if (!disentangle_element(m, matedit_i * dst->columns + matedit_j))
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < src->rows; i++)
             for (j = 0; j < src->columns; j++) {
                 int4 n1 = i * src->columns + j;
                 int4 n2 = (i + matedit_i) * dst->columns + j + matedit_j;
-                dst->array->data[n2 * 2] = src->array->data[n1];
-                dst->array->data[n2 * 2 + 1] = 0;
+                disentangle_element(m, n2);
+                phloat *d = matrix_element(dst->array, n2);
+                d[0] = matrix_data(src->array)[n1];
+                d[1] = 0;
             }
         return ERR_NONE;
     } else {
@@ -412,14 +388,16 @@ int docmd_putm(arg_struct *arg) {
         if (src->rows + matedit_i > dst->rows
                 || src->columns + matedit_j > dst->columns)
             return ERR_DIMENSION_ERROR;
-        if (!disentangle(m))
+        if (!disentangle_element(m, matedit_i * dst->columns + matedit_j))
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < src->rows; i++)
             for (j = 0; j < src->columns; j++) {
                 int4 n1 = i * src->columns + j;
                 int4 n2 = (i + matedit_i) * dst->columns + j + matedit_j;
-                dst->array->data[n2 * 2] = src->array->data[n1 * 2];
-                dst->array->data[n2 * 2 + 1] = src->array->data[n1 * 2 + 1];
+                disentangle_element(m, n2);
+                phloat *d = matrix_element(dst->array, n2);
+                d[0] = matrix_data(src->array)[n1 * 2];
+                d[1] = matrix_data(src->array)[n1 * 2 + 1];
             }
         return ERR_NONE;
     }
@@ -447,16 +425,16 @@ int docmd_rclel(arg_struct *arg) {
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
-        if (rm->array->is_string[n])
-            v = new_string(phloat_text(rm->array->data[n]),
-                           phloat_length(rm->array->data[n]));
+        phloat *d = matrix_element(rm->array, n);
+        if (IS_STRING(rm->array, n))
+            v = new_string(phloat_text(*d), phloat_length(*d));
         else
-            v = new_real(rm->array->data[n]);
+            v = new_real(*d);
     } else if (m->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
         int4 n = matedit_i * cm->columns + matedit_j;
-        v = new_complex(cm->array->data[2 * n],
-                        cm->array->data[2 * n + 1]);
+        phloat *d = matrix_element(cm->array, n);
+        v = new_complex(d[0], d[1]);
     } else
         return ERR_INVALID_TYPE;
     if (v == NULL)
@@ -484,21 +462,17 @@ int docmd_rnrm(arg_struct *arg) {
     if (reg_x->type == TYPE_REALMATRIX) {
         vartype *v;
         vartype_realmatrix *rm = (vartype_realmatrix *) reg_x;
-        int4 size = rm->rows * rm->columns;
         int4 i, j;
         phloat max = 0;
-        for (i = 0; i < size; i++)
-            if (rm->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
+        if (!contains_no_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        phloat *data = matrix_data(rm->array);
         for (i = 0; i < rm->rows; i++) {
-            phloat nrm = 0;
-            for (j = 0; j < rm->columns; j++) {
-                phloat x = rm->array->data[i * rm->columns + j];
-                if (x >= 0)
-                    nrm += x;
-                else
-                    nrm -= x;
-            }
+            dot_acc acc;
+            dot_init(&acc);
+            for (j = 0; j < rm->columns; j++)
+                dot_add(&acc, fabs(data[i * rm->columns + j]), 1);
+            phloat nrm = dot_result(&acc);
             if (p_isinf(nrm)) {
                 if (flags.f.range_error_ignore)
                     max = POS_HUGE_PHLOAT;
@@ -519,13 +493,16 @@ int docmd_rnrm(arg_struct *arg) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) reg_x;
         int4 i, j;
         phloat max = 0;
+        phloat *data = matrix_data(cm->array);
         for (i = 0; i < cm->rows; i++) {
-            phloat nrm = 0;
+            dot_acc acc;
+            dot_init(&acc);
             for (j = 0; j < cm->columns; j++) {
-                phloat re = cm->array->data[2 * (i * cm->columns + j)];
-                phloat im = cm->array->data[2 * (i * cm->columns + j) + 1];
-                nrm += hypot(re, im);
+                phloat re = data[2 * (i * cm->columns + j)];
+                phloat im = data[2 * (i * cm->columns + j) + 1];
+                dot_add(&acc, hypot(re, im), 1);
             }
+            phloat nrm = dot_result(&acc);
             if (p_isinf(nrm)) {
                 if (flags.f.range_error_ignore)
                     max = POS_HUGE_PHLOAT;
@@ -551,19 +528,19 @@ int docmd_rsum(arg_struct *arg) {
     if (reg_x->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) reg_x;
         vartype_realmatrix *res;
-        int4 size = rm->rows * rm->columns;
         int4 i, j;
-        for (i = 0; i < size; i++)
-            if (rm->array->is_string[i])
-                return ERR_ALPHA_DATA_IS_INVALID;
+        if (!contains_no_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
         res = (vartype_realmatrix *) new_realmatrix(rm->rows, 1);
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < rm->rows; i++) {
-            phloat sum = 0;
+            dot_acc acc;
             int inf;
+            dot_init(&acc);
             for (j = 0; j < rm->columns; j++)
-                sum += rm->array->data[i * rm->columns + j];
+                dot_add(&acc, matrix_data(rm->array)[i * rm->columns + j], 1);
+            phloat sum = dot_result(&acc);
             if ((inf = p_isinf(sum)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -572,7 +549,7 @@ int docmd_rsum(arg_struct *arg) {
                     return ERR_OUT_OF_RANGE;
                 }
             }
-            res->array->data[i] = sum;
+            matrix_data(res->array)[i] = sum;
         }
         unary_result((vartype *) res);
         return ERR_NONE;
@@ -583,13 +560,18 @@ int docmd_rsum(arg_struct *arg) {
         res = (vartype_complexmatrix *) new_complexmatrix(cm->rows, 1);
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
+        phloat *data = matrix_data(cm->array);
         for (i = 0; i < cm->rows; i++) {
-            phloat sum_re = 0, sum_im = 0;
+            dot_acc acc_re, acc_im;
             int inf;
+            dot_init(&acc_re);
+            dot_init(&acc_im);
             for (j = 0; j < cm->columns; j++) {
-                sum_re += cm->array->data[2 * (i * cm->columns + j)];
-                sum_im += cm->array->data[2 * (i * cm->columns + j) + 1];
+                dot_add(&acc_re, data[2 * (i * cm->columns + j)], 1);
+                dot_add(&acc_im, data[2 * (i * cm->columns + j) + 1], 1);
             }
+            phloat sum_re = dot_result(&acc_re);
+            phloat sum_im = dot_result(&acc_im);
             if ((inf = p_isinf(sum_re)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -606,8 +588,8 @@ int docmd_rsum(arg_struct *arg) {
                     return ERR_OUT_OF_RANGE;
                 }
             }
-            res->array->data[2 * i] = sum_re;
-            res->array->data[2 * i + 1] = sum_im;
+            matrix_data(res->array)[2 * i] = sum_re;
+            matrix_data(res->array)[2 * i + 1] = sum_im;
         }
         unary_result((vartype *) res);
         return ERR_NONE;
@@ -684,12 +666,12 @@ int docmd_swap_r(arg_struct *arg) {
         for (i = 0; i < rm->columns; i++) {
             int4 n1 = x * rm->columns + i;
             int4 n2 = y * rm->columns + i;
-            char tempc = rm->array->is_string[n1];
-            phloat tempds = rm->array->data[n1];
-            rm->array->is_string[n1] = rm->array->is_string[n2];
-            rm->array->data[n1] = rm->array->data[n2];
-            rm->array->is_string[n2] = tempc;
-            rm->array->data[n2] = tempds;
+            char tempc = IS_STRING(rm->array, n1);
+            phloat tempds = matrix_data(rm->array)[n1];
+            set_is_string(rm->array, n1, IS_STRING(rm->array, n2));
+            matrix_data(rm->array)[n1] = matrix_data(rm->array)[n2];
+            set_is_string(rm->array, n2, tempc);
+            matrix_data(rm->array)[n2] = tempds;
         }
         return ERR_NONE;
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
@@ -703,9 +685,9 @@ int docmd_swap_r(arg_struct *arg) {
         for (i = 0; i < 2 * cm->columns; i++) {
             int4 n1 = x * 2 * cm->columns + i;
             int4 n2 = y * 2 * cm->columns + i;
-            phloat tempd = cm->array->data[n1];
-            cm->array->data[n1] = cm->array->data[n2];
-            cm->array->data[n2] = tempd;
+            phloat tempd = matrix_data(cm->array)[n1];
+            matrix_data(cm->array)[n1] = matrix_data(cm->array)[n2];
+            matrix_data(cm->array)[n2] = tempd;
         }
         return ERR_NONE;
     }
@@ -792,37 +774,43 @@ int docmd_stoel(arg_struct *arg) {
          */
         return ERR_INVALID_TYPE;
 
-    if (!disentangle(m))
+    int4 columns = m->type == TYPE_REALMATRIX
+                ? ((vartype_realmatrix *) m)->columns
+                : ((vartype_complexmatrix *) m)->columns;
+    int4 n = matedit_i * columns + matedit_j;
+    if (element_unchanged(m, n, reg_x))
+        return ERR_NONE;
+    if (!disentangle_element(m, n))
         return ERR_INSUFFICIENT_MEMORY;
 
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
-        int4 n = matedit_i * rm->columns + matedit_j;
+        phloat *d = matrix_element(rm->array, n);
         if (reg_x->type == TYPE_REAL) {
-            rm->array->is_string[n] = 0;
-            rm->array->data[n] = ((vartype_real *) reg_x)->x;
+            set_is_string(rm->array, n, false);
+            *d = ((vartype_real *) reg_x)->x;
             return ERR_NONE;
         } else if (reg_x->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) reg_x;
             int i;
-            rm->array->is_string[n] = 1;
-            phloat_length(rm->array->data[n]) = s->length;
+            set_is_string(rm->array, n, true);
+            phloat_length(*d) = s->length;
             for (i = 0; i < s->length; i++)
-                phloat_text(rm->array->data[n])[i] = s->text[i];
+                phloat_text(*d)[i] = s->text[i];
             return ERR_NONE;
         } else
             return ERR_INVALID_TYPE;
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) m;
-        int4 n = matedit_i * cm->columns + matedit_j;
+        phloat *d = matrix_element(cm->array, n);
         if (reg_x->type == TYPE_REAL) {
-            cm->array->data[2 * n] = ((vartype_real *) reg_x)->x;
-            cm->array->data[2 * n + 1] = 0;
+            d[0] = ((vartype_real *) reg_x)->x;
+            d[1] = 0;
             return ERR_NONE;
         } else if (reg_x->type == TYPE_COMPLEX) {
             vartype_complex *c = (vartype_complex *) reg_x;
-            cm->array->data[2 * n] = c->re;
-            cm->array->data[2 * n + 1] = c->im;
+            d[0] = c->re;
+            d[1] = c->im;
             return ERR_NONE;
         } else if (reg_x->type == TYPE_STRING)
             return ERR_ALPHA_DATA_IS_INVALID;
@@ -977,8 +965,8 @@ int docmd_trans(arg_struct *arg) {
             for (j = 0; j < columns; j++) {
                 int4 n1 = i * columns + j;
                 int4 n2 = j * rows + i;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                dst->array->data[n2] = src->array->data[n1];
+                set_is_string(dst->array, n2, IS_STRING(src->array, n1));
+                matrix_data(dst->array)[n2] = matrix_data(src->array)[n1];
             }
         unary_result((vartype *) dst);
         return ERR_NONE;
@@ -995,8 +983,8 @@ int docmd_trans(arg_struct *arg) {
             for (j = 0; j < columns; j++) {
                 int4 n1 = 2 * (i * columns + j);
                 int4 n2 = 2 * (j * rows + i);
-                dst->array->data[n2] = src->array->data[n1];
-                dst->array->data[n2 + 1] = src->array->data[n1 + 1];
+                dst->array->data[n2] = matrix_data(src->array)[n1];
+                dst->array->data[n2 + 1] = matrix_data(src->array)[n1 + 1];
             }
         unary_result((vartype *) dst);
         return ERR_NONE;
@@ -1069,9 +1057,6 @@ static int matedit_move(int direction) {
     } else
         return ERR_INVALID_TYPE;
 
-    if (!disentangle(m))
-        return ERR_INSUFFICIENT_MEMORY;
-
     new_i = matedit_i;
     new_j = matedit_j;
     switch (direction) {
@@ -1132,44 +1117,58 @@ static int matedit_move(int direction) {
     old_n = matedit_i * columns + matedit_j;
     new_n = new_i * columns + new_j;
 
+    /* X is written back into the element we're leaving, which only requires
+     * a private copy of (the chunk holding) that element if it actually
+     * changes it.
+     */
+    int unchanged = element_unchanged(m, old_n, reg_x);
+    if (!unchanged && !disentangle_element(m, old_n))
+        return ERR_INSUFFICIENT_MEMORY;
+
     if (m->type == TYPE_REALMATRIX) {
         if (old_n != new_n) {
-            if (rm->array->is_string[new_n])
-                v = new_string(phloat_text(rm->array->data[new_n]),
-                            phloat_length(rm->array->data[new_n]));
+            phloat *d = matrix_element(rm->array, new_n);
+            if (IS_STRING(rm->array, new_n))
+                v = new_string(phloat_text(*d), phloat_length(*d));
             else
-                v = new_real(rm->array->data[new_n]);
+                v = new_real(*d);
             if (v == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
         }
-        if (reg_x->type == TYPE_REAL) {
-            rm->array->is_string[old_n] = 0;
-            rm->array->data[old_n] = ((vartype_real *) reg_x)->x;
+        phloat *d = matrix_element(rm->array, old_n);
+        if (unchanged) {
+            /* Nothing to write back */
+        } else if (reg_x->type == TYPE_REAL) {
+            set_is_string(rm->array, old_n, false);
+            *d = ((vartype_real *) reg_x)->x;
         } else if (reg_x->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) reg_x;
             int i;
-            rm->array->is_string[old_n] = 1;
-            phloat_length(rm->array->data[old_n]) = s->length;
+            set_is_string(rm->array, old_n, true);
+            phloat_length(*d) = s->length;
             for (i = 0; i < s->length; i++)
-                phloat_text(rm->array->data[old_n])[i] = s->text[i];
+                phloat_text(*d)[i] = s->text[i];
         } else {
             free_vartype(v);
             return ERR_INVALID_TYPE;
         }
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
         if (old_n != new_n) {
-            v = new_complex(cm->array->data[2 * new_n],
-                            cm->array->data[2 * new_n + 1]);
+            phloat *d = matrix_element(cm->array, new_n);
+            v = new_complex(d[0], d[1]);
             if (v == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
         }
-        if (reg_x->type == TYPE_REAL) {
-            cm->array->data[2 * old_n] = ((vartype_real *) reg_x)->x;
-            cm->array->data[2 * old_n + 1] = 0;
+        phloat *d = matrix_element(cm->array, old_n);
+        if (unchanged) {
+            /* Nothing to write back */
+        } else if (reg_x->type == TYPE_REAL) {
+            d[0] = ((vartype_real *) reg_x)->x;
+            d[1] = 0;
         } else if (reg_x->type == TYPE_COMPLEX) {
             vartype_complex *c = (vartype_complex *) reg_x;
-            cm->array->data[2 * old_n] = c->re;
-            cm->array->data[2 * old_n + 1] = c->im;
+            d[0] = c->re;
+            d[1] = c->im;
         } else {
             free_vartype(v);
             return reg_x->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
@@ -1256,12 +1255,12 @@ static void matx_completion(int error, vartype *res) {
     if (res->type == TYPE_REALMATRIX) {
         vartype_realmatrix *m = (vartype_realmatrix *) res;
         vartype_real *v = (vartype_real *) matx_v;
-        v->x = m->array->data[0];
+        v->x = matrix_data(m->array)[0];
     } else {
         vartype_complexmatrix *m = (vartype_complexmatrix *) res;
         vartype_complex *v = (vartype_complex *) matx_v;
-        v->re = m->array->data[0];
-        v->im = m->array->data[1];
+        v->re = matrix_data(m->array)[0];
+        v->im = matrix_data(m->array)[1];
     }
     free_vartype(reg_x);
     reg_x = matx_v;
@@ -1328,14 +1327,14 @@ static int matabx(int which) {
 
     if (mat->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) mat;
-        if (rm->array->is_string[0])
-            v = new_string(phloat_text(rm->array->data[0]),
-                            phloat_length(rm->array->data[0]));
+        if (IS_STRING(rm->array, 0))
+            v = new_string(phloat_text(matrix_data(rm->array)[0]),
+                            phloat_length(matrix_data(rm->array)[0]));
         else
-            v = new_real(rm->array->data[0]);
+            v = new_real(matrix_data(rm->array)[0]);
     } else {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) mat;
-        v = new_complex(cm->array->data[0], cm->array->data[1]);
+        v = new_complex(matrix_data(cm->array)[0], matrix_data(cm->array)[1]);
     }
     if (v == NULL)
         return ERR_INSUFFICIENT_MEMORY;
@@ -1502,9 +1501,9 @@ static int max_min_helper(int do_max) {
     for (i = matedit_i; i < rm->rows; i++) {
         int4 index = i * rm->columns + matedit_j;
         phloat e;
-        if (rm->array->is_string[index])
+        if (IS_STRING(rm->array, index))
             return ERR_ALPHA_DATA_IS_INVALID;
-        e = rm->array->data[index];
+        e = matrix_data(rm->array)[index];
         if (do_max ? e >= max_or_min_value : e <= max_or_min_value) {
             max_or_min_value = e;
             max_or_min_index = i;
@@ -1555,11 +1554,12 @@ int docmd_find(arg_struct *arg) {
         if (reg_x->type == TYPE_COMPLEX)
             return ERR_NO;
         rm = (vartype_realmatrix *) m;
+        phloat *data = matrix_data(rm->array);
         if (reg_x->type == TYPE_REAL) {
             phloat d = ((vartype_real *) reg_x)->x;
             for (i = 0; i < rm->rows; i++)
                 for (j = 0; j < rm->columns; j++)
-                    if (!rm->array->is_string[p] && rm->array->data[p] == d) {
+                    if (!IS_STRING(rm->array, p) && data[p] == d) {
                         matedit_i = i;
                         matedit_j = j;
                         return ERR_YES;
@@ -1569,10 +1569,10 @@ int docmd_find(arg_struct *arg) {
             vartype_string *s = (vartype_string *) reg_x;
             for (i = 0; i < rm->rows; i++)
                 for (j = 0; j < rm->columns; j++)
-                    if (rm->array->is_string[p]
+                    if (IS_STRING(rm->array, p)
                             && string_equals(s->text, s->length, 
-                                             phloat_text(rm->array->data[p]),
-                                             phloat_length(rm->array->data[p]))) {
+                                             phloat_text(data[p]),
+                                             phloat_length(data[p]))) {
                         matedit_i = i;
                         matedit_j = j;
                         return ERR_YES;
@@ -1588,9 +1588,10 @@ int docmd_find(arg_struct *arg) {
         cm = (vartype_complexmatrix *) m;
         re = ((vartype_complex *) reg_x)->re;
         im = ((vartype_complex *) reg_x)->im;
+        phloat *data = matrix_data(cm->array);
         for (i = 0; i < cm->rows; i++)
             for (j = 0; j < cm->columns; j++)
-                if (cm->array->data[p] == re && cm->array->data[p + 1] == im) {
+                if (data[p] == re && data[p + 1] == im) {
                     matedit_i = i;
                     matedit_j = j;
                     return ERR_YES;
@@ -399,7 +399,7 @@ static int get_summation() {
     int4 size, i;
     vartype *regs = recall_var("REGS", 4);
     vartype_realmatrix *r;
-    phloat *sigmaregs;
+    phloat sigmaregs[13];
     if (regs == NULL)
         return ERR_SIZE_ERROR;
     if (regs->type != TYPE_REALMATRIX)
@@ -408,10 +408,11 @@ static int get_summation() {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
-    for (i = first; i < last; i++)
-        if (r->array->is_string[i])
+    for (i = first; i < last; i++) {
+        if (IS_STRING(r->array, i))
             return ERR_ALPHA_DATA_IS_INVALID;
-    sigmaregs = r->array->data + first;
+        sigmaregs[i - first] = *matrix_element(r->array, i);
+    }
     sum.x = sigmaregs[0];
     sum.x2 = sigmaregs[1];
     sum.y = sigmaregs[2];
@@ -1286,9 +1287,15 @@ static int sigma_helper_1(int weight) {
     if (last > size)
         return ERR_SIZE_ERROR;
     for (i = first; i < last; i++)
-        if (r->array->is_string[i])
+        if (IS_STRING(r->array, i))
             return ERR_ALPHA_DATA_IS_INVALID;
-    sigmaregs = r->array->data + first;
+    /* REGS may be shared, e.g. after RCL "REGS"; give it private copies of
+     * the chunks holding the summation registers before updating them.
+     */
+    for (i = first; i < last; i++)
+        if (!disentangle_element(regs, i))
+            return ERR_INSUFFICIENT_MEMORY;
+    sigmaregs = matrix_element(r->array, first);
 
     /* All summation registers present, real-valued, non-string. */
     switch (reg_x->type) {
@@ -1318,15 +1325,15 @@ static int sigma_helper_1(int weight) {
             if (rm->columns != 2)
                 return ERR_DIMENSION_ERROR;
             for (i = 0; i < rm->rows * 2; i++)
-                if (rm->array->is_string[i])
+                if (IS_STRING(rm->array, i))
                     return ERR_ALPHA_DATA_IS_INVALID;
             x = (vartype_real *) new_real(0);
             if (x == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
             for (i = 0; i < rm->rows; i++)
                 x->x = sigma_helper_2(sigmaregs,
-                                      rm->array->data[i * 2],
-                                      rm->array->data[i * 2 + 1],
+                                      matrix_data(rm->array)[i * 2],
+                                      matrix_data(rm->array)[i * 2 + 1],
                                       weight);
             free_vartype(reg_lastx);
             reg_lastx = reg_x;
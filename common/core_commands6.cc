@@ -688,7 +688,8 @@ int docmd_sqrt(arg_struct *arg) {
         return ERR_ALPHA_DATA_IS_INVALID;
     } else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_sqrt_r, mappable_sqrt_c);
+        int err = map_unary(reg_x, &v, mappable_sqrt_r, mappable_sqrt_c,
+                                                        array_sqrt_r);
         if (err != ERR_NONE)
             return err;
         unary_result(v);
@@ -735,7 +736,8 @@ int docmd_square(arg_struct *arg) {
         return ERR_ALPHA_DATA_IS_INVALID;
     else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_square_r, mappable_square_c);
+        int err = map_unary(reg_x, &v, mappable_square_r, mappable_square_c,
+                                                        array_square_r);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -780,7 +782,8 @@ int docmd_inv(arg_struct *arg) {
         return ERR_ALPHA_DATA_IS_INVALID;
     else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_inv_r, mappable_inv_c);
+        int err = map_unary(reg_x, &v, mappable_inv_r, mappable_inv_c,
+                                                        array_inv_r);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -85,8 +85,8 @@ int docmd_locat(arg_struct *arg) {
         return ERR_INSUFFICIENT_MEMORY;
     }
     vartype_realmatrix *rm = (vartype_realmatrix *) new_t;
-    rm->array->data[0] = lat_lon_acc;
-    rm->array->data[1] = elev_acc;
+    matrix_data(rm->array)[0] = lat_lon_acc;
+    matrix_data(rm->array)[1] = elev_acc;
     free_vartype(reg_t);
     free_vartype(reg_z);
     free_vartype(reg_y);
@@ -119,9 +119,9 @@ int docmd_heading(arg_struct *arg) {
         return ERR_INSUFFICIENT_MEMORY;
     }
     vartype_realmatrix *rm = (vartype_realmatrix *) new_t;
-    rm->array->data[0] = x;
-    rm->array->data[1] = y;
-    rm->array->data[2] = z;
+    matrix_data(rm->array)[0] = x;
+    matrix_data(rm->array)[1] = y;
+    matrix_data(rm->array)[2] = z;
     free_vartype(reg_t);
     free_vartype(reg_z);
     free_vartype(reg_y);
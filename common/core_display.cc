@@ -1742,15 +1742,47 @@ static void draw_catalog() {
     }
 }
 
+static int mem2string(int8 bytes, char *buf) {
+    /* At most 4 characters: bytes below 1000, then K, M, or G, rounded up */
+    char unit = 0;
+    const char *units = "KMG";
+    while (bytes >= 1000 && *units != 0) {
+        bytes = (bytes + 1023) / 1024;
+        unit = *units++;
+    }
+    int len = uint2string((uint4) bytes, buf, 4);
+    if (unit != 0)
+        buf[len++] = unit;
+    return len;
+}
+
+static void draw_mem_line(int row, const char *label1, int8 bytes1,
+                                   const char *label2, int8 bytes2) {
+    char buf[22];
+    memcpy(buf, label1, 4);
+    buf[4] = ' ';
+    int len = 5 + mem2string(bytes1, buf + 5);
+    buf[len++] = ' ';
+    memcpy(buf + len, label2, 4);
+    buf[len + 4] = ' ';
+    len += 5;
+    len += mem2string(bytes2, buf + len);
+    draw_string(0, row, buf, len);
+}
+
 void display_mem() {
-    uint4 bytes = shell_get_mem();
-    char buf[16];
-    int buflen;
+    /* The memory held by the core, by category, and what is left. The
+     * pools hold the values of variables, so they are counted with them;
+     * the RTN stack and the profiler results are counted with the programs.
+     */
+    core_mem_usage usage;
+    core_get_mem_usage(&usage);
     clear_display();
-    draw_string(0, 0, "Available Memory:", 17);
-    buflen = uint2string(bytes, buf, 16);
-    draw_string(0, 1, buf, buflen);
-    draw_string(buflen + 1, 1, "Bytes", 5);
+    draw_mem_line(0, "Vars", usage.variables + usage.pools,
+                     "Mats", usage.matrices);
+    draw_mem_line(1, "Prgm",
+                  usage.programs + usage.rtn_stack + usage.profiler,
+                  "Free", shell_get_mem());
     flush_display();
 }
 
@@ -1878,11 +1910,11 @@ void show() {
             }
             case TYPE_REALMATRIX: {
                 vartype_realmatrix *rm = (vartype_realmatrix *) reg_x;
-                phloat *d = rm->array->data;
+                phloat *d = matrix_element(rm->array, 0);
                 bufptr = vartype2string(reg_x, buf, 22);
                 draw_string(0, 0, buf, bufptr);
                 draw_string(0, 1, "1:1=", 4);
-                if (rm->array->is_string[0]) {
+                if (IS_STRING(rm->array, 0)) {
                     draw_char(4, 1, '"');
                     draw_string(5, 1, phloat_text(*d), phloat_length(*d));
                     draw_char(5 + phloat_length(*d), 1, '"');
@@ -1901,8 +1933,8 @@ void show() {
                 draw_string(0, 0, buf, bufptr);
                 draw_string(0, 1, "1:1=", 4);
                 c.type = TYPE_COMPLEX;
-                c.re = cm->array->data[0];
-                c.im = cm->array->data[1];
+                c.re = matrix_element(cm->array, 0)[0];
+                c.im = matrix_element(cm->array, 0)[1];
                 bufptr = vartype2string((vartype *) &c, buf, 18);
                 draw_string(4, 1, buf, bufptr);
                 break;
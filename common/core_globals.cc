@@ -569,6 +569,16 @@ int labels_capacity = 0;
 int labels_count = 0;
 label_struct *labels = NULL;
 
+/* Hash table for find_global_label(), mapping label names to indexes in
+ * 'labels'. Since those indexes shift whenever a label is added or removed,
+ * the table is not kept up to date, but simply marked stale, and rebuilt the
+ * next time it is needed. That way, bulk edits like importing or pasting
+ * programs never touch it at all.
+ */
+static int *labels_hash = NULL;
+static int labels_hash_size = 0;
+static bool labels_hash_valid = false;
+
 int current_prgm = -1;
 int4 pc;
 int prgm_highlight_row = 0;
@@ -787,6 +797,14 @@ static rtn_stack_entry *rtn_stack = NULL;
 static int rtn_level = 0;
 static bool rtn_level_0_has_matrix_entry;
 static int rtn_stop_level = -1;
+/* The number of local variables created at each level, so that
+ * remove_locals() can stop looking once it has found all of them, and
+ * doesn't have to look at all when there are none. Only meaningful while
+ * rtn_locals_valid is true; it is cleared when the variables are replaced
+ * wholesale, and recomputed on demand.
+ */
+static int rtn_locals[MAX_RTN_LEVEL + 1];
+static bool rtn_locals_valid = false;
 static bool rtn_solve_active = false;
 static bool rtn_integ_active = false;
 
@@ -815,6 +833,8 @@ static bool persist_vartype(vartype *v);
 static bool unpersist_vartype(vartype **v, bool padded);
 static void update_label_table(int prgm, int4 pc, int inserted);
 static void invalidate_lclbls(int prgm_index, bool force);
+static void update_lclbl_index(int prgm_index, int4 pc, int4 delta);
+static void update_line_index(int prgm_index, int4 pc, int4 delta);
 static int pc_line_convert(int4 loc, int loc_is_pc);
 static bool convert_programs(bool *clear_stack);
 #ifdef BCD_MATH
@@ -847,6 +867,30 @@ static int array_list_search(void *array) {
     return -1;
 }
 
+/* The state file keeps one flag byte per matrix element; in memory, the
+ * flags are packed eight to a byte.
+ */
+static bool write_is_string(const realmatrix_data *array, int4 size) {
+    char *buf = (char *) malloc(size + 1);
+    if (buf == NULL)
+        return false;
+    unpack_is_string(buf, array, size);
+    bool ok = fwrite(buf, 1, size, gfile) == size;
+    free(buf);
+    return ok;
+}
+
+static bool read_is_string(realmatrix_data *array, int4 size) {
+    char *buf = (char *) malloc(size + 1);
+    if (buf == NULL)
+        return false;
+    bool ok = fread(buf, 1, size, gfile) == size;
+    if (ok)
+        pack_is_string(array, buf, size);
+    free(buf);
+    return ok;
+}
+
 static bool persist_vartype(vartype *v) {
     if (v == NULL)
         return write_char(TYPE_NULL);
@@ -891,15 +935,15 @@ static bool persist_vartype(vartype *v) {
             write_int4(columns);
             if (must_write) {
                 int size = rm->rows * rm->columns;
-                if (fwrite(rm->array->is_string, 1, size, gfile) != size)
+                if (!write_is_string(rm->array, size))
                     return false;
                 for (int i = 0; i < size; i++) {
-                    if (rm->array->is_string[i]) {
-                        char *str = (char *) &rm->array->data[i];
+                    if (IS_STRING(rm->array, i)) {
+                        char *str = (char *) &matrix_data(rm->array)[i];
                         if (fwrite(str, 1, 7, gfile) != 7)
                             return false;
                     } else {
-                        if (!write_phloat(rm->array->data[i]))
+                        if (!write_phloat(matrix_data(rm->array)[i]))
                             return false;
                     }
                 }
@@ -932,7 +976,7 @@ static bool persist_vartype(vartype *v) {
             if (must_write) {
                 int size = 2 * cm->rows * cm->columns;
                 for (int i = 0; i < size; i++)
-                    if (!write_phloat(cm->array->data[i]))
+                    if (!write_phloat(matrix_data(cm->array)[i]))
                         return false;
             }
             return true;
@@ -1027,13 +1071,13 @@ static bool unpersist_vartype(vartype **v, bool padded) {
                 if (rm == NULL)
                     return false;
                 int4 size = rows * columns;
-                if (fread(rm->array->is_string, 1, size, gfile) != size) {
+                if (!read_is_string(rm->array, size)) {
                     free_vartype((vartype *) rm);
                     return false;
                 }
                 bool success = true;
                 for (int4 i = 0; i < size; i++) {
-                    if (rm->array->is_string[i]) {
+                    if (IS_STRING(rm->array, i)) {
                         char *dst = (char *) &rm->array->data[i];
                         if (bug_mode == 0) {
                             // 6 bytes of text followed by length byte
@@ -1121,7 +1165,7 @@ static bool unpersist_vartype(vartype **v, bool padded) {
                     return false;
                 int4 size = 2 * rows * columns;
                 for (int4 i = 0; i < size; i++) {
-                    if (!read_phloat(&cm->array->data[i])) {
+                    if (!read_phloat(&matrix_data(cm->array)[i])) {
                         free_vartype((vartype *) cm);
                         return false;
                     }
@@ -1303,14 +1347,14 @@ static bool unpersist_vartype(vartype **v, bool padded) {
                     free_vartype((vartype *) rm);
                     return false;
                 }
-                if (fread(rm->array->is_string, 1, size, gfile) != size) {
+                if (!read_is_string(rm->array, size)) {
                     free(temp);
                     free_vartype((vartype *) rm);
                     return false;
                 }
                 #ifdef BCD_MATH
                     for (int4 i = 0; i < size; i++) {
-                        if (rm->array->is_string[i]) {
+                        if (IS_STRING(rm->array, i)) {
                             char *src = temp + i * phsz;
                             char *dst = (char *) (rm->array->data + i);
                             for (int j = 0; j < 7; j++)
@@ -1321,7 +1365,7 @@ static bool unpersist_vartype(vartype **v, bool padded) {
                     }
                 #else
                     for (int4 i = 0; i < size; i++) {
-                        if (rm->array->is_string[i]) {
+                        if (IS_STRING(rm->array, i)) {
                             char *src = temp + i * phsz;
                             char *dst = (char *) (rm->array->data + i);
                             for (int j = 0; j < 7; j++)
@@ -1334,20 +1378,20 @@ static bool unpersist_vartype(vartype **v, bool padded) {
                 free(temp);
             } else {
                 int4 size = mp.rows * mp.columns * sizeof(phloat);
-                if (fread(rm->array->data, 1, size, gfile) != size) {
+                if (fread(matrix_data(rm->array), 1, size, gfile) != size) {
                     free_vartype((vartype *) rm);
                     return false;
                 }
                 size = mp.rows * mp.columns;
-                if (fread(rm->array->is_string, 1, size, gfile) != size) {
+                if (!read_is_string(rm->array, size)) {
                     free_vartype((vartype *) rm);
                     return false;
                 }
                 #ifdef BCD_MATH
                     if (state_file_number_format != NUMBER_FORMAT_BID128)
                         for (int4 i = 0; i < size; i++)
-                            if (!rm->array->is_string[i])
-                                update_decimal(&rm->array->data[i].val);
+                            if (!IS_STRING(rm->array, i))
+                                update_decimal(&matrix_data(rm->array)[i].val);
                 #endif
             }
             if (shared) {
@@ -1385,13 +1429,13 @@ static bool unpersist_vartype(vartype **v, bool padded) {
             if (bin_dec_mode_switch()) {
                 int4 size = 2 * mp.rows * mp.columns;
                 for (int4 i = 0; i < size; i++)
-                    if (!read_phloat(cm->array->data + i)) {
+                    if (!read_phloat(matrix_data(cm->array) + i)) {
                         free_vartype((vartype *) cm);
                         return false;
                     }
             } else {
                 int4 size = 2 * mp.rows * mp.columns * sizeof(phloat);
-                if (fread(cm->array->data, 1, size, gfile) != size) {
+                if (fread(matrix_data(cm->array), 1, size, gfile) != size) {
                     free_vartype((vartype *) cm);
                     return false;
                 }
@@ -1399,7 +1443,7 @@ static bool unpersist_vartype(vartype **v, bool padded) {
                     if (state_file_number_format != NUMBER_FORMAT_BID128) {
                         size = mp.rows * mp.columns;
                         for (int4 i = 0; i < size; i++)
-                            update_decimal(&cm->array->data[i].val);
+                            update_decimal(&matrix_data(cm->array)[i].val);
                     }
                 #endif
             }
@@ -1538,6 +1582,8 @@ static bool suppress_varmenu_update = false;
 
 static bool unpersist_globals(int4 ver) {
     int i;
+    rtn_locals_valid = false;
+    invalidate_var_index();
     array_count = 0;
     array_list_capacity = 0;
     array_list = NULL;
@@ -1706,6 +1752,18 @@ static bool unpersist_globals(int4 ver) {
             prgms[i].capacity = prgms[i].size;
             prgms[i].text = (unsigned char *) malloc(prgms[i].size);
             // TODO - handle memory allocation failure
+            prgms[i].decoded_index = NULL;
+            prgms[i].decoded = NULL;
+            prgms[i].decoded_count = 0;
+            prgms[i].decoded_capacity = 0;
+            prgms[i].lclbls = NULL;
+            prgms[i].lclbls_count = 0;
+            prgms[i].lclbls_capacity = 0;
+            prgms[i].lclbl_hash = NULL;
+            prgms[i].lclbl_hash_size = 0;
+            prgms[i].line_pcs = NULL;
+            prgms[i].line_count = 0;
+            prgms[i].line_capacity = 0;
         }
         for (i = 0; i < prgms_count; i++) {
             if (fread(prgms[i].text, 1, prgms[i].size, gfile)
@@ -1909,9 +1967,13 @@ static bool unpersist_globals(int4 ver) {
 void clear_all_prgms() {
     if (prgms != NULL) {
         int i;
-        for (i = 0; i < prgms_count; i++)
+        for (i = 0; i < prgms_count; i++) {
             if (prgms[i].text != NULL)
                 free(prgms[i].text);
+            invalidate_decoded(i);
+            invalidate_lclbl_index(i);
+            invalidate_line_index(i);
+        }
         free(prgms);
     }
     prgms = NULL;
@@ -1922,6 +1984,10 @@ void clear_all_prgms() {
     labels = NULL;
     labels_capacity = 0;
     labels_count = 0;
+    free(labels_hash);
+    labels_hash = NULL;
+    labels_hash_size = 0;
+    labels_hash_valid = false;
 }
 
 int clear_prgm(const arg_struct *arg) {
@@ -1957,6 +2023,9 @@ int clear_prgm_by_index(int prgm_index) {
     else if (current_prgm > prgm_index)
         current_prgm--;
     free(prgms[prgm_index].text);
+    invalidate_decoded(prgm_index);
+    invalidate_lclbl_index(prgm_index);
+    invalidate_line_index(prgm_index);
     for (i = prgm_index; i < prgms_count - 1; i++)
         prgms[i] = prgms[i + 1];
     prgms_count--;
@@ -1972,6 +2041,7 @@ int clear_prgm_by_index(int prgm_index) {
             i++;
     }
     labels_count = i;
+    labels_hash_valid = false;
     if (prgms_count == 0 || prgm_index == prgms_count) {
         int saved_prgm = current_prgm;
         int saved_pc = pc;
@@ -2021,12 +2091,71 @@ void clear_prgm_lines(int4 count) {
             i++;
     }
     labels_count = i;
+    labels_hash_valid = false;
 
+    update_lclbl_index(current_prgm, frompc, -deleted);
+    update_line_index(current_prgm, frompc, -deleted);
     invalidate_lclbls(current_prgm, false);
     clear_all_rtns();
 }
 
-void goto_dot_dot(bool force_new) {
+static bool grow_labels();
+
+static bool grow_prgms() {
+    /* Makes room for one more program. The capacity is doubled, rather than
+     * grown by a fixed amount, so importing a large program library doesn't
+     * keep reallocating.
+     */
+    if (prgms_count < prgms_capacity)
+        return true;
+    int nc = prgms_capacity < 10 ? 10 : prgms_capacity * 2;
+    prgm_struct *np = (prgm_struct *) realloc(prgms, nc * sizeof(prgm_struct));
+    if (np == NULL)
+        return false;
+    prgms_capacity = nc;
+    prgms = np;
+    return true;
+}
+
+static int4 text_capacity(int4 capacity, int4 needed) {
+    /* Program text grows by doubling, starting at 512 bytes */
+    int4 c = capacity < 512 ? 512 : capacity;
+    while (c < needed)
+        c <<= 1;
+    return c;
+}
+
+void shrink_programs() {
+    /* Gives back the room left over by geometric growth. Called after bulk
+     * operations, like importing and pasting programs; the text is trimmed
+     * to the next multiple of 512 bytes, so that the next few edits still
+     * won't need to grow it again.
+     */
+    for (int i = 0; i < prgms_count; i++) {
+        prgm_struct *prgm = prgms + i;
+        int4 c = (prgm->size + 511) & ~511;
+        if (c < prgm->capacity) {
+            unsigned char *t = (unsigned char *) realloc(prgm->text, c);
+            if (t != NULL) {
+                prgm->text = t;
+                prgm->capacity = c;
+            }
+        }
+    }
+    int nc = prgms_count < 10 ? 10 : prgms_count;
+    if (nc < prgms_capacity) {
+        prgm_struct *np = (prgm_struct *) realloc(prgms, nc * sizeof(prgm_struct));
+        if (np != NULL) {
+            prgms = np;
+            prgms_capacity = nc;
+        }
+    }
+}
+
+bool goto_dot_dot(bool force_new) {
+    /* Returns false, after reporting Insufficient Memory, if a new program
+     * was needed but could not be created.
+     */
     int command;
     arg_struct arg;
     if (prgms_count != 0 && !force_new) {
@@ -2036,30 +2165,41 @@ void goto_dot_dot(bool force_new) {
         get_next_command(&pc, &command, &arg, 0);
         if (command == CMD_END) {
             pc = -1;
-            return;
+            return true;
         }
     }
-    if (prgms_count == prgms_capacity) {
-        prgm_struct *newprgms;
-        int i;
-        prgms_capacity += 10;
-        newprgms = (prgm_struct *) malloc(prgms_capacity * sizeof(prgm_struct));
-        // TODO - handle memory allocation failure
-        for (i = 0; i < prgms_count; i++)
-            newprgms[i] = prgms[i];
-        if (prgms != NULL)
-            free(prgms);
-        prgms = newprgms;
+    /* Everything the new program needs, including room for its END in
+     * the text and in the label table, is allocated up front, so it can't
+     * be left half made.
+     */
+    unsigned char *text = NULL;
+    if (!grow_prgms() || !grow_labels()
+            || (text = (unsigned char *) malloc(512)) == NULL) {
+        display_error(ERR_INSUFFICIENT_MEMORY, 1);
+        return false;
     }
     current_prgm = prgms_count++;
-    prgms[current_prgm].capacity = 0;
+    prgms[current_prgm].capacity = 512;
     prgms[current_prgm].size = 0;
     prgms[current_prgm].lclbl_invalid = 1;
-    prgms[current_prgm].text = NULL;
+    prgms[current_prgm].text = text;
+    prgms[current_prgm].decoded_index = NULL;
+    prgms[current_prgm].decoded = NULL;
+    prgms[current_prgm].decoded_count = 0;
+    prgms[current_prgm].decoded_capacity = 0;
+    prgms[current_prgm].lclbls = NULL;
+    prgms[current_prgm].lclbls_count = 0;
+    prgms[current_prgm].lclbls_capacity = 0;
+    prgms[current_prgm].lclbl_hash = NULL;
+    prgms[current_prgm].lclbl_hash_size = 0;
+    prgms[current_prgm].line_pcs = NULL;
+    prgms[current_prgm].line_count = 0;
+    prgms[current_prgm].line_capacity = 0;
     command = CMD_END;
     arg.type = ARGTYPE_NONE;
     store_command(0, command, &arg);
     pc = -1;
+    return true;
 }
 
 int mvar_prgms_exist() {
@@ -2212,15 +2352,205 @@ void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target){
     }
 }
 
-void rebuild_label_table() {
-    /* TODO -- this is *not* efficient; inserting and deleting ENDs and
-     * global LBLs should not cause every single program to get rescanned!
-     * But, I don't feel like dealing with that at the moment, so just
-     * this ugly brute force approach for now.
+const decoded_command *get_decoded_line(int4 pc) {
+    /* Returns the decoded form of the line at 'pc' in the current program,
+     * decoding it first if this is the first time it is asked for. Local
+     * GTO/XEQ targets are resolved as by get_next_command(..., 1), and the
+     * command's handler is linked in, so the run loop can dispatch on the
+     * result directly.
+     * Returns NULL if the cache can't be allocated.
+     */
+    prgm_struct *prgm = prgms + current_prgm;
+    int4 idx;
+    if (prgm->decoded_index == NULL) {
+        prgm->decoded_index = (int4 *) malloc(prgm->size * sizeof(int4));
+        if (prgm->decoded_index == NULL)
+            return NULL;
+        for (idx = 0; idx < prgm->size; idx++)
+            prgm->decoded_index[idx] = -1;
+    }
+    idx = prgm->decoded_index[pc];
+    if (idx == -1) {
+        decoded_command *dc;
+        if (prgm->decoded_count == prgm->decoded_capacity) {
+            int4 newcapacity = prgm->decoded_capacity == 0 ? 16
+                                    : prgm->decoded_capacity * 2;
+            decoded_command *newdecoded = (decoded_command *)
+                    realloc(prgm->decoded, newcapacity * sizeof(decoded_command));
+            if (newdecoded == NULL)
+                return NULL;
+            prgm->decoded = newdecoded;
+            prgm->decoded_capacity = newcapacity;
+        }
+        idx = prgm->decoded_count++;
+        prgm->decoded_index[pc] = idx;
+        dc = prgm->decoded + idx;
+        dc->next_pc = pc;
+        get_next_command(&dc->next_pc, &dc->cmd, &dc->arg, 1);
+        dc->handler = cmdlist(dc->cmd)->handler;
+        return dc;
+    }
+    return prgm->decoded + idx;
+}
+
+void get_decoded_command(int4 *pc, int *command, arg_struct *arg) {
+    /* Equivalent to get_next_command(pc, command, arg, 1), but decodes each
+     * line only once; subsequent executions of the same line are served from
+     * the current program's decoded-instruction cache.
+     */
+    const decoded_command *dc = get_decoded_line(*pc);
+    if (dc == NULL) {
+        get_next_command(pc, command, arg, 1);
+        return;
+    }
+    *command = dc->cmd;
+    *arg = dc->arg;
+    *pc = dc->next_pc;
+}
+
+void invalidate_decoded(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    free(prgm->decoded_index);
+    free(prgm->decoded);
+    prgm->decoded_index = NULL;
+    prgm->decoded = NULL;
+    prgm->decoded_count = 0;
+    prgm->decoded_capacity = 0;
+}
+
+int8 programs_mem_usage() {
+    /* Program text, the indexes and caches built from it, and the global
+     * label table
      */
+    int8 bytes = (int8) prgms_capacity * sizeof(prgm_struct)
+            + (int8) labels_capacity * sizeof(label_struct)
+            + (int8) labels_hash_size * sizeof(int);
+    for (int i = 0; i < prgms_count; i++) {
+        const prgm_struct *prgm = prgms + i;
+        bytes += prgm->capacity;
+        if (prgm->decoded_index != NULL)
+            bytes += (int8) prgm->size * sizeof(int4);
+        bytes += (int8) prgm->decoded_capacity * sizeof(decoded_command);
+        bytes += (int8) prgm->lclbls_capacity * sizeof(lclbl_entry);
+        if (prgm->lclbl_hash != NULL)
+            bytes += (int8) prgm->lclbl_hash_size * sizeof(int4);
+        bytes += (int8) prgm->line_capacity * sizeof(int4);
+    }
+    return bytes;
+}
+
+static int label_hash_slot(const char *name, int length) {
+    /* Returns the slot where the given name is, or where it would go */
+    uint4 h = length;
+    int mask = labels_hash_size - 1;
+    int i, slot;
+    for (i = 0; i < length; i++)
+        h = h * 31 + (unsigned char) name[i];
+    slot = h & mask;
+    while (true) {
+        int li = labels_hash[slot];
+        if (li == -1 || string_equals(labels[li].name, labels[li].length,
+                                                            name, length))
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+}
+
+static bool rehash_labels() {
+    int size = 16;
+    int i;
+    while (size < labels_count * 2)
+        size <<= 1;
+    if (size != labels_hash_size) {
+        int *newhash = (int *) realloc(labels_hash, size * sizeof(int));
+        if (newhash == NULL)
+            return false;
+        labels_hash = newhash;
+        labels_hash_size = size;
+    }
+    for (i = 0; i < size; i++)
+        labels_hash[i] = -1;
+    /* When a name occurs more than once, the last occurrence wins */
+    for (i = 0; i < labels_count; i++)
+        labels_hash[label_hash_slot(labels[i].name, labels[i].length)] = i;
+    labels_hash_valid = true;
+    return true;
+}
+
+static bool grow_labels() {
+    if (labels_count < labels_capacity)
+        return true;
+    int newcapacity = labels_capacity == 0 ? 50 : labels_capacity * 2;
+    label_struct *newlabels = (label_struct *)
+                realloc(labels, newcapacity * sizeof(label_struct));
+    if (newlabels == NULL)
+        return false;
+    labels = newlabels;
+    labels_capacity = newcapacity;
+    return true;
+}
+
+static int find_label_pos(int prgm, int4 pc) {
+    /* Returns the index of the first label at or after the given program
+     * and pc; 'labels' is sorted by program and pc.
+     */
+    int lo = 0, hi = labels_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (labels[mid].prgm < prgm
+                || labels[mid].prgm == prgm && labels[mid].pc < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static bool insert_label(int prgm, int4 pc) {
+    /* Adds the END or global LBL found at the given program and pc. When
+     * editing, the caller makes room with grow_labels() before changing the
+     * program, so that this can't fail and leave the table out of sync.
+     */
+    prgm_struct *p = prgms + prgm;
+    label_struct *newlabel;
+    int i, pos;
+    if (!grow_labels())
+        return false;
+    pos = find_label_pos(prgm, pc);
+    for (i = labels_count; i > pos; i--)
+        labels[i] = labels[i - 1];
+    labels_count++;
+    newlabel = labels + pos;
+    if (p->text[pc] == CMD_END)
+        newlabel->length = 0;
+    else {
+        newlabel->length = p->text[pc + 2];
+        for (i = 0; i < newlabel->length; i++)
+            newlabel->name[i] = p->text[pc + 3 + i];
+    }
+    newlabel->prgm = prgm;
+    newlabel->pc = pc;
+    labels_hash_valid = false;
+    return true;
+}
+
+static void remove_label(int prgm, int4 pc) {
+    int pos = find_label_pos(prgm, pc);
+    int i;
+    if (pos == labels_count || labels[pos].prgm != prgm
+                            || labels[pos].pc != pc)
+        return;
+    for (i = pos; i < labels_count - 1; i++)
+        labels[i] = labels[i + 1];
+    labels_count--;
+    labels_hash_valid = false;
+}
+
+void rebuild_label_table() {
     int prgm_index;
     int4 pc;
     labels_count = 0;
+    labels_hash_valid = false;
     for (prgm_index = 0; prgm_index < prgms_count; prgm_index++) {
         prgm_struct *prgm = prgms + prgm_index;
         pc = 0;
@@ -2232,31 +2562,13 @@ void rebuild_label_table() {
 
             if (command == CMD_END
                         || (command == CMD_LBL && argtype == ARGTYPE_STR)) {
-                label_struct *newlabel;
-                if (labels_count == labels_capacity) {
-                    label_struct *newlabels;
-                    int i;
-                    labels_capacity += 50;
-                    newlabels = (label_struct *)
-                                malloc(labels_capacity * sizeof(label_struct));
-                    // TODO - handle memory allocation failure
-                    for (i = 0; i < labels_count; i++)
-                        newlabels[i] = labels[i];
-                    if (labels != NULL)
-                        free(labels);
-                    labels = newlabels;
+                /* Always goes at the end, so this is just an append */
+                if (!insert_label(prgm_index, pc)) {
+                    /* Leave no partial table behind */
+                    labels_count = 0;
+                    display_error(ERR_INSUFFICIENT_MEMORY, 1);
+                    return;
                 }
-                newlabel = labels + labels_count++;
-                if (command == CMD_END)
-                    newlabel->length = 0;
-                else {
-                    int i;
-                    newlabel->length = prgm->text[pc + 2];
-                    for (i = 0; i < newlabel->length; i++)
-                        newlabel->name[i] = prgm->text[pc + 3 + i];
-                }
-                newlabel->prgm = prgm_index;
-                newlabel->pc = pc;
             }
             pc += get_command_length(prgm_index, pc);
         }
@@ -2265,16 +2577,28 @@ void rebuild_label_table() {
 
 static void update_label_table(int prgm, int4 pc, int inserted) {
     int i;
-    for (i = 0; i < labels_count; i++) {
+    for (i = find_label_pos(prgm, pc); i < labels_count; i++) {
         if (labels[i].prgm > prgm)
             return;
-        if (labels[i].prgm == prgm && labels[i].pc >= pc)
-            labels[i].pc += inserted;
+        labels[i].pc += inserted;
     }
 }
 
 static void invalidate_lclbls(int prgm_index, bool force) {
     prgm_struct *prgm = prgms + prgm_index;
+    /* This is called whenever a program's text changes, so it's also
+     * where the decoded-instruction cache gets discarded.
+     */
+    invalidate_decoded(prgm_index);
+    /* 'force' is used when lines have been moved between programs (END
+     * inserted or deleted), in which case the local label and line indexes
+     * can't be adjusted incrementally, so they are discarded and rebuilt on
+     * demand.
+     */
+    if (force) {
+        invalidate_lclbl_index(prgm_index);
+        invalidate_line_index(prgm_index);
+    }
     if (force || !prgm->lclbl_invalid) {
         int4 pc2 = 0;
         while (pc2 < prgm->size) {
@@ -2317,6 +2641,16 @@ void delete_command(int4 pc) {
             return;
         nextprgm = prgm + 1;
         prgm->size -= 2;
+        /* Remove this program's END from the label table, and move the
+         * next program's labels into this one.
+         */
+        remove_label(current_prgm, prgm->size);
+        for (pos = find_label_pos(current_prgm + 1, 0); pos < labels_count;
+                                                                pos++) {
+            if (labels[pos].prgm == current_prgm + 1)
+                labels[pos].pc += prgm->size;
+            labels[pos].prgm--;
+        }
         newsize = prgm->size + nextprgm->size;
         if (newsize > prgm->capacity) {
             int4 newcapacity = (newsize + 511) & ~511;
@@ -2331,10 +2665,12 @@ void delete_command(int4 pc) {
         for (pos = 0; pos < nextprgm->size; pos++)
             prgm->text[prgm->size++] = nextprgm->text[pos];
         free(nextprgm->text);
+        invalidate_decoded(current_prgm + 1);
+        invalidate_lclbl_index(current_prgm + 1);
+        invalidate_line_index(current_prgm + 1);
         for (pos = current_prgm + 1; pos < prgms_count - 1; pos++)
             prgms[pos] = prgms[pos + 1];
         prgms_count--;
-        rebuild_label_table();
         invalidate_lclbls(current_prgm, true);
         clear_all_rtns();
         draw_varmenu();
@@ -2344,10 +2680,11 @@ void delete_command(int4 pc) {
     for (pos = pc; pos < prgm->size - length; pos++)
         prgm->text[pos] = prgm->text[pos + length];
     prgm->size -= length;
+    update_lclbl_index(current_prgm, pc, -length);
+    update_line_index(current_prgm, pc, -length);
     if (command == CMD_LBL && argtype == ARGTYPE_STR)
-        rebuild_label_table();
-    else
-        update_label_table(current_prgm, pc, -length);
+        remove_label(current_prgm, pc);
+    update_label_table(current_prgm, pc, -length);
     invalidate_lclbls(current_prgm, false);
     clear_all_rtns();
     draw_varmenu();
@@ -2399,32 +2736,46 @@ void store_command(int4 pc, int command, arg_struct *arg) {
      */
     if (command == CMD_END && prgm->size > 0) {
         prgm_struct *new_prgm;
-        if (prgms_count == prgms_capacity) {
-            prgm_struct *new_prgms;
-            int i;
-            prgms_capacity += 10;
-            new_prgms = (prgm_struct *)
-                            malloc(prgms_capacity * sizeof(prgm_struct));
-            // TODO - handle memory allocation failure
-            for (i = 0; i <= current_prgm; i++)
-                new_prgms[i] = prgms[i];
-            for (i = current_prgm + 1; i < prgms_count; i++)
-                new_prgms[i + 1] = prgms[i];
-            free(prgms);
-            prgms = new_prgms;
-            prgm = prgms + current_prgm;
-        } else {
-            for (i = prgms_count - 1; i > current_prgm; i--)
-                prgms[i + 1] = prgms[i];
+        unsigned char *new_text;
+        int4 new_size = prgm->size - pc;
+        int4 new_capacity = (new_size + 511) & ~511;
+        if (!grow_prgms() || !grow_labels()) {
+            display_error(ERR_INSUFFICIENT_MEMORY, 1);
+            return;
+        }
+        new_text = (unsigned char *) malloc(new_capacity);
+        if (new_text == NULL) {
+            display_error(ERR_INSUFFICIENT_MEMORY, 1);
+            return;
         }
+        prgm = prgms + current_prgm;
+        for (i = prgms_count - 1; i > current_prgm; i--)
+            prgms[i + 1] = prgms[i];
         prgms_count++;
+        /* Labels from pc onward move to the new program */
+        for (i = find_label_pos(current_prgm, pc); i < labels_count; i++) {
+            if (labels[i].prgm == current_prgm)
+                labels[i].pc -= pc;
+            labels[i].prgm++;
+        }
         new_prgm = prgm + 1;
-        new_prgm->size = prgm->size - pc;
-        new_prgm->capacity = (new_prgm->size + 511) & ~511;
-        new_prgm->text = (unsigned char *) malloc(new_prgm->capacity);
-        // TODO - handle memory allocation failure
+        new_prgm->size = new_size;
+        new_prgm->capacity = new_capacity;
+        new_prgm->text = new_text;
         for (i = pc; i < prgm->size; i++)
             new_prgm->text[i - pc] = prgm->text[i];
+        new_prgm->decoded_index = NULL;
+        new_prgm->decoded = NULL;
+        new_prgm->decoded_count = 0;
+        new_prgm->decoded_capacity = 0;
+        new_prgm->lclbls = NULL;
+        new_prgm->lclbls_count = 0;
+        new_prgm->lclbls_capacity = 0;
+        new_prgm->lclbl_hash = NULL;
+        new_prgm->lclbl_hash_size = 0;
+        new_prgm->line_pcs = NULL;
+        new_prgm->line_count = 0;
+        new_prgm->line_capacity = 0;
         current_prgm++;
 
         /* Truncate the previously 'current' program and append an END.
@@ -2438,7 +2789,7 @@ void store_command(int4 pc, int command, arg_struct *arg) {
         if (flags.f.printer_exists && (flags.f.trace_print || flags.f.normal_print))
             print_program_line(current_prgm - 1, pc);
 
-        rebuild_label_table();
+        insert_label(current_prgm - 1, pc);
         invalidate_lclbls(current_prgm, true);
         invalidate_lclbls(current_prgm - 1, true);
         clear_all_rtns();
@@ -2490,11 +2841,22 @@ void store_command(int4 pc, int command, arg_struct *arg) {
         }
     }
 
+    if ((command == CMD_END
+                || command == CMD_LBL && arg->type == ARGTYPE_STR)
+            && !grow_labels()) {
+        display_error(ERR_INSUFFICIENT_MEMORY, 1);
+        return;
+    }
+
     if (bufptr + prgm->size > prgm->capacity) {
         unsigned char *newtext;
-        prgm->capacity += 512;
-        newtext = (unsigned char *) malloc(prgm->capacity);
-        // TODO - handle memory allocation failure
+        int4 newcapacity = text_capacity(prgm->capacity, bufptr + prgm->size);
+        newtext = (unsigned char *) malloc(newcapacity);
+        if (newtext == NULL) {
+            display_error(ERR_INSUFFICIENT_MEMORY, 1);
+            return;
+        }
+        prgm->capacity = newcapacity;
         for (pos = 0; pos < pc; pos++)
             newtext[pos] = prgm->text[pos];
         for (pos = pc; pos < prgm->size; pos++)
@@ -2509,14 +2871,15 @@ void store_command(int4 pc, int command, arg_struct *arg) {
     for (pos = 0; pos < bufptr; pos++)
         prgm->text[pc + pos] = buf[pos];
     prgm->size += bufptr;
+    update_lclbl_index(current_prgm, pc, bufptr);
+    update_line_index(current_prgm, pc, bufptr);
     if (command != CMD_END && flags.f.printer_exists && (flags.f.trace_print || flags.f.normal_print))
         print_program_line(current_prgm, pc);
     
+    update_label_table(current_prgm, pc, bufptr);
     if (command == CMD_END ||
             (command == CMD_LBL && arg->type == ARGTYPE_STR))
-        rebuild_label_table();
-    else
-        update_label_table(current_prgm, pc, bufptr);
+        insert_label(current_prgm, pc);
     invalidate_lclbls(current_prgm, false);
     clear_all_rtns();
     if (!suppress_varmenu_update)
@@ -2531,11 +2894,106 @@ void store_command_after(int4 *pc, int command, arg_struct *arg) {
     store_command(*pc, command, arg);
 }
 
+void invalidate_line_index(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    free(prgm->line_pcs);
+    prgm->line_pcs = NULL;
+    prgm->line_count = 0;
+    prgm->line_capacity = 0;
+}
+
+static bool grow_line_index(prgm_struct *prgm) {
+    if (prgm->line_count < prgm->line_capacity)
+        return true;
+    int4 newcap = prgm->line_capacity == 0 ? 64 : prgm->line_capacity * 2;
+    int4 *newpcs = (int4 *) realloc(prgm->line_pcs, newcap * sizeof(int4));
+    if (newpcs == NULL)
+        return false;
+    prgm->line_pcs = newpcs;
+    prgm->line_capacity = newcap;
+    return true;
+}
+
+static bool build_line_index(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 pc2 = 0;
+    invalidate_line_index(prgm_index);
+    while (pc2 < prgm->size) {
+        if (!grow_line_index(prgm)) {
+            invalidate_line_index(prgm_index);
+            return false;
+        }
+        prgm->line_pcs[prgm->line_count++] = pc2;
+        pc2 += get_command_length(prgm_index, pc2);
+    }
+    return true;
+}
+
+static int4 find_line_index(const prgm_struct *prgm, int4 pc) {
+    /* Returns the index of the first line at or after 'pc' */
+    int4 lo = 0, hi = prgm->line_count;
+    while (lo < hi) {
+        int4 mid = (lo + hi) / 2;
+        if (prgm->line_pcs[mid] < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void update_line_index(int prgm_index, int4 pc, int4 delta) {
+    /* Called after a line of 'delta' bytes has been inserted at 'pc'
+     * (delta > 0), or after lines totaling -delta bytes have been removed
+     * from 'pc' onward (delta < 0). A DEL that deletes nothing passes
+     * delta == 0, which leaves the line numbering unchanged.
+     */
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 i, j;
+    if (prgm->line_pcs == NULL || delta == 0)
+        return;
+    i = find_line_index(prgm, pc);
+    if (delta < 0) {
+        j = find_line_index(prgm, pc - delta);
+        for (; j < prgm->line_count; i++, j++)
+            prgm->line_pcs[i] = prgm->line_pcs[j] + delta;
+        prgm->line_count = i;
+    } else {
+        if (!grow_line_index(prgm)) {
+            invalidate_line_index(prgm_index);
+            return;
+        }
+        for (j = prgm->line_count; j > i; j--)
+            prgm->line_pcs[j] = prgm->line_pcs[j - 1] + delta;
+        prgm->line_pcs[i] = pc;
+        prgm->line_count++;
+    }
+}
+
 static int pc_line_convert(int4 loc, int loc_is_pc) {
     int4 pc = 0;
     int4 line = 1;
     prgm_struct *prgm = prgms + current_prgm;
 
+    if ((prgm->line_pcs != NULL || build_line_index(current_prgm))
+            && prgm->line_count > 0) {
+        /* The last line is always the END, which is where both
+         * conversions stop if 'loc' is past the end of the program.
+         */
+        if (loc_is_pc) {
+            int4 i = find_line_index(prgm, loc);
+            if (i == prgm->line_count)
+                i--;
+            return i + 1;
+        } else {
+            if (loc < 1)
+                loc = 1;
+            else if (loc > prgm->line_count)
+                loc = prgm->line_count;
+            return prgm->line_pcs[loc - 1];
+        }
+    }
+
     while (1) {
         if (loc_is_pc) {
             if (pc >= loc)
@@ -2565,7 +3023,192 @@ int4 line2pc(int4 line) {
         return pc_line_convert(line, 0);
 }
 
-int4 find_local_label(const arg_struct *arg) {
+void invalidate_lclbl_index(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    free(prgm->lclbls);
+    free(prgm->lclbl_hash);
+    prgm->lclbls = NULL;
+    prgm->lclbls_count = 0;
+    prgm->lclbls_capacity = 0;
+    prgm->lclbl_hash = NULL;
+    prgm->lclbl_hash_size = 0;
+}
+
+static bool get_lclbl(const prgm_struct *prgm, int4 pc, char *type, int4 *num) {
+    /* Checks if the line at 'pc' is a local LBL, and if so, returns its
+     * label in the form used by the index: ARGTYPE_NUM with the label
+     * number, ARGTYPE_LCLBL with the label character, or ARGTYPE_STK with
+     * the register name, for synthetic LBL ST T etc.
+     */
+    int command = prgm->text[pc];
+    int argtype = prgm->text[pc + 1];
+    command |= (argtype & 240) << 4;
+    argtype &= 15;
+    if (command != CMD_LBL)
+        return false;
+    if (argtype == ARGTYPE_NUM) {
+        int4 n = 0;
+        unsigned char c;
+        pc += 2;
+        do {
+            c = prgm->text[pc++];
+            n = (n << 7) | (c & 127);
+        } while ((c & 128) == 0);
+        *num = n;
+    } else if (argtype == ARGTYPE_STK || argtype == ARGTYPE_LCLBL)
+        *num = prgm->text[pc + 2];
+    else
+        return false;
+    *type = argtype;
+    return true;
+}
+
+static int4 lclbl_hash_slot(const prgm_struct *prgm, char type, int4 num) {
+    /* Returns the slot where the given label is, or where it would go */
+    int4 mask = prgm->lclbl_hash_size - 1;
+    int4 slot = ((uint4) num * 31 + type) & mask;
+    while (true) {
+        int4 idx = prgm->lclbl_hash[slot];
+        if (idx == -1)
+            return slot;
+        const lclbl_entry *e = prgm->lclbls + idx;
+        if (e->type == type && e->num == num)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+}
+
+static bool rehash_lclbls(prgm_struct *prgm) {
+    int4 size = 16;
+    int4 i;
+    while (size < prgm->lclbls_count * 2)
+        size <<= 1;
+    if (size != prgm->lclbl_hash_size) {
+        int4 *newhash = (int4 *) realloc(prgm->lclbl_hash, size * sizeof(int4));
+        if (newhash == NULL)
+            return false;
+        prgm->lclbl_hash = newhash;
+        prgm->lclbl_hash_size = size;
+    }
+    for (i = 0; i < size; i++)
+        prgm->lclbl_hash[i] = -1;
+    /* Going backwards, so each label's chain ends up in order of pc */
+    for (i = prgm->lclbls_count - 1; i >= 0; i--) {
+        lclbl_entry *e = prgm->lclbls + i;
+        int4 slot = lclbl_hash_slot(prgm, e->type, e->num);
+        e->next = prgm->lclbl_hash[slot];
+        prgm->lclbl_hash[slot] = i;
+    }
+    return true;
+}
+
+static bool grow_lclbls(prgm_struct *prgm) {
+    if (prgm->lclbls_count < prgm->lclbls_capacity)
+        return true;
+    int4 newcap = prgm->lclbls_capacity == 0 ? 16 : prgm->lclbls_capacity * 2;
+    lclbl_entry *newlbls = (lclbl_entry *)
+                realloc(prgm->lclbls, newcap * sizeof(lclbl_entry));
+    if (newlbls == NULL)
+        return false;
+    prgm->lclbls = newlbls;
+    prgm->lclbls_capacity = newcap;
+    return true;
+}
+
+static bool build_lclbl_index(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 pc2 = 0;
+    invalidate_lclbl_index(prgm_index);
+    while (pc2 < prgm->size) {
+        char type;
+        int4 num;
+        if (get_lclbl(prgm, pc2, &type, &num)) {
+            if (!grow_lclbls(prgm))
+                goto fail;
+            lclbl_entry *e = prgm->lclbls + prgm->lclbls_count++;
+            e->pc = pc2;
+            e->type = type;
+            e->num = num;
+        }
+        pc2 += get_command_length(prgm_index, pc2);
+    }
+    if (rehash_lclbls(prgm))
+        return true;
+    fail:
+    invalidate_lclbl_index(prgm_index);
+    return false;
+}
+
+static void update_lclbl_index(int prgm_index, int4 pc, int4 delta) {
+    /* Called after 'delta' bytes have been inserted at 'pc' (delta > 0),
+     * or removed from 'pc' onward (delta < 0). The label entries are
+     * shifted, and added or removed, to match the new text, so edits never
+     * require the program to be rescanned. A DEL that deletes nothing
+     * passes delta == 0, which must not be mistaken for an insertion.
+     */
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 i, j;
+    if (prgm->lclbl_hash == NULL || delta == 0)
+        return;
+    if (delta < 0) {
+        for (i = j = 0; j < prgm->lclbls_count; j++) {
+            lclbl_entry *e = prgm->lclbls + j;
+            if (e->pc >= pc && e->pc < pc - delta)
+                continue;
+            if (e->pc >= pc)
+                e->pc += delta;
+            prgm->lclbls[i++] = *e;
+        }
+        prgm->lclbls_count = i;
+    } else {
+        char type;
+        int4 num;
+        int4 pos = prgm->lclbls_count;
+        for (i = 0; i < prgm->lclbls_count; i++)
+            if (prgm->lclbls[i].pc >= pc) {
+                if (pos == prgm->lclbls_count)
+                    pos = i;
+                prgm->lclbls[i].pc += delta;
+            }
+        if (get_lclbl(prgm, pc, &type, &num)) {
+            if (!grow_lclbls(prgm)) {
+                invalidate_lclbl_index(prgm_index);
+                return;
+            }
+            for (i = prgm->lclbls_count; i > pos; i--)
+                prgm->lclbls[i] = prgm->lclbls[i - 1];
+            prgm->lclbls[pos].pc = pc;
+            prgm->lclbls[pos].type = type;
+            prgm->lclbls[pos].num = num;
+            prgm->lclbls_count++;
+        }
+    }
+    if (!rehash_lclbls(prgm))
+        invalidate_lclbl_index(prgm_index);
+}
+
+static int4 lookup_lclbl(const prgm_struct *prgm, char type, int4 num,
+                                                        int4 from_pc) {
+    /* Returns the pc of the first occurrence of the given label at or after
+     * from_pc, wrapping around to the beginning of the program if necessary,
+     * or -2 if the label does not exist.
+     */
+    int4 idx = prgm->lclbl_hash[lclbl_hash_slot(prgm, type, num)];
+    int4 first;
+    if (idx == -1)
+        return -2;
+    first = prgm->lclbls[idx].pc;
+    while (idx != -1) {
+        const lclbl_entry *e = prgm->lclbls + idx;
+        if (e->pc >= from_pc)
+            return e->pc;
+        idx = e->next;
+    }
+    return first;
+}
+
+static int4 find_local_label_slow(const arg_struct *arg) {
+    /* Used when the label index can't be allocated */
     int4 orig_pc = pc;
     int4 search_pc;
     int wrapped = 0;
@@ -2604,7 +3247,7 @@ int4 find_local_label(const arg_struct *arg) {
                 // Allow GTO ST T and GTO 112
                 char stk = prgm->text[search_pc + 2];
                 if (arg->type == ARGTYPE_STK) {
-                    if (stk = arg->val.stk)
+                    if (stk == arg->val.stk)
                         return search_pc;
                 } else if (arg->type == ARGTYPE_NUM) {
                     int num = 0;
@@ -2630,10 +3273,62 @@ int4 find_local_label(const arg_struct *arg) {
     return -2;
 }
 
+int4 find_local_label(const arg_struct *arg) {
+    int4 orig_pc = pc;
+    int4 target;
+    prgm_struct *prgm = prgms + current_prgm;
+
+    if (prgm->lclbl_hash == NULL && !build_lclbl_index(current_prgm))
+        return find_local_label_slow(arg);
+    if (orig_pc == -1)
+        orig_pc = 0;
+
+    switch (arg->type) {
+        case ARGTYPE_NUM: {
+            // Synthetic LBL ST T etc. are also found by GTO 112 etc.
+            char stk = 0;
+            switch (arg->val.num) {
+                case 112: stk = 'T'; break;
+                case 113: stk = 'Z'; break;
+                case 114: stk = 'Y'; break;
+                case 115: stk = 'X'; break;
+                case 116: stk = 'L'; break;
+            }
+            target = lookup_lclbl(prgm, ARGTYPE_NUM, arg->val.num, orig_pc);
+            if (stk != 0) {
+                int4 t2 = lookup_lclbl(prgm, ARGTYPE_STK, stk, orig_pc);
+                /* If both exist, take whichever comes first searching
+                 * forward from orig_pc
+                 */
+                if (target == -2)
+                    target = t2;
+                else if (t2 != -2 && ((t2 >= orig_pc) == (target >= orig_pc)
+                                        ? t2 < target : t2 >= orig_pc))
+                    target = t2;
+            }
+            return target;
+        }
+        case ARGTYPE_STK:
+            return lookup_lclbl(prgm, ARGTYPE_STK, arg->val.stk, orig_pc);
+        case ARGTYPE_LCLBL:
+            return lookup_lclbl(prgm, ARGTYPE_LCLBL, arg->val.lclbl, orig_pc);
+        default:
+            return -2;
+    }
+}
+
 int find_global_label(const arg_struct *arg, int *prgm, int4 *pc) {
     int i;
     const char *name = arg->val.text;
     int namelen = arg->length;
+    if (labels_hash_valid || rehash_labels()) {
+        i = labels_hash[label_hash_slot(name, namelen)];
+        if (i == -1)
+            return 0;
+        *prgm = labels[i].prgm;
+        *pc = labels[i].pc;
+        return 1;
+    }
     for (i = labels_count - 1; i >= 0; i--) {
         int j;
         char *labelname;
@@ -2651,21 +3346,46 @@ int find_global_label(const arg_struct *arg, int *prgm, int4 *pc) {
     return 0;
 }
 
+int find_containing_label(int prgm, int4 pc) {
+    /* Returns the index of the last global LBL at or before the given pc in
+     * the given program, or -1 if there is none.
+     */
+    int i = find_label_pos(prgm, pc + 1) - 1;
+    while (i >= 0 && labels[i].prgm == prgm) {
+        if (labels[i].length > 0)
+            return i;
+        i--;
+    }
+    return -1;
+}
+
+static bool grow_rtn_stack(int n) {
+    /* Makes room for n more entries. The capacity is doubled, rather than
+     * grown by a fixed amount, so deep recursion doesn't keep reallocating.
+     */
+    if (rtn_sp + n <= rtn_stack_capacity)
+        return true;
+    int new_rtn_stack_capacity = rtn_stack_capacity == 0 ? 16 : rtn_stack_capacity;
+    while (new_rtn_stack_capacity < rtn_sp + n)
+        new_rtn_stack_capacity <<= 1;
+    rtn_stack_entry *new_rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, new_rtn_stack_capacity * sizeof(rtn_stack_entry));
+    if (new_rtn_stack == NULL)
+        return false;
+    rtn_stack_capacity = new_rtn_stack_capacity;
+    rtn_stack = new_rtn_stack;
+    return true;
+}
+
 int push_rtn_addr(int prgm, int4 pc) {
     if (rtn_level == MAX_RTN_LEVEL)
         return ERR_RTN_STACK_FULL;
-    if (rtn_sp == rtn_stack_capacity) {
-        int new_rtn_stack_capacity = rtn_stack_capacity + 16;
-        rtn_stack_entry *new_rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, new_rtn_stack_capacity * sizeof(rtn_stack_entry));
-        if (new_rtn_stack == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
-        rtn_stack_capacity = new_rtn_stack_capacity;
-        rtn_stack = new_rtn_stack;
-    }
+    if (!grow_rtn_stack(1))
+        return ERR_INSUFFICIENT_MEMORY;
     rtn_stack[rtn_sp].prgm = prgm & 0x7fffffff;
     rtn_stack[rtn_sp].pc = pc;
     rtn_sp++;
     rtn_level++;
+    rtn_locals[rtn_level] = 0;
     if (prgm == -2)
         rtn_solve_active = true;
     else if (prgm == -3)
@@ -2684,14 +3404,8 @@ int push_indexed_matrix(const char *name, int len) {
     if (rtn_level == 0) {
         if (rtn_level_0_has_matrix_entry)
             return ERR_NONE;
-        if (rtn_sp + 2 > rtn_stack_capacity) {
-            int new_rtn_stack_capacity = rtn_stack_capacity + 16;
-            rtn_stack_entry *new_rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, new_rtn_stack_capacity * sizeof(rtn_stack_entry));
-            if (new_rtn_stack == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            rtn_stack_capacity = new_rtn_stack_capacity;
-            rtn_stack = new_rtn_stack;
-        }
+        if (!grow_rtn_stack(2))
+            return ERR_INSUFFICIENT_MEMORY;
         rtn_level_0_has_matrix_entry = true;
         rtn_sp += 2;
         rtn_stack_matrix_name_entry e1;
@@ -2706,14 +3420,8 @@ int push_indexed_matrix(const char *name, int len) {
     } else {
         if ((rtn_stack[rtn_sp - 1].prgm & 0x80000000) != 0)
             return ERR_NONE;
-        if (rtn_sp + 2 > rtn_stack_capacity) {
-            int new_rtn_stack_capacity = rtn_stack_capacity + 16;
-            rtn_stack_entry *new_rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, new_rtn_stack_capacity * sizeof(rtn_stack_entry));
-            if (new_rtn_stack == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            rtn_stack_capacity = new_rtn_stack_capacity;
-            rtn_stack = new_rtn_stack;
-        }
+        if (!grow_rtn_stack(2))
+            return ERR_INSUFFICIENT_MEMORY;
         rtn_sp += 2;
         rtn_stack[rtn_sp - 1] = rtn_stack[rtn_sp - 3];
         rtn_stack[rtn_sp - 1].prgm |= 0x80000000;
@@ -2748,13 +3456,47 @@ bool should_i_stop_at_this_level() {
     return stop;
 }
 
+static void count_locals() {
+    for (int i = 0; i <= MAX_RTN_LEVEL; i++)
+        rtn_locals[i] = 0;
+    for (int i = 0; i < vars_count; i++) {
+        int level = vars[i].level;
+        if (level >= 0 && level <= MAX_RTN_LEVEL)
+            rtn_locals[level]++;
+    }
+    rtn_locals_valid = true;
+}
+
+void update_local_count(int delta) {
+    /* Called by store_var() and purge_var() when they create or delete a
+     * local variable at the current level.
+     */
+    if (rtn_locals_valid)
+        rtn_locals[rtn_level] += delta;
+}
+
+void invalidate_local_counts() {
+    rtn_locals_valid = false;
+}
+
+int8 rtn_stack_mem_usage() {
+    return (int8) rtn_stack_capacity * sizeof(rtn_stack_entry);
+}
+
 static void remove_locals() {
+    if (!rtn_locals_valid)
+        count_locals();
+    int n = rtn_locals[rtn_level];
+    if (n == 0)
+        return;
+    rtn_locals[rtn_level] = 0;
     int last = -1;
-    for (int i = vars_count - 1; i >= 0; i--) {
+    for (int i = vars_count - 1; i >= 0 && n > 0; i--) {
         if (vars[i].level == -1)
             continue;
         if (vars[i].level < rtn_level)
             break;
+        n--;
         if ((matedit_mode == 1 || matedit_mode == 3)
                 && string_equals(vars[i].name, vars[i].length, matedit_name, matedit_length)) {
             if (matedit_mode == 3) {
@@ -2763,10 +3505,12 @@ static void remove_locals() {
             }
             matedit_mode = 0;
         }
+        var_index_remove(i);
         if (vars[i].hiding) {
             for (int j = i - 1; j >= 0; j--)
                 if (vars[j].hidden && string_equals(vars[i].name, vars[i].length, vars[j].name, vars[j].length)) {
                     vars[j].hidden = false;
+                    var_index_update(j);
                     break;
                 }
         }
@@ -2779,8 +3523,12 @@ static void remove_locals() {
     int from = last;
     int to = last;
     while (from < vars_count) {
-        if (vars[from].length != 100)
-            vars[to++] = vars[from];
+        if (vars[from].length != 100) {
+            vars[to] = vars[from];
+            if (!vars[to].hidden)
+                var_index_update(to);
+            to++;
+        }
         from++;
     }
     vars_count -= from - to;
@@ -3694,6 +4442,7 @@ void hard_reset(int reason) {
         labels = NULL;
         labels_capacity = 0;
         labels_count = 0;
+        labels_hash_valid = false;
     }
     goto_dot_dot(false);
 
@@ -3966,7 +4715,8 @@ static bool convert_programs(bool *clear_stack) {
                         int4 pos;
                         if (prgm->size + growth > prgm->capacity) {
                             unsigned char *newtext;
-                            prgm->capacity += 512;
+                            prgm->capacity = text_capacity(prgm->capacity,
+                                                    prgm->size + growth);
                             newtext = (unsigned char *) malloc(prgm->capacity);
                             if (newtext == NULL)
                                 // Failed to grow program; abort.
@@ -234,12 +234,47 @@ typedef struct {
 } vartype_complex;
 
 
-typedef struct {
+/* Matrix elements are copied on write in chunks of this many; see
+ * disentangle_element() in core_variables.cc.
+ */
+#define MATRIX_CHUNK 64
+
+typedef struct realmatrix_data_struct {
     int refcount;
+    /* Don't use this directly; use matrix_data() or matrix_element(), in
+     * core_variables.h, which know about copies in progress.
+     */
     phloat *data;
-    char *is_string;
+    /* Bit (i & 7) of is_string[i >> 3] is set if element i is a string;
+     * string_count is the number of bits set, so all-numeric matrices can
+     * be recognized without looking at the bitmap.
+     * Use IS_STRING() to read the flags, and set_is_string() and friends,
+     * in core_variables.cc, to change them.
+     */
+    unsigned char *is_string;
+    int4 string_count;
+    /* Size of the block holding this struct and the matrix, in bytes */
+    int4 bytes;
+    /* Number of elements */
+    int4 size;
+    /* While this array is a copy in progress, 'source' is the array it is
+     * being copied from, which it holds a reference to, and bit (c & 7) of
+     * copied[c >> 3] is set for each chunk c that has been copied so far;
+     * the others are still read from 'source'. chunks_left counts those.
+     */
+    struct realmatrix_data_struct *source;
+    unsigned char *copied;
+    int4 chunks_left;
 } realmatrix_data;
 
+#define CHUNK_COPIED(array, i) \
+        (((array)->copied[(i) / MATRIX_CHUNK >> 3] \
+                >> ((i) / MATRIX_CHUNK & 7)) & 1)
+#define IS_STRING(array, i) \
+        ((((array)->source == NULL || CHUNK_COPIED(array, i) \
+                ? (array) : (array)->source)->is_string[(i) >> 3] \
+                                >> ((i) & 7)) & 1)
+
 typedef struct {
     int type;
     int4 rows;
@@ -248,9 +283,17 @@ typedef struct {
 } vartype_realmatrix;
 
 
-typedef struct {
+typedef struct complexmatrix_data_struct {
     int refcount;
+    /* Don't use this directly; see realmatrix_data */
     phloat *data;
+    /* Size of the block holding this struct and the matrix, in bytes */
+    int4 bytes;
+    /* Number of elements, and copy in progress; see realmatrix_data */
+    int4 size;
+    struct complexmatrix_data_struct *source;
+    unsigned char *copied;
+    int4 chunks_left;
 } complexmatrix_data;
 
 typedef struct {
@@ -381,11 +424,51 @@ extern int vars_count;
 extern var_struct *vars;
 
 /* Programs */
+typedef struct {
+    int cmd;
+    int4 next_pc;
+    int (*handler)(arg_struct *arg);
+    arg_struct arg;
+} decoded_command;
+typedef struct {
+    int4 pc;
+    int4 num;
+    char type;
+    int4 next;
+} lclbl_entry;
 typedef struct {
     int4 capacity;
     int4 size;
     int lclbl_invalid;
     unsigned char *text;
+    /* Decoded-instruction cache, used by the run loop; see
+     * get_decoded_command(). decoded_index maps each pc to an index into
+     * 'decoded', or -1 if that line hasn't been decoded yet. Both arrays
+     * are allocated on demand, and discarded whenever 'text' changes.
+     */
+    int4 *decoded_index;
+    decoded_command *decoded;
+    int4 decoded_count;
+    int4 decoded_capacity;
+    /* Local label index, used by find_local_label(). 'lclbls' holds all the
+     * local LBLs in the program, in order of pc; 'lclbl_hash' is an open
+     * hash table mapping each label to the index of its first occurrence,
+     * and the 'next' field of each entry links it to the next occurrence of
+     * the same label, if any. Built on demand, and adjusted in place when
+     * lines are inserted or deleted; lclbl_hash is NULL while not built.
+     */
+    lclbl_entry *lclbls;
+    int4 lclbls_count;
+    int4 lclbls_capacity;
+    int4 *lclbl_hash;
+    int4 lclbl_hash_size;
+    /* Line index, used by pc2line() and line2pc(): line_pcs[n] is the pc of
+     * line n + 1. Built on demand, and adjusted in place when lines are
+     * inserted or deleted; NULL while not built.
+     */
+    int4 *line_pcs;
+    int4 line_count;
+    int4 line_capacity;
 } prgm_struct;
 typedef struct {
     int4 capacity;
@@ -536,11 +619,17 @@ void clear_all_prgms();
 int clear_prgm(const arg_struct *arg);
 int clear_prgm_by_index(int prgm_index);
 void clear_prgm_lines(int4 count);
-void goto_dot_dot(bool force_new);
+bool goto_dot_dot(bool force_new);
+void shrink_programs();
 int mvar_prgms_exist();
 int label_has_mvar(int lblindex);
 int get_command_length(int prgm, int4 pc);
 void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target);
+const decoded_command *get_decoded_line(int4 pc);
+void get_decoded_command(int4 *pc, int *command, arg_struct *arg);
+void invalidate_decoded(int prgm_index);
+void invalidate_lclbl_index(int prgm_index);
+void invalidate_line_index(int prgm_index);
 void rebuild_label_table();
 void delete_command(int4 pc);
 void store_command(int4 pc, int command, arg_struct *arg);
@@ -549,6 +638,7 @@ int4 pc2line(int4 pc);
 int4 line2pc(int4 line);
 int4 find_local_label(const arg_struct *arg);
 int find_global_label(const arg_struct *arg, int *prgm, int4 *pc);
+int find_containing_label(int prgm, int4 pc);
 int push_rtn_addr(int prgm, int4 pc);
 int push_indexed_matrix(const char *name, int len);
 void step_out();
@@ -558,6 +648,10 @@ void pop_rtn_addr(int *prgm, int4 *pc, bool *stop);
 void pop_indexed_matrix(const char *name, int namelen);
 void clear_all_rtns();
 int get_rtn_level();
+void update_local_count(int delta);
+void invalidate_local_counts();
+int8 programs_mem_usage();
+int8 rtn_stack_mem_usage();
 bool solve_active();
 bool integ_active();
 bool unwind_stack_until_solve();
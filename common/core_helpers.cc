@@ -17,6 +17,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "core_helpers.h"
 #include "core_commands2.h"
@@ -42,8 +43,8 @@ int resolve_ind_arg(arg_struct *arg) {
                 int4 num = arg->val.num;
                 if (num >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[num]) {
-                    phloat *d = &rm->array->data[num];
+                if (IS_STRING(rm->array, num)) {
+                    phloat *d = matrix_element(rm->array, num);
                     int len = phloat_length(*d);
                     if (len == 0)
                         return ERR_RESTRICTED_OPERATION;
@@ -52,7 +53,7 @@ int resolve_ind_arg(arg_struct *arg) {
                     for (int i = 0; i < len; i++)
                         arg->val.text[i] = phloat_text(*d)[i];
                 } else {
-                    phloat x = rm->array->data[num];
+                    phloat x = *matrix_element(rm->array, num);
                     if (x < 0)
                         x = -x;
                     if (x >= 2147483648.0)
@@ -125,16 +126,9 @@ int arg_to_num(arg_struct *arg, int4 *num) {
 }
 
 int is_pure_real(const vartype *matrix) {
-    vartype_realmatrix *rm;
-    int4 size, i;
     if (matrix->type != TYPE_REALMATRIX)
         return 0;
-    rm = (vartype_realmatrix *) matrix;
-    size = rm->rows * rm->columns;
-    for (i = 0; i < size; i++)
-        if (rm->array->is_string[i])
-            return 0;
-    return 1;
+    return contains_no_strings((const vartype_realmatrix *) matrix);
 }
 
 void recall_result(vartype *v) {
@@ -151,6 +145,63 @@ void recall_result(vartype *v) {
         docmd_prx(NULL);
 }
 
+bool overwrite_scalar(vartype *dst, const vartype *src) {
+    /* If 'dst' and 'src' are scalars of the same type, copies the value of
+     * 'src' into 'dst' and returns true. This lets a register that is about
+     * to be discarded take the place of a copy of 'src', saving the
+     * free_vartype() and dup_vartype() round trip.
+     */
+    if (dst->type != src->type)
+        return false;
+    switch (src->type) {
+        case TYPE_REAL:
+            ((vartype_real *) dst)->x = ((const vartype_real *) src)->x;
+            return true;
+        case TYPE_COMPLEX: {
+            vartype_complex *d = (vartype_complex *) dst;
+            const vartype_complex *s = (const vartype_complex *) src;
+            d->re = s->re;
+            d->im = s->im;
+            return true;
+        }
+        case TYPE_STRING: {
+            vartype_string *d = (vartype_string *) dst;
+            const vartype_string *s = (const vartype_string *) src;
+            d->length = s->length;
+            memmove(d->text, s->text, s->length);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+int recall_copy(const vartype *src) {
+    /* Like recall_result(dup_vartype(src)), but when the register that
+     * drops off the stack (T, or X if stack lift is disabled) holds the
+     * same type of scalar as 'src', it is reused for the copy. 'src' may
+     * be one of the stack registers itself.
+     */
+    vartype **drop = flags.f.stack_lift_disable ? &reg_x : &reg_t;
+    if (!overwrite_scalar(*drop, src)) {
+        vartype *v = dup_vartype(src);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        recall_result(v);
+        return ERR_NONE;
+    }
+    vartype *v = *drop;
+    if (!flags.f.stack_lift_disable) {
+        reg_t = reg_z;
+        reg_z = reg_y;
+        reg_y = reg_x;
+    }
+    reg_x = v;
+    if (flags.f.trace_print && flags.f.printer_exists)
+        docmd_prx(NULL);
+    return ERR_NONE;
+}
+
 void recall_two_results(vartype *x, vartype *y) {
     if (flags.f.stack_lift_disable) {
         free_vartype(reg_t);
@@ -177,17 +228,56 @@ void unary_result(vartype *x) {
         docmd_prx(NULL);
 }
 
+static void drop_y() {
+    /* Drops Y, and duplicates T. When Y and T are scalars of the same type,
+     * Y becomes the copy of T.
+     */
+    vartype *y = reg_y;
+    reg_y = reg_z;
+    if (overwrite_scalar(y, reg_t))
+        reg_z = y;
+    else {
+        free_vartype(y);
+        reg_z = dup_vartype(reg_t);
+    }
+}
+
 void binary_result(vartype *x) {
     free_vartype(reg_lastx);
     reg_lastx = reg_x;
     reg_x = x;
-    free_vartype(reg_y);
-    reg_y = reg_z;
-    reg_z = dup_vartype(reg_t);
+    drop_y();
     if (flags.f.trace_print && flags.f.printer_exists)
         docmd_prx(NULL);
 }
 
+int binary_real_result(int (*op)(phloat x, phloat y, phloat *z)) {
+    /* For + - * / with reals in X and Y. The result goes into the register
+     * that held LASTX, if that is a real, so that the stack is updated
+     * without allocating or freeing anything.
+     */
+    phloat z;
+    int err = op(((vartype_real *) reg_x)->x, ((vartype_real *) reg_y)->x, &z);
+    if (err != ERR_NONE)
+        return err;
+    vartype *v;
+    if (reg_lastx->type != TYPE_REAL) {
+        v = new_real(z);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        binary_result(v);
+        return ERR_NONE;
+    }
+    v = reg_lastx;
+    ((vartype_real *) v)->x = z;
+    reg_lastx = reg_x;
+    reg_x = v;
+    drop_y();
+    if (flags.f.trace_print && flags.f.printer_exists)
+        docmd_prx(NULL);
+    return ERR_NONE;
+}
+
 phloat rad_to_angle(phloat x) {
     if (flags.f.rad)
         return x;
@@ -496,26 +586,52 @@ phloat base2phloat(int8 n) {
         return phloat((uint8) n);
 }
 
+/* Reduces n to the current word size, for WRAP mode */
+static int8 base_wrap(int8 n, int wsize) {
+    if (flags.f.base_signed) {
+        int8 m = 1LL << (wsize - 1);
+        if ((n & m) != 0)
+            n |= -1LL << (wsize - 1);
+        else
+            n &= (1LL << (wsize - 1)) - 1;
+    } else {
+        if (wsize < 64)
+            n &= (1ULL << wsize) - 1;
+    }
+    return n;
+}
+
 bool phloat2base(phloat p, int8 *res) {
     int wsize = effective_wsize();
+#ifdef BCD_MATH
+    /* Integers with small coefficients, which is what base mode mostly
+     * deals with, can be checked and converted without going through
+     * the BID library.
+     */
+    int8 t;
+    bool exact;
+    if (phloat_trunc_int8(p, &t, &exact) && (exact || flags.f.base_wrap)) {
+        if (flags.f.base_wrap)
+            t = base_wrap(t, wsize);
+        else if (flags.f.base_signed) {
+            if (wsize < 64 && (t >= (1LL << (wsize - 1))
+                                || t < -(1LL << (wsize - 1))))
+                return false;
+        } else {
+            if (t < 0 || (wsize < 64 && (uint8) t > (1ULL << wsize) - 1))
+                return false;
+        }
+        *res = t;
+        return true;
+    }
+#endif
     if (flags.f.base_wrap) {
         phloat ip = p < 0 ? -floor(-p) : floor(p);
         phloat d = pow(phloat(2), wsize);
         phloat r = fmod(ip, d);
         if (r < 0)
             r += d;
-        int8 n = (int8) to_uint8(r);
-        if (flags.f.base_signed) {
-            int8 m = 1LL << (wsize - 1);
-            if ((n & m) != 0)
-                n |= -1LL << (wsize - 1);
-            else
-                n &= (1LL << (wsize - 1)) - 1;
-        } else {
-            if (wsize < 64)
-                n &= (1ULL << wsize) - 1;
-        }
-        *res = n;
+        *res = base_wrap((int8) to_uint8(r), wsize);
     } else if (flags.f.base_signed) {
         phloat high = pow(phloat(2), wsize - 1);
         phloat low = -high;
@@ -924,137 +1040,47 @@ int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool
 }
 
 int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
+    /* The array is replaced by a new one, with the old contents copied
+     * over; the old array is deleted if this was its only reference.
+     */
     int4 size = rows * columns;
     if (matrix->type == TYPE_REALMATRIX) {
         vartype_realmatrix *oldmatrix = (vartype_realmatrix *) matrix;
         if (oldmatrix->rows == rows && oldmatrix->columns == columns)
             return ERR_NONE;
-        if (oldmatrix->array->refcount == 1) {
-            /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc(). However, I
-             * only use realloc() on the 'data' array, not on the
-             * 'is_string' array -- if I used it on both, and the second
-             * call fails, I might be unable to roll back the first.
-             * So, playing safe -- shouldn't be too big a handicap since
-             * 'is_string' is a lot smaller than 'data', so the transient
-             * memory overhead is only about 12.5%.
-             */
-            char *new_is_string = (char *) malloc(size);
-            if (new_is_string == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            int4 i, s, oldsize;
-            phloat *new_data = (phloat *)
-                                    realloc(oldmatrix->array->data,
-                                            size * sizeof(phloat));
-            if (new_data == NULL) {
-                free(new_is_string);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            s = oldsize < size ? oldsize : size;
-            for (i = 0; i < s; i++)
-                new_is_string[i] = oldmatrix->array->is_string[i];
-            for (i = s; i < size; i++) {
-                new_is_string[i] = 0;
-                new_data[i] = 0;
-            }
-            free(oldmatrix->array->is_string);
-            oldmatrix->array->is_string = new_is_string;
-            oldmatrix->array->data = new_data;
-            oldmatrix->rows = rows;
-            oldmatrix->columns = columns;
-            return ERR_NONE;
-        } else {
-            /* There are shared references to the matrix. This means I
-             * can't realloc() it; I'm going to allocate a brand-new instance,
-             * and copy the contents from the old instance. I don't use
-             * disentangle(); that's only useful if you want to eliminate
-             * shared references without resizing.
-             */
-            realmatrix_data *new_array;
-            int4 i, s, oldsize;
-            new_array = (realmatrix_data *) malloc(sizeof(realmatrix_data));
-            if (new_array == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            new_array->data = (phloat *) malloc(size * sizeof(phloat));
-            if (new_array->data == NULL) {
-                free(new_array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            new_array->is_string = (char *) malloc(size);
-            if (new_array->is_string == NULL) {
-                free(new_array->data);
-                free(new_array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            s = oldsize < size ? oldsize : size;
-            for (i = 0; i < s; i++) {
-                new_array->is_string[i] = oldmatrix->array->is_string[i];
-                new_array->data[i] = oldmatrix->array->data[i];
-            }
-            for (i = s; i < size; i++) {
-                new_array->is_string[i] = 0;
-                new_array->data[i] = 0;
-            }
-            new_array->refcount = 1;
-            oldmatrix->array->refcount--;
-            oldmatrix->array = new_array;
-            oldmatrix->rows = rows;
-            oldmatrix->columns = columns;
-            return ERR_NONE;
-        }
+        realmatrix_data *new_array = new_realmatrix_data(size);
+        if (new_array == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int4 oldsize = oldmatrix->rows * oldmatrix->columns;
+        int4 s = oldsize < size ? oldsize : size;
+        memcpy(new_array->data, matrix_data(oldmatrix->array),
+               s * sizeof(phloat));
+        copy_is_string(new_array, 0, oldmatrix->array, 0, s);
+        clear_phloats(new_array->data + s, size - s);
+        if (--(oldmatrix->array->refcount) == 0)
+            free_realmatrix_data(oldmatrix->array);
+        oldmatrix->array = new_array;
+        oldmatrix->rows = rows;
+        oldmatrix->columns = columns;
+        return ERR_NONE;
     } else /* matrix->type == TYPE_COMPLEXMATRIX */ {
         vartype_complexmatrix *oldmatrix = (vartype_complexmatrix *) matrix;
         if (oldmatrix->rows == rows && oldmatrix->columns == columns)
             return ERR_NONE;
-        if (oldmatrix->array->refcount == 1) {
-            /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc().
-             */
-            int4 i, oldsize;
-            phloat *new_data = (phloat *)
-                    realloc(oldmatrix->array->data, 2 * size * sizeof(phloat));
-            if (new_data == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            for (i = 2 * oldsize; i < 2 * size; i++)
-                new_data[i] = 0;
-            oldmatrix->array->data = new_data;
-            oldmatrix->rows = rows;
-            oldmatrix->columns = columns;
-            return ERR_NONE;
-        } else {
-            /* There are shared references to the matrix. This means I
-             * can't realloc() it; I'm going to allocate a brand-new instance,
-             * and copy the contents from the old instance. I don't use
-             * disentangle(); that's only useful if you want to eliminate
-             * shared references without resizing.
-             */
-            complexmatrix_data *new_array;
-            int4 i, s, oldsize;
-            new_array = (complexmatrix_data *)
-                                        malloc(sizeof(complexmatrix_data));
-            if (new_array == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            new_array->data = (phloat *) malloc(2 * size * sizeof(phloat));
-            if (new_array->data == NULL) {
-                free(new_array);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            s = oldsize < size ? oldsize : size;
-            for (i = 0; i < 2 * s; i++)
-                new_array->data[i] = oldmatrix->array->data[i];
-            for (i = 2 * s; i < 2 * size; i++)
-                new_array->data[i] = 0;
-            new_array->refcount = 1;
-            oldmatrix->array->refcount--;
-            oldmatrix->array = new_array;
-            oldmatrix->rows = rows;
-            oldmatrix->columns = columns;
-            return ERR_NONE;
-        }
+        complexmatrix_data *new_array = new_complexmatrix_data(size);
+        if (new_array == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int4 oldsize = oldmatrix->rows * oldmatrix->columns;
+        int4 s = oldsize < size ? oldsize : size;
+        memcpy(new_array->data, matrix_data(oldmatrix->array),
+               2 * s * sizeof(phloat));
+        clear_phloats(new_array->data + 2 * s, 2 * (size - s));
+        if (--(oldmatrix->array->refcount) == 0)
+            free_complexmatrix_data(oldmatrix->array);
+        oldmatrix->array = new_array;
+        oldmatrix->rows = rows;
+        oldmatrix->columns = columns;
+        return ERR_NONE;
     }
 }
 
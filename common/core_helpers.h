@@ -32,9 +32,12 @@ int resolve_ind_arg(arg_struct *arg);
 int arg_to_num(arg_struct *arg, int4 *num);
 int is_pure_real(const vartype *matrix);
 void recall_result(vartype *v);
+bool overwrite_scalar(vartype *dst, const vartype *src);
+int recall_copy(const vartype *src);
 void recall_two_results(vartype *x, vartype *y);
 void unary_result(vartype *x);
 void binary_result(vartype *x);
+int binary_real_result(int (*op)(phloat x, phloat y, phloat *z));
 phloat rad_to_angle(phloat x);
 phloat rad_to_deg(phloat x);
 phloat deg_to_rad(phloat x);
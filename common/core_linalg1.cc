@@ -303,7 +303,7 @@ typedef struct {
     vartype_realmatrix *right;
     vartype *result;
     int4 i, j, k;
-    phloat sum;
+    dot_acc sum;
     void (*completion)(int error, vartype *result);
 } mul_rr_data_struct;
 
@@ -345,7 +345,7 @@ static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
-    dat->sum = 0;
+    dot_init(&dat->sum);
     dat->completion = completion;
 
     mul_rr_data = dat;
@@ -362,16 +362,16 @@ static int matrix_mul_rr_worker(int interrupted) {
     mul_rr_data_struct *dat = mul_rr_data;
     int count = 0;
     int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_realmatrix *) dat->result)->array->data;
+    phloat *l = matrix_data(dat->left->array);
+    phloat *r = matrix_data(dat->right->array);
+    phloat *p = matrix_data(((vartype_realmatrix *) dat->result)->array);
     int4 i = dat->i;
     int4 j = dat->j;
     int4 k = dat->k;
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
-    phloat sum = dat->sum;
+    dot_acc sum = dat->sum;
 
     if (interrupted) {
         dat->completion(ERR_INTERRUPTED, NULL);
@@ -381,21 +381,22 @@ static int matrix_mul_rr_worker(int interrupted) {
     }
 
     while (count++ < 1000) {
-        sum += l[i * q + k] * r[k * n + j];
+        dot_add(&sum, l[i * q + k], r[k * n + j]);
         if (++k < q)
             continue;
         k = 0;
-        if ((inf = p_isinf(sum)) != 0) {
+        phloat res = dot_result(&sum);
+        if ((inf = p_isinf(res)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        p[i * n + j] = sum;
-        sum = 0;
+        p[i * n + j] = res;
+        dot_init(&sum);
         if (++j < n)
             continue;
         j = 0;
@@ -440,8 +441,8 @@ static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
     phloat *cache = NULL;
     phloat *leftcache, *rightcache;
 
-    phloat *l = left->array->data;
-    phloat *r = right->array->data;
+    phloat *l = matrix_data(left->array);
+    phloat *r = matrix_data(right->array);
     phloat *p;
     int inf;
     int4 m, n, q;
@@ -459,7 +460,7 @@ static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
     *result = new_realmatrix(m, n);
     if (*result == NULL)
         return ERR_INSUFFICIENT_MEMORY;
-    p = ((vartype_realmatrix *) *result)->array->data;
+    p = matrix_data(((vartype_realmatrix *) *result)->array);
 
     if (BLOCK_SIZE > 0) {
         int4 cachesize = 2 * BLOCK_SIZE * BLOCK_SIZE;
@@ -557,7 +558,7 @@ typedef struct {
     vartype_complexmatrix *right;
     vartype *result;
     int4 i, j, k;
-    phloat sum_re, sum_im;
+    dot_acc sum_re, sum_im;
     void (*completion)(int error, vartype *result);
 } mul_rc_data_struct;
 
@@ -599,8 +600,8 @@ static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
+    dot_init(&dat->sum_re);
+    dot_init(&dat->sum_im);
     dat->completion = completion;
 
     mul_rc_data = dat;
@@ -617,17 +618,17 @@ static int matrix_mul_rc_worker(int interrupted) {
     mul_rc_data_struct *dat = mul_rc_data;
     int count = 0;
     int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
+    phloat *l = matrix_data(dat->left->array);
+    phloat *r = matrix_data(dat->right->array);
+    phloat *p = matrix_data(((vartype_complexmatrix *) dat->result)->array);
     int4 i = dat->i;
     int4 j = dat->j;
     int4 k = dat->k;
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    dot_acc sum_re = dat->sum_re;
+    dot_acc sum_im = dat->sum_im;
 
     if (interrupted) {
         dat->completion(ERR_INTERRUPTED, NULL);
@@ -638,33 +639,35 @@ static int matrix_mul_rc_worker(int interrupted) {
 
     while (count++ < 1000) {
         phloat tmp = l[i * q + k];
-        sum_re += tmp * r[2 * (k * n + j)];
-        sum_im += tmp * r[2 * (k * n + j) + 1];
+        dot_add(&sum_re, tmp, r[2 * (k * n + j)]);
+        dot_add(&sum_im, tmp, r[2 * (k * n + j) + 1]);
         if (++k < q)
             continue;
         k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
+        phloat res_re = dot_result(&sum_re);
+        phloat res_im = dot_result(&sum_im);
+        if ((inf = p_isinf(res_re)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        if ((inf = p_isinf(sum_im)) != 0) {
+        if ((inf = p_isinf(res_im)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
+        p[2 * (i * n + j)] = res_re;
+        p[2 * (i * n + j) + 1] = res_im;
+        dot_init(&sum_re);
+        dot_init(&sum_im);
         if (++j < n)
             continue;
         j = 0;
@@ -690,7 +693,7 @@ typedef struct {
     vartype_realmatrix *right;
     vartype *result;
     int4 i, j, k;
-    phloat sum_re, sum_im;
+    dot_acc sum_re, sum_im;
     void (*completion)(int error, vartype *result);
 } mul_cr_data_struct;
 
@@ -732,8 +735,8 @@ static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right,
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
+    dot_init(&dat->sum_re);
+    dot_init(&dat->sum_im);
     dat->completion = completion;
 
     mul_cr_data = dat;
@@ -750,17 +753,17 @@ static int matrix_mul_cr_worker(int interrupted) {
     mul_cr_data_struct *dat = mul_cr_data;
     int count = 0;
     int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
+    phloat *l = matrix_data(dat->left->array);
+    phloat *r = matrix_data(dat->right->array);
+    phloat *p = matrix_data(((vartype_complexmatrix *) dat->result)->array);
     int4 i = dat->i;
     int4 j = dat->j;
     int4 k = dat->k;
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    dot_acc sum_re = dat->sum_re;
+    dot_acc sum_im = dat->sum_im;
 
     if (interrupted) {
         dat->completion(ERR_INTERRUPTED, NULL);
@@ -771,33 +774,35 @@ static int matrix_mul_cr_worker(int interrupted) {
 
     while (count++ < 1000) {
         phloat tmp = r[k * n + j];
-        sum_re += tmp * l[2 * (i * q + k)];
-        sum_im += tmp * l[2 * (i * q + k) + 1];
+        dot_add(&sum_re, tmp, l[2 * (i * q + k)]);
+        dot_add(&sum_im, tmp, l[2 * (i * q + k) + 1]);
         if (++k < q)
             continue;
         k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
+        phloat res_re = dot_result(&sum_re);
+        phloat res_im = dot_result(&sum_im);
+        if ((inf = p_isinf(res_re)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        if ((inf = p_isinf(sum_im)) != 0) {
+        if ((inf = p_isinf(res_im)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
+        p[2 * (i * n + j)] = res_re;
+        p[2 * (i * n + j) + 1] = res_im;
+        dot_init(&sum_re);
+        dot_init(&sum_im);
         if (++j < n)
             continue;
         j = 0;
@@ -823,7 +828,7 @@ typedef struct {
     vartype_complexmatrix *right;
     vartype *result;
     int4 i, j, k;
-    phloat sum_re, sum_im;
+    dot_acc sum_re, sum_im;
     void (*completion)(int error, vartype *result);
 } mul_cc_data_struct;
 
@@ -860,8 +865,8 @@ static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *rig
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
+    dot_init(&dat->sum_re);
+    dot_init(&dat->sum_im);
     dat->completion = completion;
 
     mul_cc_data = dat;
@@ -878,17 +883,17 @@ static int matrix_mul_cc_worker(int interrupted) {
     mul_cc_data_struct *dat = mul_cc_data;
     int count = 0;
     int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
+    phloat *l = matrix_data(dat->left->array);
+    phloat *r = matrix_data(dat->right->array);
+    phloat *p = matrix_data(((vartype_complexmatrix *) dat->result)->array);
     int4 i = dat->i;
     int4 j = dat->j;
     int4 k = dat->k;
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    dot_acc sum_re = dat->sum_re;
+    dot_acc sum_im = dat->sum_im;
 
     if (interrupted) {
         dat->completion(ERR_INTERRUPTED, NULL);
@@ -902,33 +907,34 @@ static int matrix_mul_cc_worker(int interrupted) {
         phloat l_im = l[2 * (i * q + k) + 1];
         phloat r_re = r[2 * (k * n + j)];
         phloat r_im = r[2 * (k * n + j) + 1];
-        sum_re += l_re * r_re - l_im * r_im;
-        sum_im += l_im * r_re + l_re * r_im;
+        dot_add_complex(&sum_re, &sum_im, l_re, l_im, r_re, r_im);
         if (++k < q)
             continue;
         k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
+        phloat res_re = dot_result(&sum_re);
+        phloat res_im = dot_result(&sum_im);
+        if ((inf = p_isinf(res_re)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        if ((inf = p_isinf(sum_im)) != 0) {
+        if ((inf = p_isinf(res_im)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
                 free(dat);
                 return ERR_OUT_OF_RANGE;
             } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+                res_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
         }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
+        p[2 * (i * n + j)] = res_re;
+        p[2 * (i * n + j) + 1] = res_im;
+        dot_init(&sum_re);
+        dot_init(&sum_im);
         if (++j < n)
             continue;
         j = 0;
@@ -1058,7 +1064,7 @@ static int inv_r_completion1(int error, vartype_realmatrix *a, int4 *perm,
         int4 i, n = a->rows;
         vartype_realmatrix *inv = (vartype_realmatrix *) linalg_inv_result;
         for (i = 0; i < n; i++)
-            inv->array->data[i * (n + 1)] = 1;
+            matrix_data(inv->array)[i * (n + 1)] = 1;
         return lu_backsubst_rr(a, perm, inv, inv_r_completion2);
     }
 }
@@ -1085,7 +1091,7 @@ static int inv_c_completion1(int error, vartype_complexmatrix *a, int4 *perm,
         vartype_complexmatrix *inv =
                             (vartype_complexmatrix *) linalg_inv_result;
         for (i = 0; i < n; i++)
-            inv->array->data[2 * (i * (n + 1))] = 1;
+            matrix_data(inv->array)[2 * (i * (n + 1))] = 1;
         return lu_backsubst_cc(a, perm, inv, inv_c_completion2);
     }
 }
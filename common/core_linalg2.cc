@@ -20,6 +20,7 @@
 #include "core_linalg2.h"
 #include "core_globals.h"
 #include "core_main.h"
+#include "core_variables.h"
 
 
 #define STATE(s)             \
@@ -40,7 +41,8 @@ typedef struct {
     int4 *perm;
     phloat det;
     int4 i, imax, j, k;
-    phloat max, tmp, sum, *scale;
+    phloat max, tmp, *scale;
+    dot_acc sum;
     int state;
     int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
 } lu_r_data_struct;
@@ -79,7 +81,7 @@ static int lu_decomp_r_worker(int interrupted) {
     
     lu_r_data_struct *dat = lu_r_data;
 
-    phloat *a = dat->a->array->data;
+    phloat *a = matrix_data(dat->a->array);
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
@@ -92,7 +94,8 @@ static int lu_decomp_r_worker(int interrupted) {
     int4 k = dat->k;
     phloat max = dat->max;
     phloat tmp = dat->tmp;
-    phloat sum = dat->sum;
+    dot_acc sum = dat->sum;
+    phloat t;
 
     if (interrupted) {
         free(scale);
@@ -127,28 +130,29 @@ static int lu_decomp_r_worker(int interrupted) {
 
     for (j = 0; j < n; j++) {
         for (i = 0; i < j; i++) {
-            sum = a[i * n + j];
+            dot_init(&sum, a[i * n + j]);
             for (k = 0; k < i; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
+                dot_sub(&sum, a[i * n + k], a[k * n + j]);
                 STATE(2);
             }
-            a[i * n + j] = sum;
+            a[i * n + j] = dot_result(&sum);
         }
 
         max = 0;
         imax = j;
         for (i = j; i < n; i++) {
-            sum = a[i * n + j];
+            dot_init(&sum, a[i * n + j]);
             for (k = 0; k < j; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
+                dot_sub(&sum, a[i * n + k], a[k * n + j]);
                 STATE(3);
             }
-            a[i * n  + j] = sum;
+            t = dot_result(&sum);
+            a[i * n  + j] = t;
             if (scale[i] == 0) {
                 imax = i;
                 break;
             }
-            tmp = (sum < 0 ? -sum : sum) / scale[i];
+            tmp = (t < 0 ? -t : t) / scale[i];
             if (tmp > max) {
                 imax = i;
                 max = tmp;
@@ -223,7 +227,8 @@ typedef struct {
     int4 *perm;
     phloat det_re, det_im;
     int4 i, imax, j, k;
-    phloat max, tmp, tmp_re, tmp_im, sum_re, sum_im, *scale;
+    phloat max, tmp, tmp_re, tmp_im, *scale;
+    dot_acc sum_re, sum_im;
     int state;
     int (*completion)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
 } lu_c_data_struct;
@@ -263,7 +268,7 @@ static int lu_decomp_c_worker(int interrupted) {
     
     lu_c_data_struct *dat = lu_c_data;
 
-    phloat *a = dat->a->array->data;
+    phloat *a = matrix_data(dat->a->array);
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
@@ -278,10 +283,11 @@ static int lu_decomp_c_worker(int interrupted) {
     phloat tmp = dat->tmp;
     phloat tmp_re = dat->tmp_re;
     phloat tmp_im = dat->tmp_im;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    dot_acc sum_re = dat->sum_re;
+    dot_acc sum_im = dat->sum_im;
 
     phloat xre, xim, yre, yim;
+    phloat t_re, t_im;
     phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
     phloat tiny;
     phloat s_re, s_im;
@@ -318,41 +324,41 @@ static int lu_decomp_c_worker(int interrupted) {
 
     for (j = 0; j < n; j++) {
         for (i = 0; i < j; i++) {
-            sum_re = a[2 * (i * n + j)];
-            sum_im = a[2 * (i * n + j) + 1];
+            dot_init(&sum_re, a[2 * (i * n + j)]);
+            dot_init(&sum_im, a[2 * (i * n + j) + 1]);
             for (k = 0; k < i; k++) {
                 xre = a[2 * (i * n + k)];
                 xim = a[2 * (i * n + k) + 1];
                 yre = a[2 * (k * n + j)];
                 yim = a[2 * (k * n + j) + 1];
-                sum_re -= xre * yre - xim * yim;
-                sum_im -= xim * yre + xre * yim;
+                dot_sub_complex(&sum_re, &sum_im, xre, xim, yre, yim);
                 STATE(2);
             }
-            a[2 * (i * n + j)] = sum_re;
-            a[2 * (i * n + j) + 1] = sum_im;
+            a[2 * (i * n + j)] = dot_result(&sum_re);
+            a[2 * (i * n + j) + 1] = dot_result(&sum_im);
         }
 
         max = 0;
         for (i = j; i < n; i++) {
-            sum_re = a[2 * (i * n + j)];
-            sum_im = a[2 * (i * n + j) + 1];
+            dot_init(&sum_re, a[2 * (i * n + j)]);
+            dot_init(&sum_im, a[2 * (i * n + j) + 1]);
             for (k = 0; k < j; k++) {
                 xre = a[2 * (i * n + k)];
                 xim = a[2 * (i * n + k) + 1];
                 yre = a[2 * (k * n + j)];
                 yim = a[2 * (k * n + j) + 1];
-                sum_re -= xre * yre - xim * yim;
-                sum_im -= xim * yre + xre * yim;
+                dot_sub_complex(&sum_re, &sum_im, xre, xim, yre, yim);
                 STATE(3);
             }
-            a[2 * (i * n + j)] = sum_re;
-            a[2 * (i * n + j) + 1] = sum_im;
+            t_re = dot_result(&sum_re);
+            t_im = dot_result(&sum_im);
+            a[2 * (i * n + j)] = t_re;
+            a[2 * (i * n + j) + 1] = t_im;
             if (scale[i] == 0) {
                 imax = i;
                 break;
             }
-            tmp = hypot(sum_re, sum_im) / scale[i];
+            tmp = hypot(t_re, t_im) / scale[i];
             if (tmp > max) {
                 imax = i;
                 max = tmp;
@@ -446,7 +452,7 @@ typedef struct {
     int4 *perm;
     vartype_realmatrix *b;
     int4 i, ii, j, ll, k;
-    phloat sum;
+    dot_acc sum;
     int state;
     void (*completion)(int, vartype_realmatrix *, int4 *, vartype_realmatrix *);
 } backsub_rr_data_struct;
@@ -481,9 +487,9 @@ int lu_backsubst_rr(vartype_realmatrix *a, int4 *perm, vartype_realmatrix *b,
 
 static int lu_backsubst_rr_worker(int interrupted) {
     backsub_rr_data_struct *dat = backsub_rr_data;
-    phloat *a = dat->a->array->data;
+    phloat *a = matrix_data(dat->a->array);
     int4 n = dat->a->rows;
-    phloat *b = dat->b->array->data;
+    phloat *b = matrix_data(dat->b->array);
     int4 q = dat->b->columns;
     int4 *perm = dat->perm;
     int count = 1000;
@@ -493,7 +499,7 @@ static int lu_backsubst_rr_worker(int interrupted) {
     int4 j = dat->j;
     int4 ll = dat->ll;
     int4 k = dat->k;
-    phloat sum = dat->sum;
+    dot_acc sum = dat->sum;
 
     phloat t;
 
@@ -513,24 +519,25 @@ static int lu_backsubst_rr_worker(int interrupted) {
         ii = -1;
         for (i = 0; i < n; i++) {
             ll = perm[i];
-            sum = b[ll * q + k];
+            t = b[ll * q + k];
+            dot_init(&sum, t);
             b[ll * q + k] = b[i * q + k];
             if (ii != -1) {
                 for (j = ii; j < i; j++) {
-                    sum -= a[i * n + j] * b[j * q + k];
+                    dot_sub(&sum, a[i * n + j], b[j * q + k]);
                     STATE(1);
                 }
-            } else if (sum != 0)
+            } else if (t != 0)
                 ii = i;
-            b[i * q + k] = sum;
+            b[i * q + k] = dot_result(&sum);
         }
         for (i = n - 1; i >= 0; i--) {
-            sum = b[i * q + k];
+            dot_init(&sum, b[i * q + k]);
             for (j = i + 1; j < n; j++) {
-                sum -= a[i * n + j] * b[j * q + k];
+                dot_sub(&sum, a[i * n + j], b[j * q + k]);
                 STATE(2);
             }
-            t = sum / a[i * n + i];
+            t = dot_result(&sum) / a[i * n + i];
             if (p_isinf(t) || p_isnan(t)) {
                 if (core_settings.matrix_outofrange
                                         && !flags.f.range_error_ignore)
@@ -561,7 +568,7 @@ typedef struct {
     int4 *perm;
     vartype_complexmatrix *b;
     int4 i, ii, j, ll, k;
-    phloat sum_re, sum_im;
+    dot_acc sum_re, sum_im;
     int state;
     void (*completion)(int, vartype_realmatrix *, int4 *,
                                             vartype_complexmatrix *);
@@ -597,9 +604,9 @@ int lu_backsubst_rc(vartype_realmatrix *a, int4 *perm, vartype_complexmatrix *b,
 
 static int lu_backsubst_rc_worker(int interrupted) {
     backsub_rc_data_struct *dat = backsub_rc_data;
-    phloat *a = dat->a->array->data;
+    phloat *a = matrix_data(dat->a->array);
     int4 n = dat->a->rows;
-    phloat *b = dat->b->array->data;
+    phloat *b = matrix_data(dat->b->array);
     int4 q = dat->b->columns;
     int4 *perm = dat->perm;
     int count = 1000;
@@ -609,8 +616,8 @@ static int lu_backsubst_rc_worker(int interrupted) {
     int4 j = dat->j;
     int4 ll = dat->ll;
     int4 k = dat->k;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    dot_acc sum_re = dat->sum_re;
+    dot_acc sum_im = dat->sum_im;
     phloat tmp;
 
     phloat t_re, t_im;
@@ -631,34 +638,36 @@ static int lu_backsubst_rc_worker(int interrupted) {
         ii = -1;
         for (i = 0; i < n; i++) {
             ll = perm[i];
-            sum_re = b[2 * (ll * q + k)];
-            sum_im = b[2 * (ll * q + k) + 1];
+            t_re = b[2 * (ll * q + k)];
+            t_im = b[2 * (ll * q + k) + 1];
+            dot_init(&sum_re, t_re);
+            dot_init(&sum_im, t_im);
             b[2 * (ll * q + k)] = b[2 * (i * q + k)];
             b[2 * (ll * q + k) + 1] = b[2 * (i * q + k) + 1];
             if (ii != -1) {
                 for (j = ii; j < i; j++) {
                     tmp = a[i * n + j];
-                    sum_re -= tmp * b[2 * (j * q + k)];
-                    sum_im -= tmp * b[2 * (j * q + k) + 1];
+                    dot_sub(&sum_re, tmp, b[2 * (j * q + k)]);
+                    dot_sub(&sum_im, tmp, b[2 * (j * q + k) + 1]);
                     STATE(1);
                 }
-            } else if (sum_re != 0 || sum_im != 0)
+            } else if (t_re != 0 || t_im != 0)
                 ii = i;
-            b[2 * (i * q + k)] = sum_re;
-            b[2 * (i * q + k) + 1] = sum_im;
+            b[2 * (i * q + k)] = dot_result(&sum_re);
+            b[2 * (i * q + k) + 1] = dot_result(&sum_im);
         }
         for (i = n - 1; i >= 0; i--) {
-            sum_re = b[2 * (i * q + k)];
-            sum_im = b[2 * (i * q + k) + 1];
+            dot_init(&sum_re, b[2 * (i * q + k)]);
+            dot_init(&sum_im, b[2 * (i * q + k) + 1]);
             for (j = i + 1; j < n; j++) {
                 tmp = a[i * n + j];
-                sum_re -= tmp * b[2 * (j * q + k)];
-                sum_im -= tmp * b[2 * (j * q + k) + 1];
+                dot_sub(&sum_re, tmp, b[2 * (j * q + k)]);
+                dot_sub(&sum_im, tmp, b[2 * (j * q + k) + 1]);
                 STATE(2);
             }
             tmp = a[i * n + i];
-            t_re = sum_re / tmp;
-            t_im = sum_im / tmp;
+            t_re = dot_result(&sum_re) / tmp;
+            t_im = dot_result(&sum_im) / tmp;
             if (p_isinf(t_re) || p_isnan(t_re)) {
                 if (core_settings.matrix_outofrange
                                         && !flags.f.range_error_ignore)
@@ -698,7 +707,7 @@ typedef struct {
     int4 *perm;
     vartype_complexmatrix *b;
     int4 i, ii, j, ll, k;
-    phloat sum_re, sum_im;
+    dot_acc sum_re, sum_im;
     int state;
     void (*completion)(int, vartype_complexmatrix *, int4 *,
                                             vartype_complexmatrix *);
@@ -734,9 +743,9 @@ int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix
 
 static int lu_backsubst_cc_worker(int interrupted) {
     backsub_cc_data_struct *dat = backsub_cc_data;
-    phloat *a = dat->a->array->data;
+    phloat *a = matrix_data(dat->a->array);
     int4 n = dat->a->rows;
-    phloat *b = dat->b->array->data;
+    phloat *b = matrix_data(dat->b->array);
     int4 q = dat->b->columns;
     int4 *perm = dat->perm;
     int count = 1000;
@@ -746,12 +755,12 @@ static int lu_backsubst_cc_worker(int interrupted) {
     int4 j = dat->j;
     int4 ll = dat->ll;
     int4 k = dat->k;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
+    dot_acc sum_re = dat->sum_re;
+    dot_acc sum_im = dat->sum_im;
     phloat tmp, tmp_re, tmp_im;
 
     phloat bre, bim;
-    phloat t_re, t_im;
+    phloat s_re, s_im, t_re, t_im;
 
     if (interrupted) {
         dat->completion(ERR_INTERRUPTED, dat->a, perm, dat->b);
@@ -769,8 +778,10 @@ static int lu_backsubst_cc_worker(int interrupted) {
         ii = -1;
         for (i = 0; i < n; i++) {
             ll = perm[i];
-            sum_re = b[2 * (ll * q + k)];
-            sum_im = b[2 * (ll * q + k) + 1];
+            t_re = b[2 * (ll * q + k)];
+            t_im = b[2 * (ll * q + k) + 1];
+            dot_init(&sum_re, t_re);
+            dot_init(&sum_im, t_im);
             b[2 * (ll * q + k)] = b[2 * (i * q + k)];
             b[2 * (ll * q + k) + 1] = b[2 * (i * q + k) + 1];
             if (ii != -1) {
@@ -779,34 +790,34 @@ static int lu_backsubst_cc_worker(int interrupted) {
                     bim = b[2 * (j * q + k) + 1];
                     tmp_re = a[2 * (i * n + j)];
                     tmp_im = a[2 * (i * n + j) + 1];
-                    sum_re -= bre * tmp_re - bim * tmp_im;
-                    sum_im -= bim * tmp_re + bre * tmp_im;
+                    dot_sub_complex(&sum_re, &sum_im, bre, bim, tmp_re, tmp_im);
                     STATE(1);
                 }
-            } else if (sum_re != 0 || sum_im != 0)
+            } else if (t_re != 0 || t_im != 0)
                 ii = i;
-            b[2 * (i * q + k)] = sum_re;
-            b[2 * (i * q + k) + 1] = sum_im;
+            b[2 * (i * q + k)] = dot_result(&sum_re);
+            b[2 * (i * q + k) + 1] = dot_result(&sum_im);
         }
         for (i = n - 1; i >= 0; i--) {
-            sum_re = b[2 * (i * q + k)];
-            sum_im = b[2 * (i * q + k) + 1];
+            dot_init(&sum_re, b[2 * (i * q + k)]);
+            dot_init(&sum_im, b[2 * (i * q + k) + 1]);
             for (j = i + 1; j < n; j++) {
                 bre = b[2 * (j * q + k)];
                 bim = b[2 * (j * q + k) + 1];
                 tmp_re = a[2 * (i * n + j)];
                 tmp_im = a[2 * (i * n + j) + 1];
-                sum_re -= bre * tmp_re - bim * tmp_im;
-                sum_im -= bim * tmp_re + bre * tmp_im;
+                dot_sub_complex(&sum_re, &sum_im, bre, bim, tmp_re, tmp_im);
                 STATE(2);
             }
+            s_re = dot_result(&sum_re);
+            s_im = dot_result(&sum_im);
             tmp_re = a[2 * (i * n + i)];
             tmp_im = a[2 * (i * n + i) + 1];
             tmp = hypot(tmp_re, tmp_im);
             tmp_re = tmp_re / tmp / tmp;
             tmp_im = -tmp_im / tmp / tmp;
-            t_re = sum_re * tmp_re - sum_im * tmp_im;
-            t_im = sum_im * tmp_re + sum_re * tmp_im;
+            t_re = s_re * tmp_re - s_im * tmp_im;
+            t_im = s_im * tmp_re + s_re * tmp_im;
             if (p_isinf(t_re) || p_isnan(t_re)) {
                 if (core_settings.matrix_outofrange
                                         && !flags.f.range_error_ignore)
@@ -70,6 +70,10 @@ void core_init(int read_saved_state, int4 version, const char *state_file_name,
      */
 
     phloat_init();
+    /* Enough for the stack, a few dozen variables, and the solver, so
+     * most sessions never have to grow the pools.
+     */
+    warm_vartype_pools(256, 32, 32);
 
     #if defined(ANDROID) || defined(IPHONE)
         core_settings.enable_ext_accel = true;
@@ -87,6 +91,8 @@ void core_init(int read_saved_state, int4 version, const char *state_file_name,
     #endif
     core_settings.enable_ext_time = true;
     core_settings.enable_ext_prog = true;
+    core_settings.cpu_slice_ms = 10;
+    core_settings.cpu_slice_lines = 0;
 
     char *state_file_name_crash = NULL;
     if (read_saved_state == 1) {
@@ -180,6 +186,67 @@ void core_cleanup() {
         vars_capacity = 0;
     }
     clean_vartype_pools();
+#ifdef VARTYPE_DEBUG
+    vartype_debug_report();
+#endif
+}
+
+struct core_stash {
+    /* The saved state, in the format written by core_save_state() */
+    FILE *file;
+};
+
+core_stash *core_stash_state() {
+    core_stash *stash = (core_stash *) malloc(sizeof(core_stash));
+    if (stash == NULL)
+        return NULL;
+    stash->file = tmpfile();
+    if (stash->file == NULL) {
+        free(stash);
+        return NULL;
+    }
+    if (mode_interruptible != NULL)
+        stop_interruptible();
+    set_running(false);
+    gfile = stash->file;
+    save_state();
+    gfile = NULL;
+    if (fflush(stash->file) != 0 || ferror(stash->file)) {
+        core_free_stash(stash);
+        return NULL;
+    }
+    return stash;
+}
+
+bool core_restore_stash(core_stash *stash) {
+    core_cleanup();
+    gfile = stash->file;
+    rewind(gfile);
+    /* 26 is the first version with the magic number and version embedded
+     * in the core's part of the state, which is all save_state() writes;
+     * load_state() takes the actual version from there.
+     */
+    bool clear, too_new = false;
+    bool ok = load_state(26, &clear, &too_new);
+    if (!ok)
+        hard_reset(1);
+    gfile = NULL;
+
+    repaint_display();
+    shell_annunciators(mode_updown,
+                       mode_shift,
+                       0 /*print*/,
+                       mode_running,
+                       flags.f.grad,
+                       flags.f.rad || flags.f.grad);
+    return ok;
+}
+
+void core_free_stash(core_stash *stash) {
+    if (stash == NULL)
+        return;
+    fclose(stash->file);
+    free(stash);
 }
 
 void core_repaint_display() {
@@ -217,6 +284,28 @@ int core_keydown_command(const char *name, int *enqueued, int *repeat) {
     return core_keydown(cmd == CMD_NONE ? 0 : cmd + 2048, enqueued, repeat);
 }
 
+bool core_run_label(const char *name) {
+    arg_struct arg;
+    int prgm;
+    int4 lblpc;
+    arg.type = ARGTYPE_STR;
+    arg.length = ascii2hp(arg.val.text, name, 7);
+    if (!find_global_label(&arg, &prgm, &lblpc))
+        return false;
+    if (mode_interruptible != NULL)
+        stop_interruptible();
+    if (flags.f.prgm_mode) {
+        flags.f.prgm_mode = 0;
+        redisplay();
+    }
+    clear_all_rtns();
+    current_prgm = prgm;
+    pc = lblpc;
+    profile_call();
+    set_running(true);
+    return true;
+}
+
 int core_keydown(int key, int *enqueued, int *repeat) {
 
     *enqueued = 0;
@@ -579,7 +668,9 @@ int core_keyup() {
             print_program_line(current_prgm, oldpc);
         mode_disable_stack_lift = false;
         set_running(true);
+        VARTYPE_ORIGIN(cmd, current_prgm, oldpc);
         error = cmdlist(cmd)->handler(&arg);
+        VARTYPE_ORIGIN(CMD_NONE, -1, -1);
         set_running(false);
         mode_pause = false;
     } else {
@@ -587,7 +678,9 @@ int core_keyup() {
                 && flags.f.printer_exists)
             print_command(pending_command, &pending_command_arg);
         mode_disable_stack_lift = false;
+        VARTYPE_ORIGIN(pending_command, -1, -1);
         error = cmdlist(pending_command)->handler(&pending_command_arg);
+        VARTYPE_ORIGIN(CMD_NONE, -1, -1);
         mode_pause = false;
     }
 
@@ -2148,7 +2241,8 @@ void core_import_programs(int num_progs, const char *raw_file_name) {
         }
         store:
         if (pending_end) {
-            goto_dot_dot(true);
+            if (!goto_dot_dot(true))
+                goto done;
             pending_end = false;
         }
         if (cmd == CMD_END) {
@@ -2161,7 +2255,7 @@ void core_import_programs(int num_progs, const char *raw_file_name) {
     }
 
     done:
-    rebuild_label_table();
+    shrink_programs();
     update_catalog();
 
     flags.f.trace_print = saved_trace;
@@ -2208,6 +2302,8 @@ static int complex2buf(char *buf, phloat re, phloat im, bool always_rect) {
     return bufptr;
 }
 
+static char *vartype2text(const vartype *v);
+
 char *core_copy() {
     if (mode_interruptible != NULL)
         stop_interruptible();
@@ -2229,31 +2325,52 @@ char *core_copy() {
         } else
             return tb.buf;
     } else if (alpha_active()) {
-        char *buf = (char *) malloc(5 * reg_alpha_length + 1);
-        int bufptr = hp2ascii(buf, reg_alpha, reg_alpha_length);
-        buf[bufptr] = 0;
-        return buf;
-    } else if (reg_x->type == TYPE_REAL) {
+        return core_copy_reg('A');
+    } else
+        return vartype2text(reg_x);
+}
+
+char *core_copy_reg(char reg) {
+    switch (reg) {
+        case 'X': return vartype2text(reg_x);
+        case 'Y': return vartype2text(reg_y);
+        case 'Z': return vartype2text(reg_z);
+        case 'T': return vartype2text(reg_t);
+        case 'L': return vartype2text(reg_lastx);
+        case 'A': {
+            char *buf = (char *) malloc(5 * reg_alpha_length + 1);
+            if (buf == NULL)
+                return NULL;
+            int bufptr = hp2ascii(buf, reg_alpha, reg_alpha_length);
+            buf[bufptr] = 0;
+            return buf;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static char *vartype2text(const vartype *v) {
+    if (v->type == TYPE_REAL) {
         char *buf = (char *) malloc(50);
-        int bufptr = real2buf(buf, ((vartype_real *) reg_x)->x);
+        int bufptr = real2buf(buf, ((vartype_real *) v)->x);
         buf[bufptr] = 0;
         return buf;
-    } else if (reg_x->type == TYPE_COMPLEX) {
+    } else if (v->type == TYPE_COMPLEX) {
         char *buf = (char *) malloc(100);
-        vartype_complex *c = (vartype_complex *) reg_x;
+        vartype_complex *c = (vartype_complex *) v;
         int bufptr = complex2buf(buf, c->re, c->im, false);
         buf[bufptr] = 0;
         return buf;
-    } else if (reg_x->type == TYPE_STRING) {
-        vartype_string *s = (vartype_string *) reg_x;
+    } else if (v->type == TYPE_STRING) {
+        vartype_string *s = (vartype_string *) v;
         char *buf = (char *) malloc(5 * s->length + 1);
         int bufptr = hp2ascii(buf, s->text, s->length);
         buf[bufptr] = 0;
         return buf;
-    } else if (reg_x->type == TYPE_REALMATRIX) {
-        vartype_realmatrix *rm = (vartype_realmatrix *) reg_x;
-        phloat *data = rm->array->data;
-        char *is_string = rm->array->is_string;
+    } else if (v->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) v;
+        phloat *data = matrix_data(rm->array);
         textbuf tb;
         tb.buf = NULL;
         tb.size = 0;
@@ -2264,7 +2381,7 @@ char *core_copy() {
         for (int r = 0; r < rm->rows; r++) {
             for (int c = 0; c < rm->columns; c++) {
                 int bufptr;
-                if (is_string[n])
+                if (IS_STRING(rm->array, n))
                     bufptr = hp2ascii(buf, phloat_text(data[n]), phloat_length(data[n]));
                 else
                     bufptr = real2buf(buf, data[n]);
@@ -2284,9 +2401,9 @@ char *core_copy() {
             return NULL;
         } else
             return tb.buf;
-    } else if (reg_x->type == TYPE_COMPLEXMATRIX) {
-        vartype_complexmatrix *cm = (vartype_complexmatrix *) reg_x;
-        phloat *data = cm->array->data;
+    } else if (v->type == TYPE_COMPLEXMATRIX) {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+        phloat *data = matrix_data(cm->array);
         textbuf tb;
         tb.buf = NULL;
         tb.size = 0;
@@ -3417,8 +3534,8 @@ static void paste_programs(const char *buf) {
         }
 
         store:
-        if (after_end)
-            goto_dot_dot(false);
+        if (after_end && !goto_dot_dot(false))
+            break;
         after_end = cmd == CMD_END;
         if (!after_end)
             store_command_after(&pc, cmd, &arg);
@@ -3426,6 +3543,7 @@ static void paste_programs(const char *buf) {
         line_done:
         pos = end + 1;
     }
+    shrink_programs();
 }
 
 void core_paste(const char *buf) {
@@ -3675,7 +3793,7 @@ void core_paste(const char *buf) {
             free(hpbuf);
             if (is_string != NULL) {
                 vartype_realmatrix *rm = (vartype_realmatrix *)
-                                malloc(sizeof(vartype_realmatrix));
+                                new_realmatrix(rows, cols);
                 if (rm == NULL) {
                     free(data);
                     free(is_string);
@@ -3683,46 +3801,22 @@ void core_paste(const char *buf) {
                     redisplay();
                     return;
                 }
-                rm->array = (realmatrix_data *)
-                                malloc(sizeof(realmatrix_data));
-                if (rm->array == NULL) {
-                    free(rm);
-                    free(data);
-                    free(is_string);
-                    display_error(ERR_INSUFFICIENT_MEMORY, 0);
-                    redisplay();
-                    return;
-                }
-                rm->type = TYPE_REALMATRIX;
-                rm->rows = rows;
-                rm->columns = cols;
-                rm->array->data = data;
-                rm->array->is_string = is_string;
-                rm->array->refcount = 1;
+                memcpy(matrix_data(rm->array), data, n * sizeof(phloat));
+                pack_is_string(rm->array, is_string, n);
+                free(data);
+                free(is_string);
                 v = (vartype *) rm;
             } else {
                 vartype_complexmatrix *cm = (vartype_complexmatrix *)
-                                malloc(sizeof(vartype_complexmatrix));
+                                new_complexmatrix(rows, cols);
                 if (cm == NULL) {
                     free(data);
                     display_error(ERR_INSUFFICIENT_MEMORY, 0);
                     redisplay();
                     return;
                 }
-                cm->array = (complexmatrix_data *)
-                                malloc(sizeof(complexmatrix_data));
-                if (cm->array == NULL) {
-                    free(cm);
-                    free(data);
-                    display_error(ERR_INSUFFICIENT_MEMORY, 0);
-                    redisplay();
-                    return;
-                }
-                cm->type = TYPE_COMPLEXMATRIX;
-                cm->rows = rows;
-                cm->columns = cols;
-                cm->array->data = data;
-                cm->array->refcount = 1;
+                memcpy(matrix_data(cm->array), data, 2 * n * sizeof(phloat));
+                free(data);
                 v = (vartype *) cm;
             }
         }
@@ -3739,9 +3833,433 @@ void set_alpha_entry(bool state) {
     mode_alpha_entry = state;
 }
 
+/* Program profiler; see core_profiler_start(). Line, label, and call path
+ * statistics are kept in three hash tables, with the same layout. For lines,
+ * the key is the program and the line's pc; for labels, it is the program and
+ * the label's pc, or -1 for code not preceded by any global label; for call
+ * paths, it is the same as for labels, plus the index of the caller's entry.
+ */
+typedef struct {
+    int4 parent;
+    int prgm;
+    int4 pc;
+    unsigned char length;
+    char name[7];
+    uint8 count;
+    uint4 ms;
+    uint4 calls;
+    /* For lines: the label entry, or -2 if not looked up yet */
+    int4 label;
+} prof_entry;
+
+typedef struct {
+    prof_entry *entries;
+    int4 count;
+    int4 capacity;
+    int4 *hash;
+    int4 hash_size;
+} prof_table;
+
+static bool profiling = false;
+static prof_table prof_lines;
+static prof_table prof_labels;
+static prof_table prof_paths;
+/* The call path entry for each level of the return stack */
+static int4 *prof_stack = NULL;
+static int4 prof_stack_capacity = 0;
+static int4 prof_depth = 0;
+static int4 prof_prev_line, prof_prev_label, prof_prev_path;
+static uint4 prof_last_ms;
+/* Set by profile_call() when a GTO or XEQ jumps to a global label */
+static bool prof_called = false;
+
+static void prof_table_clear(prof_table *t) {
+    free(t->entries);
+    free(t->hash);
+    t->entries = NULL;
+    t->count = 0;
+    t->capacity = 0;
+    t->hash = NULL;
+    t->hash_size = 0;
+}
+
+static int4 prof_hash_slot(const prof_table *t, int4 parent, int prgm, int4 pc) {
+    int4 mask = t->hash_size - 1;
+    int4 slot = ((uint4) pc * 31 + (uint4) prgm * 17 + parent) & mask;
+    while (true) {
+        int4 idx = t->hash[slot];
+        if (idx == -1)
+            return slot;
+        const prof_entry *e = t->entries + idx;
+        if (e->parent == parent && e->prgm == prgm && e->pc == pc)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+}
+
+static int4 prof_lookup(prof_table *t, int4 parent, int prgm, int4 pc) {
+    /* Returns the entry for the given key, creating it if it doesn't exist
+     * yet, or -1 if that fails.
+     */
+    int4 idx;
+    if (t->hash != NULL) {
+        idx = t->hash[prof_hash_slot(t, parent, prgm, pc)];
+        if (idx != -1)
+            return idx;
+    }
+    if (t->count == t->capacity) {
+        int4 newcap = t->capacity == 0 ? 64 : t->capacity * 2;
+        prof_entry *newentries = (prof_entry *)
+                    realloc(t->entries, newcap * sizeof(prof_entry));
+        if (newentries == NULL)
+            return -1;
+        t->entries = newentries;
+        t->capacity = newcap;
+    }
+    if (t->count * 2 >= t->hash_size) {
+        int4 newsize = t->hash_size == 0 ? 128 : t->hash_size * 2;
+        int4 *newhash = (int4 *) realloc(t->hash, newsize * sizeof(int4));
+        if (newhash == NULL)
+            return -1;
+        t->hash = newhash;
+        t->hash_size = newsize;
+        for (idx = 0; idx < newsize; idx++)
+            t->hash[idx] = -1;
+        for (idx = 0; idx < t->count; idx++) {
+            const prof_entry *e = t->entries + idx;
+            t->hash[prof_hash_slot(t, e->parent, e->prgm, e->pc)] = idx;
+        }
+    }
+    idx = t->count++;
+    prof_entry *e = t->entries + idx;
+    e->parent = parent;
+    e->prgm = prgm;
+    e->pc = pc;
+    e->length = 0;
+    e->count = 0;
+    e->ms = 0;
+    e->calls = 0;
+    e->label = -2;
+    t->hash[prof_hash_slot(t, parent, prgm, pc)] = idx;
+    return idx;
+}
+
+static void profile_line(int prgm, int4 lpc) {
+    /* Called by the run loop before executing each line, while the
+     * profiler is on.
+     */
+    uint4 now = shell_milliseconds();
+    if (now != prof_last_ms) {
+        /* The line that was executing when the clock ticked gets the
+         * time since the previous tick.
+         */
+        uint4 dt = now - prof_last_ms;
+        if (prof_prev_line != -1)
+            prof_lines.entries[prof_prev_line].ms += dt;
+        if (prof_prev_label != -1)
+            prof_labels.entries[prof_prev_label].ms += dt;
+        if (prof_prev_path != -1)
+            prof_paths.entries[prof_prev_path].ms += dt;
+        prof_last_ms = now;
+    }
+
+    int4 line = prof_lookup(&prof_lines, -1, prgm, lpc);
+    int4 label;
+    if (line != -1 && prof_lines.entries[line].label != -2)
+        label = prof_lines.entries[line].label;
+    else {
+        int li = find_containing_label(prgm, lpc);
+        label = prof_lookup(&prof_labels, -1, prgm,
+                            li == -1 ? -1 : labels[li].pc);
+        if (label != -1 && li != -1) {
+            prof_entry *e = prof_labels.entries + label;
+            e->length = labels[li].length;
+            memcpy(e->name, labels[li].name, e->length);
+        }
+        if (line != -1)
+            prof_lines.entries[line].label = label;
+    }
+
+    /* Bring the call path stack in line with the return stack. Calls are
+     * counted only where GTO or XEQ jumped to a global label, as reported
+     * by profile_call(); an XEQ to a local label adds a return level, but
+     * stays within the caller's call path. A GTO to a global label replaces
+     * the innermost call path, since it won't return to its caller.
+     */
+    int level = get_rtn_level();
+    if (prof_depth > level + 1)
+        prof_depth = level + 1;
+    if (prof_called && prof_depth == level + 1 && label != -1) {
+        const prof_entry *le = prof_labels.entries + label;
+        int4 path = prof_lookup(&prof_paths,
+                    prof_depth == 1 ? -1 : prof_stack[prof_depth - 2],
+                    prgm, le->pc);
+        if (path != -1) {
+            prof_entry *e = prof_paths.entries + path;
+            e->length = le->length;
+            memcpy(e->name, le->name, e->length);
+            e->calls++;
+        }
+        prof_labels.entries[label].calls++;
+        prof_stack[prof_depth - 1] = path;
+    }
+    while (prof_depth <= level) {
+        int4 path;
+        if (prof_depth == prof_stack_capacity) {
+            int4 newcap = prof_stack_capacity == 0 ? 16
+                                    : prof_stack_capacity * 2;
+            int4 *newstack = (int4 *)
+                        realloc(prof_stack, newcap * sizeof(int4));
+            if (newstack == NULL)
+                break;
+            prof_stack = newstack;
+            prof_stack_capacity = newcap;
+        }
+        if (label == -1)
+            break;
+        if (prof_depth > 0 && (prof_depth < level || !prof_called)) {
+            prof_stack[prof_depth] = prof_stack[prof_depth - 1];
+            prof_depth++;
+            continue;
+        }
+        const prof_entry *le = prof_labels.entries + label;
+        path = prof_lookup(&prof_paths,
+                    prof_depth == 0 ? -1 : prof_stack[prof_depth - 1],
+                    prgm, le->pc);
+        if (path != -1) {
+            prof_entry *e = prof_paths.entries + path;
+            e->length = le->length;
+            memcpy(e->name, le->name, e->length);
+            if (prof_called)
+                e->calls++;
+        }
+        if (prof_called)
+            prof_labels.entries[label].calls++;
+        prof_stack[prof_depth++] = path;
+    }
+    prof_called = false;
+
+    prof_prev_line = line;
+    prof_prev_label = label;
+    prof_prev_path = prof_depth == 0 ? -1 : prof_stack[prof_depth - 1];
+    if (line != -1)
+        prof_lines.entries[line].count++;
+    if (label != -1)
+        prof_labels.entries[label].count++;
+    if (prof_prev_path != -1)
+        prof_paths.entries[prof_prev_path].count++;
+}
+
+void core_profiler_start() {
+    prof_table_clear(&prof_lines);
+    prof_table_clear(&prof_labels);
+    prof_table_clear(&prof_paths);
+    prof_depth = 0;
+    prof_prev_line = prof_prev_label = prof_prev_path = -1;
+    prof_last_ms = shell_milliseconds();
+    prof_called = false;
+    profiling = true;
+}
+
+void core_profiler_stop() {
+    profiling = false;
+}
+
+void profile_call() {
+    if (profiling)
+        prof_called = true;
+}
+
+static int prof_compare(const void *a, const void *b) {
+    const prof_entry *e1 = *(const prof_entry **) a;
+    const prof_entry *e2 = *(const prof_entry **) b;
+    return e1->count < e2->count ? 1 : e1->count > e2->count ? -1 : 0;
+}
+
+static int prof_label_name(char *buf, const prof_entry *e) {
+    /* Writes the name of the label in 'e' in ASCII, or END or .END. if it's
+     * for code outside any global label; returns the length.
+     */
+    if (e->pc == -1) {
+        if (e->prgm == prgms_count - 1) {
+            strcpy(buf, ".END.");
+            return 5;
+        } else {
+            strcpy(buf, "END");
+            return 3;
+        }
+    } else
+        return hp2ascii(buf, e->name, e->length);
+}
+
+static void prof_write_path(textbuf *tb, int4 idx) {
+    const prof_entry *e = prof_paths.entries + idx;
+    char buf[50];
+    int len, i;
+    if (e->parent != -1) {
+        prof_write_path(tb, e->parent);
+        tb_write(tb, ";", 1);
+    }
+    len = prof_label_name(buf, e);
+    /* Spaces and semicolons are delimiters in this format */
+    for (i = 0; i < len; i++)
+        if (buf[i] == ' ' || buf[i] == ';')
+            buf[i] = '_';
+    tb_write(tb, buf, len);
+}
+
+static bool prof_write_sorted(textbuf *tb, const prof_table *t, bool lines) {
+    const prof_entry **sorted = (const prof_entry **)
+                            malloc(t->count * sizeof(prof_entry *));
+    /* Worst case, for a line: the counts (24), the label (7 characters),
+     * the line number (16), and the command (30 characters), where
+     * hp2ascii() may turn each character into as many as 5, plus the
+     * newline.
+     */
+    char buf[24 + 7 * 5 + 16 + 30 * 5 + 1];
+    int4 i;
+    if (sorted == NULL && t->count != 0)
+        return false;
+    for (i = 0; i < t->count; i++)
+        sorted[i] = t->entries + i;
+    qsort(sorted, t->count, sizeof(prof_entry *), prof_compare);
+    int saved_prgm = current_prgm;
+    for (i = 0; i < t->count; i++) {
+        const prof_entry *e = sorted[i];
+        int len;
+        if (e->prgm < 0 || e->prgm >= prgms_count)
+            continue;
+        if (lines) {
+            /* Identify the line by the label it's under, its line number,
+             * and the command itself
+             */
+            prof_entry lbl;
+            char cmdbuf[100];
+            int4 lpc = e->pc;
+            int cmd, cmdlen;
+            arg_struct arg;
+            int li = find_containing_label(e->prgm, lpc);
+            lbl.prgm = e->prgm;
+            lbl.pc = li == -1 ? -1 : labels[li].pc;
+            if (li != -1) {
+                lbl.length = labels[li].length;
+                memcpy(lbl.name, labels[li].name, lbl.length);
+            }
+            current_prgm = e->prgm;
+            len = sprintf(buf, "%12llu %8u  \"",
+                          (unsigned long long) e->count, e->ms);
+            len += prof_label_name(buf + len, &lbl);
+            len += sprintf(buf + len, "\" %04d  ", pc2line(lpc));
+            get_next_command(&lpc, &cmd, &arg, 0);
+            if (cmd == CMD_NUMBER) {
+                char *num = phloat2program(arg.val_d);
+                cmdlen = (int) strlen(num);
+                if (cmdlen > 30)
+                    cmdlen = 30;
+                memcpy(cmdbuf, num, cmdlen);
+            } else if (cmd == CMD_STRING) {
+                cmdbuf[0] = '"';
+                memcpy(cmdbuf + 1, arg.val.text, arg.length);
+                cmdbuf[arg.length + 1] = '"';
+                cmdlen = arg.length + 2;
+            } else
+                cmdlen = command2buf(cmdbuf, 30, cmd, &arg);
+            len += hp2ascii(buf + len, cmdbuf, cmdlen);
+        } else {
+            len = sprintf(buf, "%12llu %8u %8u  ",
+                          (unsigned long long) e->count, e->ms, e->calls);
+            len += prof_label_name(buf + len, e);
+        }
+        buf[len++] = '\n';
+        tb_write(tb, buf, len);
+    }
+    current_prgm = saved_prgm;
+    free(sorted);
+    return true;
+}
+
+char *core_profiler_report(bool collapsed) {
+    textbuf tb;
+    tb.buf = NULL;
+    tb.size = 0;
+    tb.capacity = 0;
+    tb.fail = false;
+    if (collapsed) {
+        int4 i;
+        for (i = 0; i < prof_paths.count; i++) {
+            const prof_entry *e = prof_paths.entries + i;
+            char buf[25];
+            if (e->count == 0 || e->prgm >= prgms_count)
+                continue;
+            prof_write_path(&tb, i);
+            tb_write(&tb, buf, sprintf(buf, " %llu\n",
+                                       (unsigned long long) e->count));
+        }
+    } else {
+        const char *h1 = "Lines:\n"
+                         "Instructions       ms  Line\n";
+        const char *h2 = "\nGlobal labels:\n"
+                         "Instructions       ms    Calls  Label\n";
+        tb_write(&tb, h1, strlen(h1));
+        if (!prof_write_sorted(&tb, &prof_lines, true))
+            tb.fail = true;
+        tb_write(&tb, h2, strlen(h2));
+        if (!prof_write_sorted(&tb, &prof_labels, false))
+            tb.fail = true;
+    }
+    tb_write_null(&tb);
+    if (tb.fail) {
+        free(tb.buf);
+        return NULL;
+    }
+    return tb.buf;
+}
+
+static int8 prof_table_mem_usage(const prof_table *t) {
+    return (int8) t->capacity * sizeof(prof_entry)
+            + (int8) t->hash_size * sizeof(int4);
+}
+
+void core_get_mem_usage(core_mem_usage *usage) {
+    usage->variables = vars_mem_usage();
+    get_matrix_data_stats(&usage->matrix_count, &usage->matrices);
+    usage->pools = vartype_pools_mem_usage();
+    usage->programs = programs_mem_usage();
+    usage->rtn_stack = rtn_stack_mem_usage();
+    usage->profiler = prof_table_mem_usage(&prof_lines)
+            + prof_table_mem_usage(&prof_labels)
+            + prof_table_mem_usage(&prof_paths)
+            + (int8) prof_stack_capacity * sizeof(int4);
+    usage->total = usage->variables + usage->matrices + usage->pools
+            + usage->programs + usage->rtn_stack + usage->profiler;
+}
+
+char *core_mem_report() {
+    core_mem_usage u;
+    core_get_mem_usage(&u);
+    char *buf = (char *) malloc(300);
+    if (buf == NULL)
+        return NULL;
+    sprintf(buf, "Variables  %12lld\n"
+                 "Matrices   %12lld  (%d)\n"
+                 "Pools      %12lld\n"
+                 "Programs   %12lld\n"
+                 "RTN stack  %12lld\n"
+                 "Profiler   %12lld\n"
+                 "Total      %12lld\n",
+            (long long) u.variables, (long long) u.matrices, u.matrix_count,
+            (long long) u.pools, (long long) u.programs,
+            (long long) u.rtn_stack, (long long) u.profiler,
+            (long long) u.total);
+    return buf;
+}
+
 void set_running(bool state) {
     if (mode_running != state) {
         mode_running = state;
+        if (state)
+            /* A new run starts a new call path for the profiler */
+            prof_depth = 0;
         shell_annunciators(-1, -1, -1, state, -1, -1);
     }
     if (state) {
@@ -3844,9 +4362,70 @@ void do_interactive(int command) {
     }
 }
 
+/* Event polling during program execution. Checking for pending events can
+ * be expensive -- on GTK it means taking the main context lock and polling
+ * all its sources -- so instead of calling shell_wants_cpu() before every
+ * line, we call it once every slice_lines lines. When the slice is time-based
+ * (see core_settings.cpu_slice_ms), slice_lines is doubled or halved after
+ * each check, depending on how long the last slice took. The clock is also
+ * read every SLICE_CLOCK_LINES lines within the slice, and the slice ends
+ * early once its time is up, so a program that goes from cheap lines to
+ * slow ones (matrix operations, SOLVE and INTEG bodies, long strings) still
+ * gets to see R/S and EXIT promptly.
+ */
+#define MAX_SLICE_LINES 65536
+#define SLICE_CLOCK_LINES 64
+static int4 slice_lines = 1;
+static int4 slice_countdown = 1;
+static uint4 slice_start;
+
+static bool slice_done() {
+    bool timed = core_settings.cpu_slice_lines <= 0
+                    && core_settings.cpu_slice_ms > 0;
+    if (core_settings.cpu_slice_lines > 0)
+        slice_lines = core_settings.cpu_slice_lines;
+    else if (core_settings.cpu_slice_ms <= 0)
+        slice_lines = 1;
+    if (--slice_countdown > 0) {
+        if (!timed || slice_countdown % SLICE_CLOCK_LINES != 0)
+            return false;
+        if (shell_milliseconds() - slice_start
+                                <= (uint4) core_settings.cpu_slice_ms)
+            return false;
+    }
+    if (timed) {
+        uint4 now = shell_milliseconds();
+        uint4 elapsed = now - slice_start;
+        slice_start = now;
+        if (elapsed > (uint4) core_settings.cpu_slice_ms) {
+            if (slice_lines > 1)
+                slice_lines >>= 1;
+        } else if (elapsed < (uint4) core_settings.cpu_slice_ms / 2) {
+            if (slice_lines < MAX_SLICE_LINES)
+                slice_lines <<= 1;
+        }
+    }
+    slice_countdown = slice_lines;
+    return shell_wants_cpu() != 0;
+}
+
+int core_get_cpu_slice_lines() {
+    if (core_settings.cpu_slice_lines > 0)
+        return core_settings.cpu_slice_lines;
+    else if (core_settings.cpu_slice_ms <= 0)
+        return 1;
+    else
+        return slice_lines;
+}
+
 static void continue_running() {
     int error;
-    while (!shell_wants_cpu()) {
+    /* Time spent outside this function, handling events or waiting for
+     * the next core_keydown() call, doesn't count against the slice
+     */
+    slice_start = shell_milliseconds();
+    prof_last_ms = slice_start;
+    while (!slice_done()) {
         int cmd;
         arg_struct arg;
         oldpc = pc;
@@ -3857,11 +4436,46 @@ static void continue_running() {
             set_running(false);
             return;
         }
-        get_next_command(&pc, &cmd, &arg, 1);
+        if (profiling)
+            profile_line(current_prgm, pc);
+        else if (!flags.f.trace_print || !flags.f.printer_exists) {
+            /* Direct-threaded fast path: dispatch straight to the handler
+             * that was linked into the decoded-instruction cache, and only
+             * fall through to the full bookkeeping below if the command
+             * did something other than complete normally, or if it stopped
+             * the program or put us in PSE or GETKEY mode. TRACE mode and
+             * the profiler always take the slow path, since they need to
+             * see every line before it is executed.
+             */
+            const decoded_command *dc = get_decoded_line(pc);
+            if (dc != NULL) {
+                pc = dc->next_pc;
+                arg = dc->arg;
+                mode_disable_stack_lift = false;
+                VARTYPE_ORIGIN(dc->cmd, current_prgm, oldpc);
+                error = dc->handler(&arg);
+                if (!mode_running || mode_pause || mode_getkey)
+                    goto slow_tail;
+                if (error == ERR_NONE || error == ERR_YES) {
+                    flags.f.stack_lift_disable = mode_disable_stack_lift;
+                    continue;
+                }
+                if (error == ERR_NO) {
+                    flags.f.stack_lift_disable = mode_disable_stack_lift;
+                    if (prgms[current_prgm].text[pc] != CMD_END)
+                        pc += get_command_length(current_prgm, pc);
+                    continue;
+                }
+                goto slow_tail;
+            }
+        }
+        get_decoded_command(&pc, &cmd, &arg);
         if (flags.f.trace_print && flags.f.printer_exists)
             print_program_line(current_prgm, oldpc);
         mode_disable_stack_lift = false;
+        VARTYPE_ORIGIN(cmd, current_prgm, oldpc);
         error = cmdlist(cmd)->handler(&arg);
+        slow_tail:
         if (mode_pause) {
             shell_request_timeout3(1000);
             return;
@@ -56,6 +56,33 @@ void core_save_state(const char *state_file_name);
  */
 void core_cleanup();
 
+/* core_stash_state()
+ * core_restore_stash()
+ * core_free_stash()
+ *
+ * These functions do what core_save_state(), core_cleanup(), and core_init()
+ * with read_state = 1 do, but with an anonymous temporary file instead of a
+ * named state file, and without the shell state. This is a save and restore
+ * helper, not support for several calculators at once: the core still has
+ * just one set of global state, which a restore replaces.
+ *
+ * core_stash_state() saves the current state, and returns it; if a program
+ * is running, it is stopped first, just like with core_save_state(). The
+ * current state stays in place. Returns NULL if the state could not be
+ * saved.
+ *
+ * core_restore_stash() replaces the current state with the stashed one, and
+ * repaints the display. The stash is left as it is, so it can be restored
+ * again. Returns false, and performs a hard reset, if the stash could not be
+ * read.
+ *
+ * core_free_stash() deletes a stash.
+ */
+typedef struct core_stash core_stash;
+core_stash *core_stash_state();
+bool core_restore_stash(core_stash *stash);
+void core_free_stash(core_stash *stash);
+
 /* core_repaint_display()
  *
  * This function asks the emulator core to repaint the display. The core will
@@ -144,6 +171,16 @@ int core_keydown(int key, int *enqueued, int *repeat);
  */
 int core_keydown_command(const char *name, int *enqueued, int *repeat);
 
+/* core_run_label()
+ *
+ * Starts running the program at the given global label, given in ASCII, the
+ * way XEQ does when invoked from the keyboard. Returns false if the label does
+ * not exist. Otherwise, the program will be running, and the shell should call
+ * core_keydown() with key code 0 for as long as it returns 1, as usual.
+ * This is meant for shells that have no keyboard, like the batch runner.
+ */
+bool core_run_label(const char *name);
+
 /* core_repeat()
  *
  * This function is called by the shell to signal auto-repeating key events.
@@ -282,6 +319,16 @@ void core_import_programs(int num_progs, const char *raw_file_name);
  */
 char *core_copy();
 
+/* core_copy_reg()
+ *
+ * Returns a string representation of the contents of a register: 'X', 'Y',
+ * 'Z', 'T', or 'L' for the stack and LASTX, using the same format as
+ * core_copy(), or 'A' for ALPHA.
+ * The caller should free the returned text using free(3). Returns NULL if
+ * the register name is not recognized, or if the text could not be allocated.
+ */
+char *core_copy_reg(char reg);
+
 /* core_paste()
  *
  * Puts the given value on the stack, using RCL semantics. It tries to parse
@@ -291,11 +338,84 @@ char *core_copy();
  */
 void core_paste(const char *s);
 
+/* core_profiler_start()
+ * core_profiler_stop()
+ * core_profiler_report()
+ *
+ * Program profiler. While it is active, the core counts the instructions
+ * executed by running programs, per program line and per global label, and
+ * samples the elapsed time (with the resolution of shell_milliseconds()).
+ * Global labels are tracked as functions: every GTO or XEQ to a global
+ * label counts as a call to it, and the instruction counts are also kept per
+ * call path, following the return stack.
+ * core_profiler_start() discards any previous results and turns the profiler
+ * on; core_profiler_stop() turns it off, but keeps the results.
+ * core_profiler_report() returns the results as text: with collapsed = false,
+ * it is a flat report, listing program lines and global labels in order of
+ * decreasing instruction count; with collapsed = true, it is one line per call
+ * path, in the "collapsed stack" format accepted by flame graph tools, with
+ * instruction counts as the sample values.
+ * The report refers to programs and lines as they are when it is created, so
+ * editing programs while the profiler holds results will make them
+ * meaningless.
+ * The returned text should be freed by the caller using free(3); the function
+ * returns NULL if it fails to allocate it.
+ * When the profiler is off, program execution is not slowed down.
+ */
+void core_profiler_start();
+void core_profiler_stop();
+char *core_profiler_report(bool collapsed);
+
+/* core_get_mem_usage()
+ * core_mem_report()
+ *
+ * Memory held by the core, in bytes, by category. Matrix elements are
+ * counted once per matrix, no matter how many variables and registers share
+ * them; pools count the slabs they hold, whether the slots in them are in
+ * use or not.
+ * The matrix and pool figures come from counters that are global to the
+ * process, like the rest of the core's state; a state stashed with
+ * core_stash_state() is in a file, and not included. The pool figure
+ * depends on history: the pools grow in slabs and don't shrink while any
+ * of their slots are in use, so two identical states may report different
+ * pool sizes.
+ * Printer output is not included, since the core doesn't buffer it: it goes
+ * to shell_print() one line at a time.
+ * This makes it possible for a shell to give the calculator a fixed amount
+ * of memory, by returning that amount minus 'total' from shell_get_mem(),
+ * which is what the MEM function shows.
+ * core_mem_report() returns the same figures as text, one category per line;
+ * the text should be freed by the caller using free(3). It returns NULL if
+ * it fails to allocate the text.
+ */
+typedef struct {
+    int8 variables;   /* the variable table and its index */
+    int8 matrices;    /* matrix elements and string flags */
+    int4 matrix_count;
+    int8 pools;       /* reals, complex numbers, strings, and matrix headers */
+    int8 programs;    /* program text, its indexes and caches, and labels */
+    int8 rtn_stack;   /* the RTN stack */
+    int8 profiler;    /* profiler results */
+    int8 total;
+} core_mem_usage;
+void core_get_mem_usage(core_mem_usage *usage);
+char *core_mem_report();
+
 /* core_settings
  *
  * This is a struct that stores user-configurable core settings. The shell
  * should provide the appropriate controls in a "Preferences" dialog box to
  * allow the user to view and change these settings.
+ *
+ * cpu_slice_ms and cpu_slice_lines control how often a running program
+ * checks for pending events by calling shell_wants_cpu(). If cpu_slice_lines
+ * is nonzero, the check is made once every cpu_slice_lines program lines;
+ * otherwise, if cpu_slice_ms is nonzero, the number of lines between checks
+ * is adjusted on the fly so that they are about cpu_slice_ms milliseconds
+ * apart. If both are zero, the check is made before every line, which is
+ * the most responsive, but also the slowest, setting. The defaults, set by
+ * core_init(), are 10 ms and 0 lines, which keeps the response to R/S and
+ * EXIT well under 20 ms.
  */
 typedef struct {
     bool matrix_singularmatrix;
@@ -307,10 +427,22 @@ typedef struct {
     bool enable_ext_time;
     bool enable_ext_fptest;
     bool enable_ext_prog;
+    int cpu_slice_ms;
+    int cpu_slice_lines;
 } core_settings_struct;
 
 extern core_settings_struct core_settings;
 
+/* core_get_cpu_slice_lines()
+ *
+ * Returns the number of program lines currently run between calls to
+ * shell_wants_cpu(). With cpu_slice_lines set, this is simply that number;
+ * with a time-based slice, it is the value the core has settled on so far,
+ * and it may change as the program runs. It is 1 when events are checked
+ * before every line.
+ */
+int core_get_cpu_slice_lines();
+
 
 /*******************/
 /* Keyboard repeat */
@@ -328,6 +460,7 @@ extern int repeating_key;
 void set_alpha_entry(bool state);
 void set_running(bool state);
 bool program_running();
+void profile_call();
 bool alpha_active();
 
 int want_to_run_again();
@@ -199,21 +199,6 @@ Phloat::Phloat(int8 numer, int8 denom) {
     bid128_div(&val, &n, &d);
 }
 
-/* public */
-Phloat::Phloat(int i) {
-    bid128_from_int32(&val, &i);
-}
-
-/* public */
-Phloat::Phloat(int8 i) {
-    bid128_from_int64(&val, &i);
-}
-
-/* public */
-Phloat::Phloat(uint8 i) {
-    bid128_from_uint64(&val, &i);
-}
-
 /* public */
 Phloat::Phloat(double d) {
     BID_UINT64 tmp;
@@ -221,29 +206,6 @@ Phloat::Phloat(double d) {
     bid64_to_bid128(&val, &tmp);
 }
 
-/* public */
-Phloat::Phloat(const Phloat &p) {
-    val = p.val;
-}
-
-/* public */
-Phloat Phloat::operator=(int i) {
-    bid128_from_int32(&val, &i);
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator=(int8 i) {
-    bid128_from_int64(&val, &i);
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator=(uint8 i) {
-    bid128_from_uint64(&val, &i);
-    return *this;
-}
-
 /* public */
 Phloat Phloat::operator=(double d) {
     BID_UINT64 tmp;
@@ -253,181 +215,58 @@ Phloat Phloat::operator=(double d) {
 }
 
 /* public */
-Phloat Phloat::operator=(Phloat p) {
-    val = p.val;
-    return *this;
-}
-
-/* public */
-bool Phloat::operator==(Phloat p) const {
-    int r;
-    bid128_quiet_equal(&r, (BID_UINT128 *) &val, &p.val);
-    return r != 0;
-}
-
-/* public */
-bool Phloat::operator!=(Phloat p) const {
-    int r;
-    bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, &p.val);
-    return r != 0;
-}
-
-/* public */
-bool Phloat::operator<(Phloat p) const {
-    int r;
-    bid128_quiet_less(&r, (BID_UINT128 *) &val, &p.val);
-    return r != 0;
-}
-
-/* public */
-bool Phloat::operator<=(Phloat p) const {
-    int r;
-    bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, &p.val);
-    return r != 0;
-}
-
-/* public */
-bool Phloat::operator>(Phloat p) const {
-    int r;
-    bid128_quiet_greater(&r, (BID_UINT128 *) &val, &p.val);
-    return r != 0;
-}
-
-/* public */
-bool Phloat::operator>=(Phloat p) const {
-    int r;
-    bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, &p.val);
-    return r != 0;
-}
-
-/* public */
-Phloat Phloat::operator-() const {
-    BID_UINT128 res;
-    bid128_negate(&res, (BID_UINT128 *) &val);
-    return Phloat(res);
-}
-
-/* public */
-Phloat Phloat::operator*(Phloat p) const {
+Phloat Phloat::operator/(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_mul(&res, (BID_UINT128 *) &val, &p.val);
+    bid128_div(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator/(Phloat p) const {
-    BID_UINT128 res;
-    bid128_div(&res, (BID_UINT128 *) &val, &p.val);
-    return Phloat(res);
-}
-
-/* public */
-Phloat Phloat::operator+(Phloat p) const {
-    BID_UINT128 res;
-    bid128_add(&res, (BID_UINT128 *) &val, &p.val);
-    return Phloat(res);
-}
-
-/* public */
-Phloat Phloat::operator-(Phloat p) const {
-    BID_UINT128 res;
-    bid128_sub(&res, (BID_UINT128 *) &val, &p.val);
-    return Phloat(res);
-}
-
-/* public */
-Phloat Phloat::operator*=(Phloat p) {
-    BID_UINT128 res;
-    bid128_mul(&res, &val, &p.val);
-    val = res;
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator/=(Phloat p) {
+Phloat Phloat::operator/=(const Phloat &p) {
     BID_UINT128 res;
-    bid128_div(&res, &val, &p.val);
+    bid128_div(&res, &val, (BID_UINT128 *) &p.val);
     val = res;
     return *this;
 }
 
-/* public */
-Phloat Phloat::operator+=(Phloat p) {
-    BID_UINT128 res;
-    bid128_add(&res, &val, &p.val);
-    val = res;
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator-=(Phloat p) {
-    BID_UINT128 res;
-    bid128_sub(&res, &val, &p.val);
-    val = res;
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator++() {
-    // prefix
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    BID_UINT128 temp;
-    bid128_add(&temp, &val, &one);
-    val = temp;
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator++(int) {
-    // postfix
-    Phloat old = *this;
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_add(&val, &old.val, &one);
-    return old;
-}
-
-/* public */
-Phloat Phloat::operator--() {
-    // prefix
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    BID_UINT128 temp;
-    bid128_sub(&temp, &val, &one);
-    val = temp;
-    return *this;
-}
-
-/* public */
-Phloat Phloat::operator--(int) {
-    // postfix
-    Phloat old = *this;
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_sub(&val, &old.val, &one);
-    return old;
-}
-
-int p_isinf(Phloat p) {
-    int r;
-    if (bid128_isInf(&r, &p.val), r)
-        return (bid128_isSigned(&r, &p.val), r) ? -1 : 1;
-    else
-        return 0;
-}
-
-int p_isnan(Phloat p) {
-    int r;
-    bid128_isNaN(&r, &p.val);
-    return r;
+const uint8 phloat_pow10[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+bool phloat_trunc_int8(const Phloat &p, int8 *res, bool *exact) {
+    uint8 c;
+    int e;
+    bool ex = true;
+    if (!phloat_unpack(p.val, &c, &e) || (c >> 63) != 0)
+        return false;
+    e -= BID128_EXP_BIAS;
+    if (e >= 0) {
+        if (c != 0) {
+            if (e > 18 || c > 0x7fffffffffffffffULL / phloat_pow10[e])
+                return false;
+            c *= phloat_pow10[e];
+        }
+    } else if (e < -19) {
+        ex = c == 0;
+        c = 0;
+    } else {
+        ex = c % phloat_pow10[-e] == 0;
+        c /= phloat_pow10[-e];
+    }
+    *res = (BID128_HI(p.val) & BID128_SIGN_MASK) != 0 ? -(int8) c : (int8) c;
+    if (exact != NULL)
+        *exact = ex;
+    return true;
 }
 
 int to_digit(Phloat p) {
+    int8 t;
+    if (phloat_trunc_int8(p, &t))
+        return (int) (t % 10);
     BID_UINT128 ten, res;
     int d10 = 10;
     int ires;
@@ -449,18 +288,27 @@ int to_digit(Phloat p) {
 }
 
 char to_char(Phloat p) {
+    int8 t;
+    if (phloat_trunc_int8(p, &t) && t == (int4) t)
+        return (char) t;
     int4 res;
     bid128_to_int32_xint(&res, &p.val);
     return (char) res;
 }
 
 int to_int(Phloat p) {
+    int8 t;
+    if (phloat_trunc_int8(p, &t) && t == (int4) t)
+        return (int) t;
     int4 res;
     bid128_to_int32_xint(&res, &p.val);
     return (int) res;
 }
 
 int4 to_int4(Phloat p) {
+    int8 t;
+    if (phloat_trunc_int8(p, &t) && t == (int4) t)
+        return (int4) t;
     int4 res;
     bid128_to_int32_xint(&res, &p.val);
     return res;
@@ -468,11 +316,16 @@ int4 to_int4(Phloat p) {
 
 int8 to_int8(Phloat p) {
     int8 res;
+    if (phloat_trunc_int8(p, &res))
+        return res;
     bid128_to_int64_xint(&res, &p.val);
     return res;
 }
 
 uint8 to_uint8(Phloat p) {
+    int8 t;
+    if (phloat_trunc_int8(p, &t) && t >= 0)
+        return (uint8) t;
     uint8 res;
     bid128_to_uint64_xint(&res, &p.val);
     return res;
@@ -620,6 +473,15 @@ Phloat sqrt(Phloat p) {
 
 Phloat fmod(Phloat x, Phloat y) {
     BID_UINT128 res;
+    uint8 xc, yc;
+    int xe, ye;
+    if (phloat_unpack(x.val, &xc, &xe) && phloat_unpack(y.val, &yc, &ye)
+            && xe == BID128_EXP_BIAS && ye == BID128_EXP_BIAS && yc != 0) {
+        // Integers: the result has the sign of x, like C's %
+        phloat_set_int(&res, (BID128_HI(x.val) & BID128_SIGN_MASK) != 0,
+                       xc % yc);
+        return Phloat(res);
+    }
     bid128_rem(&res, &x.val, &y.val);
     int numer_sign, denom_sign, res_sign;
     bid128_isSigned(&numer_sign, &x.val);
@@ -636,12 +498,6 @@ Phloat fmod(Phloat x, Phloat y) {
         return Phloat(res);
 }
 
-Phloat fabs(Phloat p) {
-    BID_UINT128 res;
-    bid128_abs(&res, &p.val);
-    return Phloat(res);
-}
-
 Phloat pow(Phloat y, Phloat x) {
     BID_UINT128 temp, res;
     bid128_round_integral_negative(&temp, &x.val);
@@ -725,55 +581,32 @@ Phloat pow(Phloat y, Phloat x) {
 
 Phloat floor(Phloat p) {
     BID_UINT128 res;
+    uint8 c;
+    int e;
+    if (phloat_unpack(p.val, &c, &e)) {
+        // Like bid128_round_integral_zero(): values with exponent >= 0
+        // are returned as they are, anything else is truncated to an
+        // integer with exponent 0, keeping the sign
+        if (e >= BID128_EXP_BIAS)
+            return p;
+        e = BID128_EXP_BIAS - e;
+        phloat_set_int(&res, (BID128_HI(p.val) & BID128_SIGN_MASK) != 0,
+                       e > 19 ? 0 : c / phloat_pow10[e]);
+        return Phloat(res);
+    }
     bid128_round_integral_zero(&res, &p.val);
     return Phloat(res);
 }
 
-Phloat operator*(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_mul(&res, &xx, &y.val);
-    return Phloat(res);
-}
-
-Phloat operator/(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_div(&res, &xx, &y.val);
-    return Phloat(res);
-}
-
-Phloat operator/(double x, Phloat y) {
+Phloat operator/(double x, const Phloat &y) {
     BID_UINT128 xx, res;
     BID_UINT64 tmp;
     binary64_to_bid64(&tmp, &x);
     bid64_to_bid128(&xx, &tmp);
-    bid128_div(&res, &xx, &y.val);
-    return Phloat(res);
-}
-
-Phloat operator+(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_add(&res, &xx, &y.val);
-    return Phloat(res);
-}
-
-Phloat operator-(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_sub(&res, &xx, &y.val);
+    bid128_div(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-bool operator==(int4 x, Phloat y) {
-    BID_UINT128 xx;
-    bid128_from_int32(&xx, &x);
-    int r;
-    bid128_quiet_equal(&r, &xx, &y.val);
-    return r != 0;
-}
-
 Phloat PI("3.141592653589793238462643383279503");
 
 void update_decimal(BID_UINT128 *val) {
@@ -788,6 +621,397 @@ void update_decimal(BID_UINT128 *val) {
 }
 
 
+/* Exact dot product accumulator. The coefficient is kept as DOT_LIMBS 32-bit
+ * limbs, least significant first, in two's complement. Its magnitude is kept
+ * below 2^280, so adding a product of two 34-digit coefficients (< 2^226)
+ * can never overflow. When a term is too large to be aligned with the sum so
+ * far, the sum is rounded and moved to 'rest', and accumulation starts over
+ * from that term; when it is too small, the term itself goes to 'rest'.
+ */
+
+#define DOT_LIMBS 9
+
+static const uint4 dot_pow10_34[DOT_LIMBS] = {
+    0x00000000, 0x378d8e64, 0xbead87c0, 0x0001ed09, 0, 0, 0, 0, 0
+};
+static const uint4 dot_pow10_43[DOT_LIMBS] = {
+    0x00000000, 0x6682e800, 0xe38cb6ce, 0x5bd86321, 0x000072cb, 0, 0, 0, 0
+};
+static const uint4 dot_pow10[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static void dot_negate(uint4 *c) {
+    uint8 carry = 1;
+    for (int i = 0; i < DOT_LIMBS; i++) {
+        carry += (uint4) ~c[i];
+        c[i] = (uint4) carry;
+        carry >>= 32;
+    }
+}
+
+static int dot_compare(const uint4 *a, const uint4 *b) {
+    for (int i = DOT_LIMBS - 1; i >= 0; i--)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+/* Multiplies the magnitude c by 10^n. Returns false if the result would
+ * not stay below 2^280; c is garbage in that case.
+ */
+static bool dot_scale(uint4 *c, int n) {
+    while (n > 0) {
+        int k = n > 9 ? 9 : n;
+        uint8 carry = 0;
+        for (int i = 0; i < DOT_LIMBS; i++) {
+            carry += (uint8) c[i] * dot_pow10[k];
+            c[i] = (uint4) carry;
+            carry >>= 32;
+        }
+        if (carry != 0 || (c[DOT_LIMBS - 1] >> 24) != 0)
+            return false;
+        n -= k;
+    }
+    return true;
+}
+
+/* Divides the magnitude c by d, and returns the remainder */
+static uint4 dot_divide(uint4 *c, uint4 d) {
+    uint8 rem = 0;
+    for (int i = DOT_LIMBS - 1; i >= 0; i--) {
+        rem = (rem << 32) | c[i];
+        c[i] = (uint4) (rem / d);
+        rem %= d;
+    }
+    return (uint4) rem;
+}
+
+/* Rounds the exact part of the accumulator to the nearest Phloat */
+static Phloat dot_round(const dot_acc *acc) {
+    if (acc->empty)
+        return 0;
+    uint4 c[DOT_LIMBS];
+    memcpy(c, acc->coef, sizeof(c));
+    bool negative = (c[DOT_LIMBS - 1] >> 31) != 0;
+    if (negative)
+        dot_negate(c);
+    int e = acc->exp;
+    bool sticky = false;
+    uint4 rd = 0;
+    while (dot_compare(c, dot_pow10_43) >= 0) {
+        sticky |= dot_divide(c, 1000000000) != 0;
+        e += 9;
+    }
+    while (dot_compare(c, dot_pow10_34) >= 0) {
+        sticky |= rd != 0;
+        rd = dot_divide(c, 10);
+        e++;
+    }
+    if (rd > 5 || (rd == 5 && (sticky || (c[0] & 1) != 0))) {
+        for (int i = 0; i < DOT_LIMBS && ++c[i] == 0; i++);
+        if (dot_compare(c, dot_pow10_34) == 0) {
+            dot_divide(c, 10);
+            e++;
+        }
+    }
+    BID_UINT128 r;
+    int be = e + BID128_EXP_BIAS;
+    int n = 0;
+    if (be > BID128_EXP_MAX) {
+        n = be - BID128_EXP_MAX;
+        be = BID128_EXP_MAX;
+    } else if (be < 0) {
+        n = be;
+        be = 0;
+    }
+    BID128_HI(r) = (negative ? BID128_SIGN_MASK : 0) | ((uint8) be << 49)
+                        | ((uint8) c[3] << 32) | c[2];
+    BID128_LO(r) = ((uint8) c[1] << 32) | c[0];
+    if (n != 0) {
+        /* Out of range: let the library produce the infinity, or the
+         * (doubly rounded, in the subnormal case) tiny result.
+         */
+        BID_UINT128 t;
+        bid128_scalbn(&t, &r, &n);
+        r = t;
+    }
+    return Phloat(r);
+}
+
+static void dot_add_rest(dot_acc *acc, const Phloat &x) {
+    if (acc->has_rest)
+        acc->rest += x;
+    else {
+        acc->rest = x;
+        acc->has_rest = true;
+    }
+}
+
+static void dot_flush(dot_acc *acc) {
+    dot_add_rest(acc, dot_round(acc));
+    acc->empty = true;
+}
+
+/* Unpacks the coefficient of x into 32-bit limbs, and returns the number of
+ * significant limbs.
+ */
+static int dot_coef(const BID_UINT128 &x, uint4 *c) {
+    c[0] = (uint4) BID128_LO(x);
+    c[1] = (uint4) (BID128_LO(x) >> 32);
+    c[2] = (uint4) BID128_HI(x);
+    c[3] = (uint4) ((BID128_HI(x) & BID128_COEF_MASK) >> 32);
+    int n = 4;
+    while (n > 0 && c[n - 1] == 0)
+        n--;
+    return n;
+}
+
+static void dot_term(dot_acc *acc, const Phloat &x, const Phloat &y, bool sub) {
+    if (!phloat_is_simple(x.val) || !phloat_is_simple(y.val)) {
+        Phloat p = x * y;
+        dot_add_rest(acc, sub ? -p : p);
+        return;
+    }
+
+    uint4 a[4], b[4], c[DOT_LIMBS];
+    int na = dot_coef(x.val, a);
+    int nb = dot_coef(y.val, b);
+    if (na == 0 || nb == 0)
+        return;
+    memset(c, 0, sizeof(c));
+    for (int i = 0; i < na; i++) {
+        uint8 carry = 0;
+        for (int j = 0; j < nb; j++) {
+            carry += (uint8) a[i] * b[j] + c[i + j];
+            c[i + j] = (uint4) carry;
+            carry >>= 32;
+        }
+        c[i + nb] = (uint4) carry;
+    }
+    int nc = na + nb;
+    int e = phloat_exponent(x.val) + phloat_exponent(y.val)
+                - 2 * BID128_EXP_BIAS;
+    bool negative = ((BID128_HI(x.val) ^ BID128_HI(y.val))
+                                            & BID128_SIGN_MASK) != 0;
+    if (sub)
+        negative = !negative;
+
+    if (!acc->empty) {
+        /* Align the exponents, by scaling up whichever of the two
+         * has the larger one.
+         */
+        uint4 m[DOT_LIMBS];
+        if (e > acc->exp) {
+            memcpy(m, c, sizeof(m));
+            if (dot_scale(m, e - acc->exp)) {
+                memcpy(c, m, sizeof(m));
+                nc = DOT_LIMBS;
+                e = acc->exp;
+            } else
+                dot_flush(acc);
+        } else if (e < acc->exp) {
+            memcpy(m, acc->coef, sizeof(m));
+            bool acc_negative = (m[DOT_LIMBS - 1] >> 31) != 0;
+            if (acc_negative)
+                dot_negate(m);
+            if (dot_scale(m, acc->exp - e)) {
+                if (acc_negative)
+                    dot_negate(m);
+                memcpy(acc->coef, m, sizeof(m));
+                acc->exp = e;
+            } else {
+                /* The term is too small to be aligned with the sum so
+                 * far; it can only matter after cancellation, so it is
+                 * kept separately, rounded.
+                 */
+                Phloat p = x * y;
+                dot_add_rest(acc, sub ? -p : p);
+                return;
+            }
+        }
+    }
+
+    if (acc->empty) {
+        memset(acc->coef, 0, sizeof(acc->coef));
+        acc->exp = e;
+        acc->empty = false;
+    }
+    /* Add or subtract the magnitude c, which occupies the low nc limbs;
+     * the carry or borrow out of those limbs rarely goes far.
+     */
+    uint4 *d = acc->coef;
+    int i;
+    if (negative) {
+        uint4 borrow = 0;
+        for (i = 0; i < nc; i++) {
+            uint8 diff = (uint8) d[i] - c[i] - borrow;
+            d[i] = (uint4) diff;
+            borrow = (uint4) (diff >> 63);
+        }
+        for (; borrow && i < DOT_LIMBS; i++)
+            borrow = d[i]-- == 0;
+    } else {
+        uint8 carry = 0;
+        for (i = 0; i < nc; i++) {
+            carry += (uint8) d[i] + c[i];
+            d[i] = (uint4) carry;
+            carry >>= 32;
+        }
+        for (; carry && i < DOT_LIMBS; i++)
+            carry = ++d[i] == 0;
+    }
+    /* Restore the headroom: bits 280 and up must all match the sign */
+    uint4 top = acc->coef[DOT_LIMBS - 1] >> 24;
+    if (top != 0 && top != 0xff)
+        dot_flush(acc);
+}
+
+void dot_init(dot_acc *acc, const Phloat &x) {
+    acc->empty = true;
+    acc->has_rest = false;
+    if (x != 0)
+        dot_term(acc, x, 1, false);
+}
+
+void dot_add(dot_acc *acc, const Phloat &x, const Phloat &y) {
+    dot_term(acc, x, y, false);
+}
+
+void dot_sub(dot_acc *acc, const Phloat &x, const Phloat &y) {
+    dot_term(acc, x, y, true);
+}
+
+void dot_add_complex(dot_acc *re, dot_acc *im, const Phloat &xre,
+                     const Phloat &xim, const Phloat &yre, const Phloat &yim) {
+    dot_term(re, xre, yre, false);
+    dot_term(re, xim, yim, true);
+    dot_term(im, xim, yre, false);
+    dot_term(im, xre, yim, false);
+}
+
+void dot_sub_complex(dot_acc *re, dot_acc *im, const Phloat &xre,
+                     const Phloat &xim, const Phloat &yre, const Phloat &yim) {
+    dot_term(re, xre, yre, true);
+    dot_term(re, xim, yim, false);
+    dot_term(im, xim, yre, true);
+    dot_term(im, xre, yim, true);
+}
+
+Phloat dot_result(const dot_acc *acc) {
+    Phloat r = dot_round(acc);
+    return acc->has_rest ? r + acc->rest : r;
+}
+
+
+/* Element-wise array kernels. These extend the inline fast paths of the
+ * Phloat operators to operands with different exponents and to products
+ * of coefficients up to 64 bits, as long as the exact result still fits;
+ * in that case it is also what the library would have returned. The
+ * addition is also used by the Phloat operators themselves, when their
+ * inline fast path doesn't apply.
+ */
+
+/* Multiplies c by 10^d, if the result stays below 2^62 */
+static inline bool array_align(uint8 *c, int d) {
+    if (*c == 0)
+        return true;
+    if (d > 18 || *c > (((uint8) 1 << 62) - 1) / phloat_pow10[d])
+        return false;
+    *c *= phloat_pow10[d];
+    return true;
+}
+
+bool phloat_exact_add(const BID_UINT128 &a, const BID_UINT128 &b,
+                      bool subtract, BID_UINT128 *res) {
+    uint8 ac, bc;
+    int ae, be;
+    if (!phloat_unpack(a, &ac, &ae) || !phloat_unpack(b, &bc, &be)
+            || (ac >> 62) != 0 || (bc >> 62) != 0)
+        return false;
+    // The exact sum has the smaller of the two exponents
+    if (ae > be) {
+        if (!array_align(&ac, ae - be))
+            return false;
+        ae = be;
+    } else if (be > ae) {
+        if (!array_align(&bc, be - ae))
+            return false;
+    }
+    uint8 as = BID128_HI(a) & BID128_SIGN_MASK;
+    uint8 bs = (subtract ? ~BID128_HI(b) : BID128_HI(b)) & BID128_SIGN_MASK;
+    uint8 sign;
+    if (as == bs) {
+        ac += bc;
+        sign = as;
+    } else if (ac >= bc) {
+        sign = ac == bc ? 0 : as;
+        ac -= bc;
+    } else {
+        ac = bc - ac;
+        sign = bs;
+    }
+    BID128_HI(*res) = sign | ((uint8) ae << 49);
+    BID128_LO(*res) = ac;
+    return true;
+}
+
+static inline bool array_mul(const BID_UINT128 &a, const BID_UINT128 &b,
+                             BID_UINT128 *res) {
+    uint8 ac, bc;
+    int ae, be;
+    if (!phloat_unpack(a, &ac, &ae) || !phloat_unpack(b, &bc, &be))
+        return false;
+    int e = ae + be - BID128_EXP_BIAS;
+    if (e < 0 || e > BID128_EXP_MAX)
+        return false;
+    // 64 x 64 -> 128 bit product, in 32-bit pieces
+    uint8 a0 = ac & 0xffffffff, a1 = ac >> 32;
+    uint8 b0 = bc & 0xffffffff, b1 = bc >> 32;
+    uint8 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint8 mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+    uint8 lo = (mid << 32) | (p00 & 0xffffffff);
+    uint8 hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    if (hi >= BID128_COEF_HI_LIMIT)
+        return false;
+    BID128_HI(*res) = ((BID128_HI(a) ^ BID128_HI(b)) & BID128_SIGN_MASK)
+                        | ((uint8) e << 49) | hi;
+    BID128_LO(*res) = lo;
+    return true;
+}
+
+bool phloat_array_add(const Phloat *x, int xinc, const Phloat *y, int yinc,
+                      Phloat *z, int4 n, bool subtract) {
+    bool slow = false;
+    for (int4 i = 0; i < n; i++) {
+        BID_UINT128 *a = (BID_UINT128 *) &y[i * yinc].val;
+        BID_UINT128 *b = (BID_UINT128 *) &x[i * xinc].val;
+        if (phloat_exact_add(*a, *b, subtract, &z[i].val))
+            continue;
+        if (subtract)
+            bid128_sub(&z[i].val, a, b);
+        else
+            bid128_add(&z[i].val, a, b);
+        slow = true;
+    }
+    return slow;
+}
+
+bool phloat_array_mul(const Phloat *x, int xinc, const Phloat *y, int yinc,
+                      Phloat *z, int4 n) {
+    bool slow = false;
+    for (int4 i = 0; i < n; i++) {
+        BID_UINT128 *a = (BID_UINT128 *) &y[i * yinc].val;
+        BID_UINT128 *b = (BID_UINT128 *) &x[i * xinc].val;
+        if (array_mul(*a, *b, &z[i].val))
+            continue;
+        bid128_mul(&z[i].val, a, b);
+        slow = true;
+    }
+    return slow;
+}
+
+
 #else // BCD_MATH
 
 
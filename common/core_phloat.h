@@ -61,12 +61,158 @@ struct hp_string {
 
 double decimal2double(void *data, bool pin_magnitude = false);
 
+// Accumulator for sums of products; see the BCD_MATH version below.
+struct dot_acc {
+    phloat sum;
+};
+
+inline void dot_init(dot_acc *acc, phloat x = 0) { acc->sum = x; }
+inline void dot_add(dot_acc *acc, phloat x, phloat y) { acc->sum += x * y; }
+inline void dot_sub(dot_acc *acc, phloat x, phloat y) { acc->sum -= x * y; }
+inline phloat dot_result(const dot_acc *acc) { return acc->sum; }
+// Complex terms: re += xre * yre - xim * yim, im += xim * yre + xre * yim.
+// Each part is computed before it is accumulated, as plain double
+// arithmetic would; splitting it into separate products would add a
+// rounding per product.
+inline void dot_add_complex(dot_acc *re, dot_acc *im, phloat xre, phloat xim,
+                            phloat yre, phloat yim) {
+    re->sum += xre * yre - xim * yim;
+    im->sum += xim * yre + xre * yim;
+}
+inline void dot_sub_complex(dot_acc *re, dot_acc *im, phloat xre, phloat xim,
+                            phloat yre, phloat yim) {
+    re->sum -= xre * yre - xim * yim;
+    im->sum -= xim * yre + xre * yim;
+}
+
 
 #else // BCD_MATH
 
 
 #define phloat Phloat
 
+// Direct access to the BID128 encoding, used by the inline fast paths below.
+// A value is 'simple' if it is finite, uses the regular encoding (exponent in
+// bits 49..62 of the high word, coefficient in the low 113 bits), and has a
+// coefficient small enough to be canonical. Everything else (infinities,
+// NaNs, and the large-coefficient encoding, which is never canonical in
+// BID128) is left to the Intel library.
+#define BID128_HI(x) ((x).w[BID_HIGH_128W])
+#define BID128_LO(x) ((x).w[BID_LOW_128W])
+#define BID128_SIGN_MASK 0x8000000000000000ULL
+#define BID128_STEER_MASK 0x6000000000000000ULL
+#define BID128_SPECIAL_MASK 0x7c00000000000000ULL
+#define BID128_INF 0x7800000000000000ULL
+#define BID128_EXP_MASK 0x7ffe000000000000ULL
+#define BID128_COEF_MASK 0x0001ffffffffffffULL
+// High word of 10^34; coefficients whose high word is below this are canonical
+#define BID128_COEF_HI_LIMIT 0x0001ed09bead87c0ULL
+#define BID128_EXP_BIAS 6176
+#define BID128_EXP_MAX 12287
+
+static inline bool phloat_is_simple(const BID_UINT128 &x) {
+    uint8 hi = BID128_HI(x);
+    return (hi & BID128_STEER_MASK) != BID128_STEER_MASK
+        && (hi & BID128_COEF_MASK) < BID128_COEF_HI_LIMIT;
+}
+
+static inline int phloat_exponent(const BID_UINT128 &x) {
+    return (int) ((BID128_HI(x) & BID128_EXP_MASK) >> 49);
+}
+
+// Unpacks a finite x with a coefficient below 2^64 into its coefficient and
+// (biased) exponent. Returns false for anything else.
+static inline bool phloat_unpack(const BID_UINT128 &x, uint8 *coef, int *exp) {
+    uint8 hi = BID128_HI(x);
+    if ((hi & BID128_STEER_MASK) == BID128_STEER_MASK
+            || (hi & BID128_COEF_MASK) != 0)
+        return false;
+    *coef = BID128_LO(x);
+    *exp = phloat_exponent(x);
+    return true;
+}
+
+extern const uint8 phloat_pow10[20];
+
+static inline void phloat_set_int(BID_UINT128 *x, bool neg, uint8 mag) {
+    BID128_HI(*x) = (neg ? BID128_SIGN_MASK : 0) | ((uint8) BID128_EXP_BIAS << 49);
+    BID128_LO(*x) = mag;
+}
+
+// Three-way comparison, for the cases that can be decided from the encoding
+// alone: zeros, opposite signs, and equal exponents. Returns -1, 0, or 1, or
+// 2 if the library has to decide.
+static inline int phloat_fast_cmp(const BID_UINT128 &a, const BID_UINT128 &b) {
+    if (!phloat_is_simple(a) || !phloat_is_simple(b))
+        return 2;
+    uint8 ah = BID128_HI(a) & BID128_COEF_MASK, al = BID128_LO(a);
+    uint8 bh = BID128_HI(b) & BID128_COEF_MASK, bl = BID128_LO(b);
+    int as = (ah | al) == 0 ? 0 : (BID128_HI(a) & BID128_SIGN_MASK) ? -1 : 1;
+    int bs = (bh | bl) == 0 ? 0 : (BID128_HI(b) & BID128_SIGN_MASK) ? -1 : 1;
+    if (as != bs || as == 0)
+        return as < bs ? -1 : as > bs ? 1 : 0;
+    if (phloat_exponent(a) != phloat_exponent(b))
+        return 2;
+    int c = ah != bh ? (ah < bh ? -1 : 1) : al != bl ? (al < bl ? -1 : 1) : 0;
+    return as < 0 ? -c : c;
+}
+
+// Exact a + b (or a - b) when both have the same exponent and coefficients
+// below 2^62, so the result needs neither alignment nor rounding. Returns
+// false if the library has to do it.
+static inline bool phloat_fast_add(const BID_UINT128 &a, const BID_UINT128 &b,
+                                   bool subtract, BID_UINT128 *res) {
+    uint8 ah = BID128_HI(a), bh = BID128_HI(b);
+    uint8 al = BID128_LO(a), bl = BID128_LO(b);
+    if ((ah & BID128_STEER_MASK) == BID128_STEER_MASK
+            || ((ah ^ bh) & BID128_EXP_MASK) != 0
+            || ((ah | bh) & BID128_COEF_MASK) != 0
+            || ((al | bl) >> 62) != 0)
+        return false;
+    uint8 as = ah & BID128_SIGN_MASK;
+    uint8 bs = (subtract ? ~bh : bh) & BID128_SIGN_MASK;
+    uint8 sign;
+    if (as == bs) {
+        al += bl;
+        sign = as;
+    } else if (al >= bl) {
+        // x + -x is +0 when rounding to nearest
+        sign = al == bl ? 0 : as;
+        al -= bl;
+    } else {
+        al = bl - al;
+        sign = bs;
+    }
+    BID128_HI(*res) = sign | (ah & BID128_EXP_MASK);
+    BID128_LO(*res) = al;
+    return true;
+}
+
+// Exact a * b when both coefficients are below 2^32 and the exponent of the
+// product is in range. Returns false if the library has to do it.
+static inline bool phloat_fast_mul(const BID_UINT128 &a, const BID_UINT128 &b,
+                                   BID_UINT128 *res) {
+    uint8 ah = BID128_HI(a), bh = BID128_HI(b);
+    uint8 al = BID128_LO(a), bl = BID128_LO(b);
+    if ((ah & BID128_STEER_MASK) == BID128_STEER_MASK
+            || (bh & BID128_STEER_MASK) == BID128_STEER_MASK
+            || ((ah | bh) & BID128_COEF_MASK) != 0
+            || ((al | bl) >> 32) != 0)
+        return false;
+    int e = phloat_exponent(a) + phloat_exponent(b) - BID128_EXP_BIAS;
+    if (e < 0 || e > BID128_EXP_MAX)
+        return false;
+    BID128_HI(*res) = ((ah ^ bh) & BID128_SIGN_MASK) | ((uint8) e << 49);
+    BID128_LO(*res) = al * bl;
+    return true;
+}
+
+// Exact a + b (or a - b) for coefficients below 2^62 whose exponents are
+// close enough to be aligned in 64 bits; the out-of-line follow-up to
+// phloat_fast_add(). Returns false if the library has to do it.
+bool phloat_exact_add(const BID_UINT128 &a, const BID_UINT128 &b,
+                      bool subtract, BID_UINT128 *res);
+
 class Phloat {
     public:
         BID_UINT128 val;
@@ -76,42 +222,112 @@ class Phloat {
         Phloat(const char *str);
         Phloat(int numer, int denom);
         Phloat(int8 numer, int8 denom);
-        Phloat(int i);
-        Phloat(int8 i);
-        Phloat(uint8 i);
+        Phloat(int i) { phloat_set_int(&val, i < 0, i < 0 ? 0 - (uint8) i : i); }
+        Phloat(int8 i) { phloat_set_int(&val, i < 0, i < 0 ? 0 - (uint8) i : i); }
+        Phloat(uint8 i) { phloat_set_int(&val, false, i); }
         Phloat(double d);
-        Phloat(const Phloat &p);
+        Phloat(const Phloat &p) : val(p.val) {}
         Phloat operator=(const BID_UINT128 &b) { val = b; return *this; }
-        Phloat operator=(int i);
-        Phloat operator=(int8 i);
-        Phloat operator=(uint8 i);
+        Phloat operator=(int i) { *this = Phloat(i); return *this; }
+        Phloat operator=(int8 i) { *this = Phloat(i); return *this; }
+        Phloat operator=(uint8 i) { *this = Phloat(i); return *this; }
         Phloat operator=(double d);
-        Phloat operator=(Phloat p);
-        bool operator==(Phloat p) const;
-        bool operator!=(Phloat p) const;
-        bool operator<(Phloat p) const;
-        bool operator<=(Phloat p) const;
-        bool operator>(Phloat p) const;
-        bool operator>=(Phloat p) const;
-        Phloat operator-() const;
-        Phloat operator*(Phloat p) const;
-        Phloat operator/(Phloat p) const;
-        Phloat operator+(Phloat p) const;
-        Phloat operator-(Phloat p) const;
-        Phloat operator*=(Phloat p);
-        Phloat operator/=(Phloat p);
-        Phloat operator+=(Phloat p);
-        Phloat operator-=(Phloat p);
-        Phloat operator++(); // prefix
-        Phloat operator++(int); // postfix
-        Phloat operator--(); // prefix
-        Phloat operator--(int); // postfix
+        Phloat operator=(const Phloat &p) { val = p.val; return *this; }
+        bool operator==(const Phloat &p) const {
+            int c = phloat_fast_cmp(val, p.val);
+            if (c != 2)
+                return c == 0;
+            int r;
+            bid128_quiet_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return r != 0;
+        }
+        bool operator!=(const Phloat &p) const {
+            int c = phloat_fast_cmp(val, p.val);
+            if (c != 2)
+                return c != 0;
+            int r;
+            bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return r != 0;
+        }
+        bool operator<(const Phloat &p) const {
+            int c = phloat_fast_cmp(val, p.val);
+            if (c != 2)
+                return c < 0;
+            int r;
+            bid128_quiet_less(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return r != 0;
+        }
+        bool operator<=(const Phloat &p) const {
+            int c = phloat_fast_cmp(val, p.val);
+            if (c != 2)
+                return c <= 0;
+            int r;
+            bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return r != 0;
+        }
+        bool operator>(const Phloat &p) const {
+            int c = phloat_fast_cmp(val, p.val);
+            if (c != 2)
+                return c > 0;
+            int r;
+            bid128_quiet_greater(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return r != 0;
+        }
+        bool operator>=(const Phloat &p) const {
+            int c = phloat_fast_cmp(val, p.val);
+            if (c != 2)
+                return c >= 0;
+            int r;
+            bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return r != 0;
+        }
+        Phloat operator-() const {
+            Phloat res(*this);
+            BID128_HI(res.val) ^= BID128_SIGN_MASK;
+            return res;
+        }
+        Phloat operator*(const Phloat &p) const {
+            BID_UINT128 res;
+            if (!phloat_fast_mul(val, p.val, &res))
+                bid128_mul(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return Phloat(res);
+        }
+        Phloat operator/(const Phloat &p) const;
+        Phloat operator+(const Phloat &p) const {
+            BID_UINT128 res;
+            if (!phloat_fast_add(val, p.val, false, &res)
+                    && !phloat_exact_add(val, p.val, false, &res))
+                bid128_add(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return Phloat(res);
+        }
+        Phloat operator-(const Phloat &p) const {
+            BID_UINT128 res;
+            if (!phloat_fast_add(val, p.val, true, &res)
+                    && !phloat_exact_add(val, p.val, true, &res))
+                bid128_sub(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
+            return Phloat(res);
+        }
+        Phloat operator*=(const Phloat &p) { *this = *this * p; return *this; }
+        Phloat operator/=(const Phloat &p);
+        Phloat operator+=(const Phloat &p) { *this = *this + p; return *this; }
+        Phloat operator-=(const Phloat &p) { *this = *this - p; return *this; }
+        Phloat operator++() { *this = *this + Phloat(1); return *this; } // prefix
+        Phloat operator++(int) { Phloat old = *this; *this = old + Phloat(1); return old; } // postfix
+        Phloat operator--() { *this = *this - Phloat(1); return *this; } // prefix
+        Phloat operator--(int) { Phloat old = *this; *this = old - Phloat(1); return old; } // postfix
 };
 
 // I can't simply overload isinf() and isnan(), because the Linux math.h
 // defines them as macros.
-int p_isinf(Phloat p);
-int p_isnan(Phloat p);
+inline int p_isinf(const Phloat &p) {
+    uint8 hi = BID128_HI(p.val);
+    if ((hi & BID128_SPECIAL_MASK) != BID128_INF)
+        return 0;
+    return (hi & BID128_SIGN_MASK) ? -1 : 1;
+}
+inline int p_isnan(const Phloat &p) {
+    return (BID128_HI(p.val) & BID128_SPECIAL_MASK) == BID128_SPECIAL_MASK;
+}
 
 // We don't define type cast operators, because they just lead
 // to tons of ambiguities. Defining explicit conversions instead.
@@ -126,6 +342,10 @@ int4 to_int4(Phloat p);
 int8 to_int8(Phloat p);
 uint8 to_uint8(Phloat p);
 double to_double(Phloat p);
+// Truncates p toward zero using 64-bit integer arithmetic, if p is finite,
+// its coefficient is below 2^63, and the result fits in an int8; 'exact' is
+// set to whether p was integral. Returns false if the library has to do it.
+bool phloat_trunc_int8(const Phloat &p, int8 *res, bool *exact = NULL);
 
 Phloat sin(Phloat p);
 Phloat cos(Phloat p);
@@ -150,19 +370,63 @@ Phloat expm1(Phloat p);
 Phloat tgamma(Phloat p);
 Phloat sqrt(Phloat p);
 Phloat fmod(Phloat x, Phloat y);
-Phloat fabs(Phloat p);
+inline Phloat fabs(const Phloat &p) {
+    Phloat res(p);
+    BID128_HI(res.val) &= ~BID128_SIGN_MASK;
+    return res;
+}
 Phloat pow(Phloat x, Phloat y);
 Phloat floor(Phloat x);
 
-Phloat operator*(int x, Phloat y);
-Phloat operator/(int x, Phloat y);
-Phloat operator/(double x, Phloat y);
-Phloat operator+(int x, Phloat y);
-Phloat operator-(int x, Phloat y);
-bool operator==(int4 x, Phloat y);
+inline Phloat operator*(int x, const Phloat &y) { return Phloat(x) * y; }
+inline Phloat operator/(int x, const Phloat &y) { return Phloat(x) / y; }
+Phloat operator/(double x, const Phloat &y);
+inline Phloat operator+(int x, const Phloat &y) { return Phloat(x) + y; }
+inline Phloat operator-(int x, const Phloat &y) { return Phloat(x) - y; }
+inline bool operator==(int4 x, const Phloat &y) { return Phloat(x) == y; }
 
 extern Phloat PI;
 
+// Accumulator for sums of products, used by matrix multiplication, DOT, the
+// norms, and the LU decomposition and back-substitution loops. The products
+// are added exactly, in a 288-bit two's complement coefficient with a common
+// exponent, and the sum is rounded only once, by dot_result(). Terms that
+// cannot be aligned within that width, infinities, and NaNs are added to
+// 'rest' using ordinary Phloat arithmetic instead. Once anything has gone to
+// 'rest', the result is rounded twice: those terms are rounded as they are
+// added, and the exact part is rounded again before it is added to them, so
+// the result is no longer correctly rounded. batch/tests/bid_kernels_test
+// allows 5 ulps for these cases; after cancellation against the rounded
+// terms, the error can be larger still.
+struct dot_acc {
+    uint4 coef[9];
+    int exp;
+    bool empty;
+    bool has_rest;
+    Phloat rest;
+};
+
+void dot_init(dot_acc *acc, const Phloat &x = 0);
+void dot_add(dot_acc *acc, const Phloat &x, const Phloat &y);
+void dot_sub(dot_acc *acc, const Phloat &x, const Phloat &y);
+Phloat dot_result(const dot_acc *acc);
+// Complex terms; here all four products are accumulated exactly.
+void dot_add_complex(dot_acc *re, dot_acc *im, const Phloat &xre,
+                     const Phloat &xim, const Phloat &yre, const Phloat &yim);
+void dot_sub_complex(dot_acc *re, dot_acc *im, const Phloat &xre,
+                     const Phloat &xim, const Phloat &yre, const Phloat &yim);
+
+// Element-wise kernels for the matrix mappers: z[i] = y[i] + x[i] (or
+// y[i] - x[i]), and z[i] = y[i] * x[i]. An increment of 0 means that operand
+// is a scalar. Exact results with 64-bit coefficients are computed inline,
+// also when the exponents differ; only the rest goes through the library.
+// They return true if any element went through the library, since only
+// those can have overflowed.
+bool phloat_array_add(const Phloat *x, int xinc, const Phloat *y, int yinc,
+                      Phloat *z, int4 n, bool subtract);
+bool phloat_array_mul(const Phloat *x, int xinc, const Phloat *y, int yinc,
+                      Phloat *z, int4 n);
+
 void update_decimal(BID_UINT128 *val);
 
 
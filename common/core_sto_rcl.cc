@@ -22,6 +22,13 @@
 #include "core_sto_rcl.h"
 #include "core_variables.h"
 
+#if !defined(BCD_MATH) && (defined(__SSE2__) || defined(_M_X64) \
+                            || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define ARRAY_SSE2 1
+#include <float.h>
+#include <emmintrin.h>
+#endif
+
 
 static int apply_sto_operation(char operation, vartype *oldval);
 static void generic_sto_completion(int error, vartype *res);
@@ -65,7 +72,8 @@ int generic_div(const vartype *px, const vartype *py, void (*completion)(int, va
         return linalg_div(py, px, completion);
     } else {
         vartype *dst;
-        int error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc);
+        int error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc,
+                                                        array_div_rr);
         completion(error, dst);
         return error;
     }
@@ -80,7 +88,8 @@ int generic_mul(const vartype *px, const vartype *py, void (*completion)(int, va
         return linalg_mul(py, px, completion);
     } else {
         vartype *dst;
-        int error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc);
+        int error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc,
+                                                        array_mul_rr);
         completion(error, dst);
         return error;
     }
@@ -165,7 +174,8 @@ int generic_sub(const vartype *px, const vartype *py, vartype **dst) {
     } else if (px->type == TYPE_STRING || py->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
     else
-        return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc);
+        return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc,
+                                                        array_sub_rr);
 }
 
 int generic_add(const vartype *px, const vartype *py, vartype **dst) {
@@ -246,10 +256,16 @@ int generic_add(const vartype *px, const vartype *py, vartype **dst) {
     } else if (px->type == TYPE_STRING || py->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
     else
-        return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc);
+        return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc,
+                                                        array_add_rr);
 }
 
-int generic_rcl(arg_struct *arg, vartype **dst) {
+int rcl_source(arg_struct *arg, vartype **src) {
+    /* Resolves indirect arguments, and for stack registers and variables,
+     * returns the value to be recalled, without copying it. For numbered
+     * registers, *src is set to NULL, and generic_rcl() should be used to
+     * get the value.
+     */
     int err;
     if (arg->type == ARGTYPE_IND_NUM
             || arg->type == ARGTYPE_IND_STK
@@ -258,6 +274,40 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
         if (err != ERR_NONE)
             return err;
     }
+    *src = NULL;
+    switch (arg->type) {
+        case ARGTYPE_STK: {
+            switch (arg->val.stk) {
+                case 'X': *src = reg_x; break;
+                case 'Y': *src = reg_y; break;
+                case 'Z': *src = reg_z; break;
+                case 'T': *src = reg_t; break;
+                case 'L': *src = reg_lastx; break;
+            }
+            return ERR_NONE;
+        }
+        case ARGTYPE_STR: {
+            *src = recall_var(arg->val.text, arg->length);
+            if (*src == NULL)
+                return ERR_NONEXISTENT;
+            return ERR_NONE;
+        }
+        default:
+            return ERR_NONE;
+    }
+}
+
+int generic_rcl(arg_struct *arg, vartype **dst) {
+    vartype *src;
+    int err = rcl_source(arg, &src);
+    if (err != ERR_NONE)
+        return err;
+    if (src != NULL) {
+        *dst = dup_vartype(src);
+        if (*dst == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        return ERR_NONE;
+    }
     switch (arg->type) {
         case ARGTYPE_NUM: {
             vartype *regs = recall_var("REGS", 4);
@@ -270,8 +320,8 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
                 phloat ds;
                 if (index >= size)
                     return ERR_SIZE_ERROR;
-                ds = rm->array->data[index];
-                if (rm->array->is_string[index])
+                ds = *matrix_element(rm->array, index);
+                if (IS_STRING(rm->array, index))
                     *dst = new_string(phloat_text(ds), phloat_length(ds));
                 else
                     *dst = new_real(ds);
@@ -283,8 +333,8 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
                 int4 size = cm->rows * cm->columns;
                 if (arg->val.num >= size)
                     return ERR_SIZE_ERROR;
-                *dst = new_complex(cm->array->data[arg->val.num * 2],
-                                cm->array->data[arg->val.num * 2 + 1]);
+                *dst = new_complex(matrix_element(cm->array, arg->val.num)[0],
+                                matrix_element(cm->array, arg->val.num)[1]);
                 if (*dst == NULL)
                     return ERR_INSUFFICIENT_MEMORY;
                 return ERR_NONE;
@@ -296,28 +346,6 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
                 return ERR_INTERNAL_ERROR;
             }
         }
-        case ARGTYPE_STK: {
-            switch (arg->val.stk) {
-                case 'X': *dst = reg_x; break;
-                case 'Y': *dst = reg_y; break;
-                case 'Z': *dst = reg_z; break;
-                case 'T': *dst = reg_t; break;
-                case 'L': *dst = reg_lastx; break;
-            }
-            *dst = dup_vartype(*dst);
-            if (*dst == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            return ERR_NONE;
-        }
-        case ARGTYPE_STR: {
-            *dst = recall_var(arg->val.text, arg->length);
-            if (*dst == NULL)
-                return ERR_NONEXISTENT;
-            *dst = dup_vartype(*dst);
-            if (*dst == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            return ERR_NONE;
-        }
         default:
             return ERR_INTERNAL_ERROR;
     }
@@ -389,31 +417,34 @@ int generic_sto(arg_struct *arg, char operation) {
                 int4 num = arg->val.num;
                 if (num >= size)
                     return ERR_SIZE_ERROR;
+                if (operation == 0 && element_unchanged(regs, num, reg_x))
+                    return ERR_NONE;
                 if (reg_x->type == TYPE_STRING) {
-                    if (!disentangle((vartype *) rm))
+                    if (!disentangle_element((vartype *) rm, num))
                         return ERR_INSUFFICIENT_MEMORY;
                     vartype_string *vs = (vartype_string *) reg_x;
-                    phloat *ds = rm->array->data + num;
+                    phloat *ds = matrix_element(rm->array, num);
                     int len, i;
                     len = vs->length;
                     phloat_length(*ds) = len;
                     for (i = 0; i < len; i++)
                         phloat_text(*ds)[i] = vs->text[i];
-                    rm->array->is_string[num] = 1;
+                    set_is_string(rm->array, num, true);
                     return ERR_NONE;
                 } else if (reg_x->type == TYPE_REAL) {
-                    if (!disentangle((vartype *) rm))
+                    if (!disentangle_element((vartype *) rm, num))
                         return ERR_INSUFFICIENT_MEMORY;
                     if (operation == 0) {
-                        rm->array->data[num] = ((vartype_real *) reg_x)->x;
-                        rm->array->is_string[num] = 0;
+                        *matrix_element(rm->array, num) =
+                                ((vartype_real *) reg_x)->x;
+                        set_is_string(rm->array, num, false);
                     } else {
                         phloat x, n;
                         int inf;
-                        if (rm->array->is_string[num])
+                        if (IS_STRING(rm->array, num))
                             return ERR_ALPHA_DATA_IS_INVALID;
                         x = ((vartype_real *) reg_x)->x;
-                        n = rm->array->data[num];
+                        n = *matrix_element(rm->array, num);
                         switch (operation) {
                             case '/': if (x == 0) return ERR_DIVIDE_BY_0;
                                       n /= x; break;
@@ -429,7 +460,7 @@ int generic_sto(arg_struct *arg, char operation) {
                             else
                                 return ERR_OUT_OF_RANGE;
                         }
-                        rm->array->data[num] = n;
+                        *matrix_element(rm->array, num) = n;
                     }
                     return ERR_NONE;
                 } else
@@ -446,7 +477,9 @@ int generic_sto(arg_struct *arg, char operation) {
                 else if (reg_x->type != TYPE_REAL
                         && reg_x->type != TYPE_COMPLEX)
                     return ERR_INVALID_TYPE;
-                if (!disentangle((vartype *) cm))
+                if (operation == 0 && element_unchanged(regs, num, reg_x))
+                    return ERR_NONE;
+                if (!disentangle_element((vartype *) cm, num))
                     return ERR_INSUFFICIENT_MEMORY;
                 if (operation == 0) {
                     if (reg_x->type == TYPE_REAL) {
@@ -456,11 +489,11 @@ int generic_sto(arg_struct *arg, char operation) {
                         re = ((vartype_complex *) reg_x)->re;
                         im = ((vartype_complex *) reg_x)->im;
                     }
-                    cm->array->data[num * 2] = re;
-                    cm->array->data[num * 2 + 1] = im;
+                    matrix_element(cm->array, num)[0] = re;
+                    matrix_element(cm->array, num)[1] = im;
                 } else {
-                    phloat nre = cm->array->data[num * 2];
-                    phloat nim = cm->array->data[num * 2 + 1];
+                    phloat nre = matrix_element(cm->array, num)[0];
+                    phloat nim = matrix_element(cm->array, num)[1];
                     int inf;
                     if (reg_x->type == TYPE_REAL) {
                         phloat x;
@@ -517,8 +550,8 @@ int generic_sto(arg_struct *arg, char operation) {
                         else
                             return ERR_OUT_OF_RANGE;
                     }
-                    cm->array->data[num * 2] = nre;
-                    cm->array->data[num * 2 + 1] = nim;
+                    matrix_element(cm->array, num)[0] = nre;
+                    matrix_element(cm->array, num)[1] = nim;
                 }
                 return ERR_NONE;
             } else {
@@ -616,7 +649,8 @@ int generic_sto(arg_struct *arg, char operation) {
     }
 }
 
-int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
+int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc,
+                                                                array_r ar) {
     int error;
     switch (src->type) {
         case TYPE_REAL: {
@@ -649,18 +683,24 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
             if (dm == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
             size = sm->rows * sm->columns;
-            for (i = 0; i < size; i++) {
-                if (sm->array->is_string[i]) {
-                    free_vartype((vartype *) dm);
-                    return ERR_ALPHA_DATA_IS_INVALID;
-                }
+            if (!contains_no_strings(sm)) {
+                free_vartype((vartype *) dm);
+                return ERR_ALPHA_DATA_IS_INVALID;
             }
-            for (i = 0; i < size; i++) {
-                error = mr(sm->array->data[i], &dm->array->data[i]);
+            if (ar != NULL) {
+                error = ar(matrix_data(sm->array), dm->array->data, size);
                 if (error != ERR_NONE) {
                     free_vartype((vartype *) dm);
                     return error;
                 }
+            } else {
+                for (i = 0; i < size; i++) {
+                    error = mr(matrix_data(sm->array)[i], &dm->array->data[i]);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
+                    }
+                }
             }
             *dst = (vartype *) dm;
             return ERR_NONE;
@@ -676,8 +716,9 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
             dm = (vartype_complexmatrix *) new_complexmatrix(rows, columns);
             if (dm == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
+            phloat *sdata = matrix_data(sm->array);
             for (i = 0; i < size; i += 2) {
-                error = mc(sm->array->data[i], sm->array->data[i + 1],
+                error = mc(sdata[i], sdata[i + 1],
                            &dm->array->data[i], &dm->array->data[i + 1]);
                 if (error != ERR_NONE) {
                     free_vartype((vartype *) dm);
@@ -693,7 +734,8 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
 }
 
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
-        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc) {
+        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+        array_rr arr) {
     int error;
     switch (src1->type) {
         case TYPE_REAL:
@@ -732,19 +774,28 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm->rows * sm->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
-                    for (i = 0; i < size; i++) {
-                        error = mrr(((vartype_real *) src1)->x,
-                                    sm->array->data[i],
-                                    &dm->array->data[i]);
+                    if (!contains_no_strings(sm)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
+                    if (arr != NULL) {
+                        error = arr(&((vartype_real *) src1)->x, 0,
+                                    matrix_data(sm->array), 1,
+                                    matrix_data(dm->array), size);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
                         }
+                    } else {
+                        for (i = 0; i < size; i++) {
+                            error = mrr(((vartype_real *) src1)->x,
+                                        matrix_data(sm->array)[i],
+                                        &matrix_data(dm->array)[i]);
+                            if (error != ERR_NONE) {
+                                free_vartype((vartype *) dm);
+                                return error;
+                            }
+                        }
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -761,10 +812,10 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     size = 2 * sm->rows * sm->columns;
                     for (i = 0; i < size; i += 2) {
                         error = mrc(((vartype_real *) src1)->x,
-                                    sm->array->data[i],
-                                    sm->array->data[i + 1],
-                                    &dm->array->data[i],
-                                    &dm->array->data[i + 1]);
+                                    matrix_data(sm->array)[i],
+                                    matrix_data(sm->array)[i + 1],
+                                    &matrix_data(dm->array)[i],
+                                    &matrix_data(dm->array)[i + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -815,17 +866,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm->rows * sm->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
+                    if (!contains_no_strings(sm)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
                     for (i = 0; i < size; i++) {
                         error = mcr(((vartype_complex *) src1)->re,
                                     ((vartype_complex *) src1)->im,
-                                    sm->array->data[i],
-                                    &dm->array->data[i * 2],
-                                    &dm->array->data[i * 2 + 1]);
+                                    matrix_data(sm->array)[i],
+                                    &matrix_data(dm->array)[i * 2],
+                                    &matrix_data(dm->array)[i * 2 + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -847,10 +897,10 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     for (i = 0; i < size; i += 2) {
                         error = mcc(((vartype_complex *) src1)->re,
                                     ((vartype_complex *) src1)->im,
-                                    sm->array->data[i],
-                                    sm->array->data[i + 1],
-                                    &dm->array->data[i],
-                                    &dm->array->data[i + 1]);
+                                    matrix_data(sm->array)[i],
+                                    matrix_data(sm->array)[i + 1],
+                                    &matrix_data(dm->array)[i],
+                                    &matrix_data(dm->array)[i + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -874,19 +924,28 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm->rows * sm->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
-                    for (i = 0; i < size; i++) {
-                        error = mrr(sm->array->data[i],
-                                    ((vartype_real *) src2)->x,
-                                    &dm->array->data[i]);
+                    if (!contains_no_strings(sm)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
+                    if (arr != NULL) {
+                        error = arr(matrix_data(sm->array), 1,
+                                    &((vartype_real *) src2)->x, 0,
+                                    matrix_data(dm->array), size);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
                         }
+                    } else {
+                        for (i = 0; i < size; i++) {
+                            error = mrr(matrix_data(sm->array)[i],
+                                        ((vartype_real *) src2)->x,
+                                        &matrix_data(dm->array)[i]);
+                            if (error != ERR_NONE) {
+                                free_vartype((vartype *) dm);
+                                return error;
+                            }
+                        }
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -901,17 +960,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm->rows * sm->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
+                    if (!contains_no_strings(sm)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
                     for (i = 0; i < size; i++) {
-                        error = mrc(sm->array->data[i],
+                        error = mrc(matrix_data(sm->array)[i],
                                     ((vartype_complex *) src2)->re,
                                     ((vartype_complex *) src2)->im,
-                                    &dm->array->data[i * 2],
-                                    &dm->array->data[i * 2 + 1]);
+                                    &matrix_data(dm->array)[i * 2],
+                                    &matrix_data(dm->array)[i * 2 + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -933,20 +991,29 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm1->rows * sm1->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm1->array->is_string[i]
-                                    || sm2->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
-                    for (i = 0; i < size; i++) {
-                        error = mrr(sm1->array->data[i],
-                                    sm2->array->data[i],
-                                    &dm->array->data[i]);
+                    if (!contains_no_strings(sm1)
+                                    || !contains_no_strings(sm2)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
+                    if (arr != NULL) {
+                        error = arr(matrix_data(sm1->array), 1,
+                                    matrix_data(sm2->array), 1,
+                                    matrix_data(dm->array), size);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
                         }
+                    } else {
+                        for (i = 0; i < size; i++) {
+                            error = mrr(matrix_data(sm1->array)[i],
+                                        matrix_data(sm2->array)[i],
+                                        &matrix_data(dm->array)[i]);
+                            if (error != ERR_NONE) {
+                                free_vartype((vartype *) dm);
+                                return error;
+                            }
+                        }
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -964,17 +1031,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm1->rows * sm1->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm1->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
+                    if (!contains_no_strings(sm1)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
                     for (i = 0; i < size; i++) {
-                        error = mrc(sm1->array->data[i],
-                                    sm2->array->data[i * 2],
-                                    sm2->array->data[i * 2 + 1],
-                                    &dm->array->data[i * 2],
-                                    &dm->array->data[i * 2 + 1]);
+                        error = mrc(matrix_data(sm1->array)[i],
+                                    matrix_data(sm2->array)[i * 2],
+                                    matrix_data(sm2->array)[i * 2 + 1],
+                                    &matrix_data(dm->array)[i * 2],
+                                    &matrix_data(dm->array)[i * 2 + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -999,11 +1065,11 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_INSUFFICIENT_MEMORY;
                     size = 2 * sm->rows * sm->columns;
                     for (i = 0; i < size; i += 2) {
-                        error = mcr(sm->array->data[i],
-                                    sm->array->data[i + 1],
+                        error = mcr(matrix_data(sm->array)[i],
+                                    matrix_data(sm->array)[i + 1],
                                     ((vartype_real *) src2)->x,
-                                    &dm->array->data[i],
-                                    &dm->array->data[i + 1]);
+                                    &matrix_data(dm->array)[i],
+                                    &matrix_data(dm->array)[i + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -1023,12 +1089,12 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_INSUFFICIENT_MEMORY;
                     size = 2 * sm->rows * sm->columns;
                     for (i = 0; i < size; i += 2) {
-                        error = mcc(sm->array->data[i],
-                                    sm->array->data[i + 1],
+                        error = mcc(matrix_data(sm->array)[i],
+                                    matrix_data(sm->array)[i + 1],
                                     ((vartype_complex *) src2)->re,
                                     ((vartype_complex *) src2)->im,
-                                    &dm->array->data[i],
-                                    &dm->array->data[i + 1]);
+                                    &matrix_data(dm->array)[i],
+                                    &matrix_data(dm->array)[i + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -1050,17 +1116,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
                     size = sm1->rows * sm1->columns;
-                    for (i = 0; i < size; i++)
-                        if (sm2->array->is_string[i]) {
-                            free_vartype((vartype *) dm);
-                            return ERR_ALPHA_DATA_IS_INVALID;
-                        }
+                    if (!contains_no_strings(sm2)) {
+                        free_vartype((vartype *) dm);
+                        return ERR_ALPHA_DATA_IS_INVALID;
+                    }
                     for (i = 0; i < size; i++) {
-                        error = mcr(sm1->array->data[i * 2],
-                                    sm1->array->data[i * 2 + 1],
-                                    sm2->array->data[i],
-                                    &dm->array->data[i * 2],
-                                    &dm->array->data[i * 2 + 1]);
+                        error = mcr(matrix_data(sm1->array)[i * 2],
+                                    matrix_data(sm1->array)[i * 2 + 1],
+                                    matrix_data(sm2->array)[i],
+                                    &matrix_data(dm->array)[i * 2],
+                                    &matrix_data(dm->array)[i * 2 + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -1083,12 +1148,12 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_INSUFFICIENT_MEMORY;
                     size = 2 * sm1->rows * sm1->columns;
                     for (i = 0; i < size; i += 2) {
-                        error = mcc(sm1->array->data[i],
-                                    sm1->array->data[i + 1],
-                                    sm2->array->data[i],
-                                    sm2->array->data[i + 1],
-                                    &dm->array->data[i],
-                                    &dm->array->data[i + 1]);
+                        error = mcc(matrix_data(sm1->array)[i],
+                                    matrix_data(sm1->array)[i + 1],
+                                    matrix_data(sm2->array)[i],
+                                    matrix_data(sm2->array)[i + 1],
+                                    &matrix_data(dm->array)[i],
+                                    &matrix_data(dm->array)[i + 1]);
                         if (error != ERR_NONE) {
                             free_vartype((vartype *) dm);
                             return error;
@@ -1436,3 +1501,231 @@ int add_cc(phloat xre, phloat xim, phloat yre, phloat yim,
     *zim = rim;
     return ERR_NONE;
 }
+
+
+/* Whole-array kernels
+ *
+ * These compute the same results as the per-element functions above, but
+ * do all the arithmetic first and apply the divide-by-zero, domain, and
+ * range checks in separate passes, so the arithmetic loops carry no error
+ * handling. In the binary build, they use SSE2 when the target has it;
+ * in the decimal build, +, -, and * use the batch kernels in core_phloat,
+ * and skip the overflow scan when no element needed the BID library.
+ * The error returned is always the one the element-by-element mapping
+ * would have run into first.
+ */
+
+#ifdef ARRAY_SSE2
+static inline __m128d array_load(const double *p, int inc, int4 i) {
+    return inc == 0 ? _mm_set1_pd(*p) : _mm_loadu_pd(p + i);
+}
+#endif
+
+/* Returns the index of the first infinite element of z, or n */
+static int4 array_first_inf(const phloat *z, int4 n) {
+    int4 i = 0;
+#ifdef ARRAY_SSE2
+    __m128d sign = _mm_set1_pd(-0.0);
+    __m128d max = _mm_set1_pd(DBL_MAX);
+    for (; i + 2 <= n; i += 2) {
+        __m128d a = _mm_andnot_pd(sign, _mm_loadu_pd(z + i));
+        if (_mm_movemask_pd(_mm_cmpgt_pd(a, max)) != 0)
+            break;
+    }
+#endif
+    for (; i < n; i++)
+        if (p_isinf(z[i]) != 0)
+            break;
+    return i;
+}
+
+/* Returns the index of the first zero element of x, or n */
+static int4 array_first_zero(const phloat *x, int xinc, int4 n) {
+    int4 i = 0;
+    if (xinc == 0)
+        return *x == 0 ? 0 : n;
+#ifdef ARRAY_SSE2
+    __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2)
+        if (_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(x + i), zero)) != 0)
+            break;
+#endif
+    for (; i < n; i++)
+        if (x[i] == 0)
+            break;
+    return i;
+}
+
+/* Returns the index of the first negative element of x, or n */
+static int4 array_first_negative(const phloat *x, int4 n) {
+    int4 i = 0;
+#ifdef ARRAY_SSE2
+    __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2)
+        if (_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(x + i), zero)) != 0)
+            break;
+#endif
+    for (; i < n; i++)
+        if (x[i] < 0)
+            break;
+    return i;
+}
+
+/* Applies the range error policy to a result array. Elements from 'bad'
+ * onward were not computed because element 'bad' had invalid operands,
+ * which is reported as 'bad_err' unless an earlier element overflowed;
+ * bad == n means all operands were valid.
+ */
+static int array_finish(phloat *z, int4 n, int4 bad, int bad_err) {
+    int4 i = array_first_inf(z, bad);
+    if (i < bad && !flags.f.range_error_ignore)
+        return ERR_OUT_OF_RANGE;
+    if (bad < n)
+        return bad_err;
+    for (; i < n; i++) {
+        int inf = p_isinf(z[i]);
+        if (inf != 0)
+            z[i] = inf == 1 ? POS_HUGE_PHLOAT : NEG_HUGE_PHLOAT;
+    }
+    return ERR_NONE;
+}
+
+/* z[i] = y[i] OP x[i], for the first 'count' elements, where either
+ * operand may be a scalar (increment 0).
+ */
+#ifdef ARRAY_SSE2
+#define ARRAY_LOOP_RR(count, vop, op) do { \
+    int4 i = 0; \
+    for (; i + 2 <= count; i += 2) \
+        _mm_storeu_pd(z + i, vop(array_load(y, yinc, i), \
+                                 array_load(x, xinc, i))); \
+    for (; i < count; i++) \
+        z[i] = y[i * yinc] op x[i * xinc]; \
+} while (0)
+#else
+#define ARRAY_LOOP_RR(count, vop, op) do { \
+    int4 i; \
+    if (xinc == 0) { \
+        phloat xs = *x; \
+        for (i = 0; i < count; i++) \
+            z[i] = y[i] op xs; \
+    } else if (yinc == 0) { \
+        phloat ys = *y; \
+        for (i = 0; i < count; i++) \
+            z[i] = ys op x[i]; \
+    } else { \
+        for (i = 0; i < count; i++) \
+            z[i] = y[i] op x[i]; \
+    } \
+} while (0)
+#endif
+
+int array_div_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n) {
+    int4 bad = array_first_zero(x, xinc, n);
+    ARRAY_LOOP_RR(bad, _mm_div_pd, /);
+    return array_finish(z, n, bad, ERR_DIVIDE_BY_0);
+}
+
+int array_mul_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n) {
+#ifdef BCD_MATH
+    if (!phloat_array_mul(x, xinc, y, yinc, z, n))
+        return ERR_NONE;
+#else
+    ARRAY_LOOP_RR(n, _mm_mul_pd, *);
+#endif
+    return array_finish(z, n, n, ERR_NONE);
+}
+
+int array_sub_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n) {
+#ifdef BCD_MATH
+    if (!phloat_array_add(x, xinc, y, yinc, z, n, true))
+        return ERR_NONE;
+#else
+    ARRAY_LOOP_RR(n, _mm_sub_pd, -);
+#endif
+    return array_finish(z, n, n, ERR_NONE);
+}
+
+int array_add_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n) {
+#ifdef BCD_MATH
+    if (!phloat_array_add(x, xinc, y, yinc, z, n, false))
+        return ERR_NONE;
+#else
+    ARRAY_LOOP_RR(n, _mm_add_pd, +);
+#endif
+    return array_finish(z, n, n, ERR_NONE);
+}
+
+int array_chs_r(const phloat *x, phloat *z, int4 n) {
+    int4 i = 0;
+#ifdef ARRAY_SSE2
+    __m128d sign = _mm_set1_pd(-0.0);
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(z + i, _mm_xor_pd(_mm_loadu_pd(x + i), sign));
+#endif
+    for (; i < n; i++)
+        z[i] = -x[i];
+    return ERR_NONE;
+}
+
+int array_abs_r(const phloat *x, phloat *z, int4 n) {
+    int4 i = 0;
+#ifdef ARRAY_SSE2
+    /* Only flip negative elements, so that -0 stays -0, like ABS on
+     * a real does
+     */
+    __m128d sign = _mm_set1_pd(-0.0);
+    __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) {
+        __m128d a = _mm_loadu_pd(x + i);
+        __m128d neg = _mm_cmplt_pd(a, zero);
+        _mm_storeu_pd(z + i, _mm_xor_pd(a, _mm_and_pd(neg, sign)));
+    }
+#endif
+    for (; i < n; i++)
+        z[i] = x[i] < 0 ? -x[i] : x[i];
+    return ERR_NONE;
+}
+
+int array_sqrt_r(const phloat *x, phloat *z, int4 n) {
+    int4 i = 0;
+    if (array_first_negative(x, n) < n)
+        return ERR_INVALID_DATA;
+#ifdef ARRAY_SSE2
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(z + i, _mm_sqrt_pd(_mm_loadu_pd(x + i)));
+#endif
+    for (; i < n; i++)
+        z[i] = sqrt(x[i]);
+    return ERR_NONE;
+}
+
+int array_square_r(const phloat *x, phloat *z, int4 n) {
+    int4 i = 0;
+#ifdef ARRAY_SSE2
+    for (; i + 2 <= n; i += 2) {
+        __m128d a = _mm_loadu_pd(x + i);
+        _mm_storeu_pd(z + i, _mm_mul_pd(a, a));
+    }
+#endif
+    for (; i < n; i++)
+        z[i] = x[i] * x[i];
+    return array_finish(z, n, n, ERR_NONE);
+}
+
+int array_inv_r(const phloat *x, phloat *z, int4 n) {
+    int4 i = 0;
+    int4 bad = array_first_zero(x, 1, n);
+#ifdef ARRAY_SSE2
+    __m128d one = _mm_set1_pd(1.0);
+    for (; i + 2 <= bad; i += 2)
+        _mm_storeu_pd(z + i, _mm_div_pd(one, _mm_loadu_pd(x + i)));
+#endif
+    for (; i < bad; i++)
+        z[i] = 1 / x[i];
+    return array_finish(z, n, bad, ERR_DIVIDE_BY_0);
+}
@@ -45,6 +45,18 @@ typedef int (*mappable_cc)(phloat xre, phloat xim, phloat yre, phloat yim,
                                                 phloat *zre, phloat *zim);
 
 
+/******************************************************************/
+/* Signatures for whole-array kernels, which map_unary and        */
+/* map_binary use instead of the per-element functions for real   */
+/* matrices when available. An increment of 0 means the operand   */
+/* is a scalar, 1 means it is an array of n elements.             */
+/******************************************************************/
+
+typedef int (*array_r)(const phloat *x, phloat *z, int4 n);
+typedef int (*array_rr)(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n);
+
+
 /****************************************************************/
 /* Generic arithmetic operators, for use in the implementations */
 /* of +, -, *, /, STO+, STO-, etc...                            */
@@ -56,6 +68,7 @@ int generic_mul(const vartype *x, const vartype *y,
                             void (*completion)(int, vartype *));
 int generic_sub(const vartype *x, const vartype *y, vartype **res);
 int generic_add(const vartype *x, const vartype *y, vartype **res);
+int rcl_source(arg_struct *arg, vartype **src);
 int generic_rcl(arg_struct *arg, vartype **dst);
 int generic_sto(arg_struct *arg, char operation);
 
@@ -65,9 +78,11 @@ int generic_sto(arg_struct *arg, char operation);
 /* to arbitrary parameter types               */
 /**********************************************/
 
-int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc);
+int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc,
+            array_r ar = NULL);
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
-            mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc);
+            mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+            array_rr arr = NULL);
 
 /**************************************************************/
 /* Operators that can be used by the mapping functions, above */
@@ -97,4 +112,23 @@ int add_cr(phloat xre, phloat xim, phloat y, phloat *zre, phloat *zim);
 int add_cc(phloat xre, phloat xim, phloat yre, phloat yim,
                                     phloat *zre, phloat *zim);
 
+/*********************************************************/
+/* Whole-array kernels that can be used by the mappers,  */
+/* and by CHS and ABS on real matrices                   */
+/*********************************************************/
+
+int array_div_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n);
+int array_mul_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n);
+int array_sub_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n);
+int array_add_rr(const phloat *x, int xinc, const phloat *y, int yinc,
+                                                phloat *z, int4 n);
+int array_chs_r(const phloat *x, phloat *z, int4 n);
+int array_abs_r(const phloat *x, phloat *z, int4 n);
+int array_sqrt_r(const phloat *x, phloat *z, int4 n);
+int array_square_r(const phloat *x, phloat *z, int4 n);
+int array_inv_r(const phloat *x, phloat *z, int4 n);
+
 #endif
@@ -16,126 +16,651 @@
  *****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core_globals.h"
 #include "core_helpers.h"
 #include "core_display.h"
 #include "core_variables.h"
+#ifdef VARTYPE_DEBUG
+#include <stdio.h>
+#include "core_tables.h"
+#include "shell.h"
+#include "shell_spool.h"
+#endif
 
 
 // We cache vartype_real, vartype_complex, and vartype_string instances, to
-// cut down on the malloc/free overhead.
+// cut down on the malloc/free overhead. The instances are carved out of
+// slabs, which are allocated in increasing sizes as needed; free instances
+// are kept on a list threaded through their first word.
 
-typedef struct pool_real {
-    vartype_real r;
-    struct pool_real *next;
-} pool_real;
+typedef struct pool_node {
+    struct pool_node *next;
+} pool_node;
 
-static pool_real *realpool = NULL;
+typedef struct pool_slab {
+    struct pool_slab *next;
+    /* Keeps the nodes that follow the header suitably aligned */
+    phloat align;
+} pool_slab;
 
-typedef struct pool_complex {
-    vartype_complex c;
-    struct pool_complex *next;
-} pool_complex;
+#define POOL_MIN_SLAB 64
+#define POOL_MAX_SLAB 4096
 
-static pool_complex *complexpool = NULL;
+typedef struct {
+    int node_size;
+    int4 next_slab;
+    pool_node *free_list;
+    pool_slab *slabs;
+    int4 live;
+    int4 free;
+    int4 bytes;
+} vartype_pool;
 
-typedef struct pool_string {
-    vartype_string s;
-    struct pool_string *next;
-} pool_string;
+static vartype_pool realpool = { sizeof(vartype_real), POOL_MIN_SLAB, NULL, NULL, 0, 0, 0 };
+static vartype_pool complexpool = { sizeof(vartype_complex), POOL_MIN_SLAB, NULL, NULL, 0, 0, 0 };
+static vartype_pool stringpool = { sizeof(vartype_string), POOL_MIN_SLAB, NULL, NULL, 0, 0, 0 };
+static vartype_pool realmatrixpool = { sizeof(vartype_realmatrix), POOL_MIN_SLAB, NULL, NULL, 0, 0, 0 };
+static vartype_pool complexmatrixpool = { sizeof(vartype_complexmatrix), POOL_MIN_SLAB, NULL, NULL, 0, 0, 0 };
 
-static pool_string *stringpool = NULL;
+#ifdef VARTYPE_DEBUG
 
-vartype *new_real(phloat value) {
-    pool_real *r;
-    if (realpool == NULL) {
-        r = (pool_real *) malloc(sizeof(pool_real));
-        if (r == NULL)
+/* Debug build (-DVARTYPE_DEBUG): the pools are bypassed, and every vartype
+ * is malloc()ed by itself, behind a header recording the command, program,
+ * and pc that were executing when it was allocated, and when it was freed.
+ * Live instances are kept on a list, which vartype_debug_report() prints;
+ * freed ones are filled with a pattern and kept in quarantine for a while
+ * before they are really freed, so that writes after free_vartype() can be
+ * spotted, and a second free_vartype() of the same instance is caught
+ * instead of corrupting the pool.
+ */
+
+#define VT_LIVE 0x4c495645
+#define VT_FREED 0x46524545
+#define VT_POISON 0xdb
+#define VT_QUARANTINE 4096
+
+typedef struct vt_debug_header {
+    struct vt_debug_header *prev;
+    struct vt_debug_header *next;
+    vartype_pool *pool;
+    uint4 magic;
+    uint4 serial;
+    int cmd, free_cmd;
+    int prgm, free_prgm;
+    int4 pc, free_pc;
+    /* Keeps the instance that follows the header suitably aligned */
+    phloat align;
+} vt_debug_header;
+
+static vt_debug_header vt_live = { &vt_live, &vt_live };
+static vt_debug_header vt_quarantine = { &vt_quarantine, &vt_quarantine };
+static int4 vt_quarantine_count = 0;
+static uint4 vt_serial = 0;
+static int vt_cmd = CMD_NONE;
+static int vt_prgm = -1;
+static int4 vt_pc = -1;
+
+void vartype_debug_origin(int cmd, int prgm, int4 pc) {
+    vt_cmd = cmd;
+    vt_prgm = prgm;
+    vt_pc = pc;
+}
+
+static void vt_unlink(vt_debug_header *h) {
+    h->prev->next = h->next;
+    h->next->prev = h->prev;
+}
+
+static void vt_link(vt_debug_header *list, vt_debug_header *h) {
+    h->prev = list->prev;
+    h->next = list;
+    list->prev->next = h;
+    list->prev = h;
+}
+
+static const char *vt_type_name(const vt_debug_header *h) {
+    vartype_pool *pool = h->pool;
+    return pool == &realpool ? "real"
+            : pool == &complexpool ? "complex"
+            : pool == &stringpool ? "string"
+            : pool == &realmatrixpool ? "real matrix"
+            : "complex matrix";
+}
+
+static int vt_origin(char *buf, int cmd, int prgm, int4 pc) {
+    if (cmd == CMD_NONE)
+        return sprintf(buf, "outside any command");
+    const command_spec *cs = cmdlist(cmd);
+    int n = sprintf(buf, "by ");
+    n += hp2ascii(buf + n, cs->name, cs->name_length);
+    if (prgm != -1)
+        n += sprintf(buf + n, " at %d:%d", prgm, (int) pc);
+    return n;
+}
+
+static void vt_complain(const char *what, const vt_debug_header *h) {
+    char buf[200];
+    int n = sprintf(buf, "vartype: %s: %s #%u, allocated ", what,
+                    vt_type_name(h), h->serial);
+    n += vt_origin(buf + n, h->cmd, h->prgm, h->pc);
+    if (h->magic == VT_FREED) {
+        n += sprintf(buf + n, ", freed ");
+        vt_origin(buf + n, h->free_cmd, h->free_prgm, h->free_pc);
+    }
+    shell_log(buf);
+}
+
+static void vt_check_poison(const vt_debug_header *h) {
+    const unsigned char *p = (const unsigned char *) (h + 1);
+    for (int i = 0; i < h->pool->node_size; i++)
+        if (p[i] != VT_POISON) {
+            vt_complain("written after being freed", h);
+            return;
+        }
+}
+
+static vt_debug_header *vt_header(const vartype *v) {
+    /* Returns the header of a vartype about to be freed, or NULL, after
+     * complaining, if it is not live.
+     */
+    vt_debug_header *h = ((vt_debug_header *) v) - 1;
+    if (h->magic == VT_LIVE)
+        return h;
+    if (h->magic == VT_FREED)
+        vt_complain("freed twice", h);
+    else {
+        char buf[100];
+        sprintf(buf, "vartype: freeing %p, which is not a vartype", v);
+        shell_log(buf);
+    }
+    return NULL;
+}
+
+static void *pool_alloc(vartype_pool *pool) {
+    vt_debug_header *h = (vt_debug_header *)
+                    malloc(sizeof(vt_debug_header) + pool->node_size);
+    if (h == NULL)
+        return NULL;
+    h->pool = pool;
+    h->magic = VT_LIVE;
+    h->serial = ++vt_serial;
+    h->cmd = vt_cmd;
+    h->prgm = vt_prgm;
+    h->pc = vt_pc;
+    vt_link(&vt_live, h);
+    pool->live++;
+    pool->bytes += sizeof(vt_debug_header) + pool->node_size;
+    return h + 1;
+}
+
+static void pool_free(vartype_pool *pool, void *v) {
+    vt_debug_header *h = ((vt_debug_header *) v) - 1;
+    h->magic = VT_FREED;
+    h->free_cmd = vt_cmd;
+    h->free_prgm = vt_prgm;
+    h->free_pc = vt_pc;
+    memset(v, VT_POISON, pool->node_size);
+    vt_unlink(h);
+    vt_link(&vt_quarantine, h);
+    pool->live--;
+    pool->bytes -= sizeof(vt_debug_header) + pool->node_size;
+    if (++vt_quarantine_count > VT_QUARANTINE) {
+        h = vt_quarantine.next;
+        vt_check_poison(h);
+        vt_unlink(h);
+        free(h);
+        vt_quarantine_count--;
+    }
+}
+
+void vartype_debug_report() {
+    /* Called by core_cleanup(), after it has freed everything it knows
+     * about, so anything still live has leaked.
+     */
+    char buf[100];
+    int4 live = 0;
+    for (vt_debug_header *h = vt_live.next; h != &vt_live; h = h->next)
+        if (live++ < 100)
+            vt_complain("still live", h);
+    for (vt_debug_header *h = vt_quarantine.next; h != &vt_quarantine; h = h->next)
+        vt_check_poison(h);
+    int4 blocks;
+    int8 bytes;
+    get_matrix_data_stats(&blocks, &bytes);
+    sprintf(buf, "vartype: %d live, %d matrix blocks (%lld bytes)",
+            (int) live, (int) blocks, (long long) bytes);
+    shell_log(buf);
+}
+
+#else
+
+static bool pool_grow(vartype_pool *pool, int4 n) {
+    int4 size = sizeof(pool_slab) + n * pool->node_size;
+    pool_slab *slab = (pool_slab *) malloc(size);
+    if (slab == NULL)
+        return false;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->bytes += size;
+    char *node = (char *) (slab + 1) + (n - 1) * pool->node_size;
+    for (int4 i = 0; i < n; i++) {
+        pool_node *p = (pool_node *) node;
+        p->next = pool->free_list;
+        pool->free_list = p;
+        node -= pool->node_size;
+    }
+    pool->free += n;
+    return true;
+}
+
+static void *pool_alloc(vartype_pool *pool) {
+    if (pool->free_list == NULL) {
+        if (!pool_grow(pool, pool->next_slab))
             return NULL;
-        r->r.type = TYPE_REAL;
-    } else {
-        r = realpool;
-        realpool = realpool->next;
+        if (pool->next_slab < POOL_MAX_SLAB)
+            pool->next_slab <<= 1;
+    }
+    pool_node *p = pool->free_list;
+    pool->free_list = p->next;
+    pool->free--;
+    pool->live++;
+    return p;
+}
+
+static void pool_free(vartype_pool *pool, void *v) {
+    pool_node *p = (pool_node *) v;
+    p->next = pool->free_list;
+    pool->free_list = p;
+    pool->free++;
+    pool->live--;
+}
+
+#endif
+
+static void pool_clean(vartype_pool *pool) {
+    /* Slabs can only be returned as a whole, so this only does anything
+     * when none of the pool's instances are in use.
+     */
+    if (pool->live != 0)
+        return;
+    while (pool->slabs != NULL) {
+        pool_slab *slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
     }
-    r->r.x = value;
+    pool->free_list = NULL;
+    pool->free = 0;
+    pool->bytes = 0;
+    pool->next_slab = POOL_MIN_SLAB;
+}
+
+static void pool_stats(const vartype_pool *pool, vartype_pool_stats *stats) {
+    stats->live = pool->live;
+    stats->free = pool->free;
+    stats->bytes = pool->bytes;
+}
+
+vartype *new_real(phloat value) {
+    vartype_real *r = (vartype_real *) pool_alloc(&realpool);
+    if (r == NULL)
+        return NULL;
+    r->type = TYPE_REAL;
+    r->x = value;
     return (vartype *) r;
 }
 
 vartype *new_complex(phloat re, phloat im) {
-    pool_complex *c;
-    if (complexpool == NULL) {
-        c = (pool_complex *) malloc(sizeof(pool_complex));
-        if (c == NULL)
-            return NULL;
-        c->c.type = TYPE_COMPLEX;
-    } else {
-        c = complexpool;
-        complexpool = complexpool->next;
-    }
-    c->c.re = re;
-    c->c.im = im;
+    vartype_complex *c = (vartype_complex *) pool_alloc(&complexpool);
+    if (c == NULL)
+        return NULL;
+    c->type = TYPE_COMPLEX;
+    c->re = re;
+    c->im = im;
     return (vartype *) c;
 }
 
 vartype *new_string(const char *text, int length) {
-    pool_string *s;
-    if (stringpool == NULL) {
-        s = (pool_string *) malloc(sizeof(pool_string));
-        if (s == NULL)
-            return NULL;
-        s->s.type = TYPE_STRING;
-    } else {
-        s = stringpool;
-        stringpool = stringpool->next;
-    }
+    vartype_string *s = (vartype_string *) pool_alloc(&stringpool);
+    if (s == NULL)
+        return NULL;
     int i;
-    s->s.type = TYPE_STRING;
-    s->s.length = length > 6 ? 6 : length;
-    for (i = 0; i < s->s.length; i++)
-        s->s.text[i] = text[i];
+    s->type = TYPE_STRING;
+    s->length = length > 6 ? 6 : length;
+    for (i = 0; i < s->length; i++)
+        s->text[i] = text[i];
     return (vartype *) s;
 }
 
+/* A matrix's elements and, for real matrices, its string flags, are kept
+ * in the same block as the realmatrix_data or complexmatrix_data struct
+ * that holds its reference count: the struct comes first, padded to a
+ * multiple of sizeof(phloat), followed by the elements, followed by the
+ * flags, followed by the bitmap of copied chunks, which is only used while
+ * the array is a copy in progress. The 'data', 'is_string', and 'copied'
+ * pointers point into that block, so it takes one malloc() to create, and
+ * one free() to delete.
+ */
+#define MATRIX_DATA_OFFSET(type) \
+        ((sizeof(type) + sizeof(phloat) - 1) / sizeof(phloat) * sizeof(phloat))
+#define MATRIX_CHUNKS(size) (((size) + MATRIX_CHUNK - 1) / MATRIX_CHUNK)
+/* Room for the bitmap of copied chunks; at most one byte too many */
+#define COPIED_BYTES(size) ((size) / MATRIX_CHUNK / 8 + 1)
+
+/* Number and total size of the matrix payload blocks in existence; see
+ * core_get_mem_usage().
+ */
+static int4 matrix_blocks = 0;
+static int8 matrix_block_bytes = 0;
+
+static realmatrix_data *alloc_realmatrix_data(int4 size) {
+    /* Everything after the struct is left uninitialized */
+    size_t offset = MATRIX_DATA_OFFSET(realmatrix_data);
+    int4 flagbytes = (size + 7) >> 3;
+    double d_bytes = ((double) size) * sizeof(phloat) + flagbytes
+                        + COPIED_BYTES(size) + offset;
+    if (size < 0 || ((double) (int4) d_bytes) != d_bytes)
+        return NULL;
+    realmatrix_data *array = (realmatrix_data *) malloc((size_t) d_bytes);
+    if (array == NULL)
+        return NULL;
+    array->data = (phloat *) ((char *) array + offset);
+    array->is_string = (unsigned char *) (array->data + size);
+    array->copied = array->is_string + flagbytes;
+    array->string_count = 0;
+    array->refcount = 1;
+    array->bytes = (int4) d_bytes;
+    array->size = size;
+    array->source = NULL;
+    array->chunks_left = 0;
+    matrix_blocks++;
+    matrix_block_bytes += array->bytes;
+    return array;
+}
+
+realmatrix_data *new_realmatrix_data(int4 size) {
+    /* The elements are left uninitialized, but the string flags are
+     * cleared, so that string_count is accurate from the start.
+     */
+    realmatrix_data *array = alloc_realmatrix_data(size);
+    if (array != NULL)
+        memset(array->is_string, 0, (size + 7) >> 3);
+    return array;
+}
+
+static complexmatrix_data *alloc_complexmatrix_data(int4 size) {
+    size_t offset = MATRIX_DATA_OFFSET(complexmatrix_data);
+    double d_bytes = ((double) size) * 2 * sizeof(phloat)
+                        + COPIED_BYTES(size) + offset;
+    if (size < 0 || ((double) (int4) d_bytes) != d_bytes)
+        return NULL;
+    complexmatrix_data *array = (complexmatrix_data *) malloc((size_t) d_bytes);
+    if (array == NULL)
+        return NULL;
+    array->data = (phloat *) ((char *) array + offset);
+    array->copied = (unsigned char *) (array->data + 2 * size);
+    array->refcount = 1;
+    array->bytes = (int4) d_bytes;
+    array->size = size;
+    array->source = NULL;
+    array->chunks_left = 0;
+    matrix_blocks++;
+    matrix_block_bytes += array->bytes;
+    return array;
+}
+
+complexmatrix_data *new_complexmatrix_data(int4 size) {
+    return alloc_complexmatrix_data(size);
+}
+
+void free_realmatrix_data(realmatrix_data *array) {
+    realmatrix_data *source = array->source;
+    matrix_blocks--;
+    matrix_block_bytes -= array->bytes;
+    free(array);
+    if (source != NULL && --(source->refcount) == 0)
+        free_realmatrix_data(source);
+}
+
+void free_complexmatrix_data(complexmatrix_data *array) {
+    complexmatrix_data *source = array->source;
+    matrix_blocks--;
+    matrix_block_bytes -= array->bytes;
+    free(array);
+    if (source != NULL && --(source->refcount) == 0)
+        free_complexmatrix_data(source);
+}
+
+/* Copy on write. An element store into a shared matrix doesn't copy the
+ * whole matrix, like disentangle() does, but gives the matrix a new array
+ * that starts out with only the chunk of MATRIX_CHUNK elements containing
+ * that element, and reads the rest from the old one, until they are
+ * written as well, or until something needs all of them in one piece and
+ * calls matrix_data(), which finishes the copy.
+ * The old array is never itself a copy in progress, so there are no chains
+ * of these; and since the copy holds a reference to it, it looks shared,
+ * and won't be changed in place, for as long as the copy needs it.
+ */
+
+static void copy_chunk(realmatrix_data *dst, const realmatrix_data *src,
+                       int4 c) {
+    int4 i = c * MATRIX_CHUNK;
+    int4 n = dst->size - i < MATRIX_CHUNK ? dst->size - i : MATRIX_CHUNK;
+    memcpy(dst->data + i, src->data + i, n * sizeof(phloat));
+    /* MATRIX_CHUNK is a multiple of 8, so chunks don't share flag bytes */
+    memcpy(dst->is_string + (i >> 3), src->is_string + (i >> 3),
+           (n + 7) >> 3);
+    dst->copied[c >> 3] |= 1 << (c & 7);
+    dst->chunks_left--;
+}
+
+static void copy_chunk(complexmatrix_data *dst, const complexmatrix_data *src,
+                       int4 c) {
+    int4 i = c * MATRIX_CHUNK;
+    int4 n = dst->size - i < MATRIX_CHUNK ? dst->size - i : MATRIX_CHUNK;
+    memcpy(dst->data + 2 * i, src->data + 2 * i, 2 * n * sizeof(phloat));
+    dst->copied[c >> 3] |= 1 << (c & 7);
+    dst->chunks_left--;
+}
+
+static bool chunk_copied(const unsigned char *copied, int4 c) {
+    return ((copied[c >> 3] >> (c & 7)) & 1) != 0;
+}
+
+static realmatrix_data *start_copy(realmatrix_data *array) {
+    /* Returns a copy in progress of 'array', which, if 'array' is itself a
+     * copy in progress, takes the chunks it has, and reads the rest from
+     * the same source.
+     */
+    realmatrix_data *copy = alloc_realmatrix_data(array->size);
+    if (copy == NULL)
+        return NULL;
+    int4 chunks = MATRIX_CHUNKS(array->size);
+    memset(copy->copied, 0, COPIED_BYTES(array->size));
+    copy->chunks_left = chunks;
+    copy->string_count = array->string_count;
+    realmatrix_data *source = array;
+    if (array->source != NULL) {
+        source = array->source;
+        for (int4 c = 0; c < chunks; c++)
+            if (chunk_copied(array->copied, c))
+                copy_chunk(copy, array, c);
+    }
+    copy->source = source;
+    source->refcount++;
+    return copy;
+}
+
+static complexmatrix_data *start_copy(complexmatrix_data *array) {
+    complexmatrix_data *copy = alloc_complexmatrix_data(array->size);
+    if (copy == NULL)
+        return NULL;
+    int4 chunks = MATRIX_CHUNKS(array->size);
+    memset(copy->copied, 0, COPIED_BYTES(array->size));
+    copy->chunks_left = chunks;
+    complexmatrix_data *source = array;
+    if (array->source != NULL) {
+        source = array->source;
+        for (int4 c = 0; c < chunks; c++)
+            if (chunk_copied(array->copied, c))
+                copy_chunk(copy, array, c);
+    }
+    copy->source = source;
+    source->refcount++;
+    return copy;
+}
+
+static void end_copy(realmatrix_data *array) {
+    realmatrix_data *source = array->source;
+    array->source = NULL;
+    if (--(source->refcount) == 0)
+        free_realmatrix_data(source);
+}
+
+static void end_copy(complexmatrix_data *array) {
+    complexmatrix_data *source = array->source;
+    array->source = NULL;
+    if (--(source->refcount) == 0)
+        free_complexmatrix_data(source);
+}
+
+void finish_copy(realmatrix_data *array) {
+    int4 chunks = MATRIX_CHUNKS(array->size);
+    for (int4 c = 0; array->chunks_left > 0 && c < chunks; c++)
+        if (!chunk_copied(array->copied, c))
+            copy_chunk(array, array->source, c);
+    end_copy(array);
+}
+
+void finish_copy(complexmatrix_data *array) {
+    int4 chunks = MATRIX_CHUNKS(array->size);
+    for (int4 c = 0; array->chunks_left > 0 && c < chunks; c++)
+        if (!chunk_copied(array->copied, c))
+            copy_chunk(array, array->source, c);
+    end_copy(array);
+}
+
+void get_matrix_data_stats(int4 *blocks, int8 *bytes) {
+    *blocks = matrix_blocks;
+    *bytes = matrix_block_bytes;
+}
+
+void set_is_string(realmatrix_data *array, int4 i, bool s) {
+    /* Element stores call disentangle_element() first, so this only has
+     * to finish a copy in progress when called for other reasons
+     */
+    if (array->source != NULL && !CHUNK_COPIED(array, i))
+        finish_copy(array);
+    unsigned char *p = array->is_string + (i >> 3);
+    unsigned char bit = 1 << (i & 7);
+    if (s) {
+        if ((*p & bit) == 0) {
+            *p |= bit;
+            array->string_count++;
+        }
+    } else {
+        if ((*p & bit) != 0) {
+            *p &= ~bit;
+            array->string_count--;
+        }
+    }
+}
+
+static int4 count_bits(const unsigned char *p, int4 n) {
+    int4 count = 0;
+    for (int4 i = 0; i < n; i++) {
+        unsigned char b = p[i];
+        while (b != 0) {
+            b &= b - 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+void copy_is_string(realmatrix_data *dst, int4 dstoff,
+                    const realmatrix_data *src, int4 srcoff, int4 n) {
+    /* Copies n string flags; the ranges must not overlap, unless dst and
+     * src are the same and dstoff < srcoff.
+     */
+    if (src->string_count == 0 && dst->string_count == 0)
+        return;
+    if (dst->source != NULL)
+        finish_copy(dst);
+    if (((dstoff | srcoff) & 7) == 0 && src->source == NULL) {
+        int4 bytes = n >> 3;
+        unsigned char *d = dst->is_string + (dstoff >> 3);
+        const unsigned char *s = src->is_string + (srcoff >> 3);
+        dst->string_count -= count_bits(d, bytes);
+        memmove(d, s, bytes);
+        dst->string_count += count_bits(d, bytes);
+        dstoff += bytes << 3;
+        srcoff += bytes << 3;
+        n -= bytes << 3;
+    }
+    for (int4 i = 0; i < n; i++)
+        set_is_string(dst, dstoff + i, IS_STRING(src, srcoff + i));
+}
+
+void clear_is_string(realmatrix_data *array, int4 off, int4 n) {
+    if (array->string_count == 0)
+        return;
+    if (array->source != NULL)
+        finish_copy(array);
+    for (int4 i = 0; i < n; i++)
+        set_is_string(array, off + i, false);
+}
+
+void unpack_is_string(char *dst, const realmatrix_data *src, int4 n) {
+    /* Expands the flags to one byte per element, as used in state files
+     * and by paste
+     */
+    for (int4 i = 0; i < n; i++)
+        dst[i] = IS_STRING(src, i);
+}
+
+void pack_is_string(realmatrix_data *dst, const char *src, int4 n) {
+    if (dst->source != NULL)
+        finish_copy(dst);
+    for (int4 i = 0; i < n; i++)
+        set_is_string(dst, i, src[i] != 0);
+}
+
+void clear_phloats(phloat *data, int4 n) {
+    /* Zero is set once and then copied in doubling chunks; this takes a
+     * handful of memcpy() calls, and doesn't assume that zero is all bits
+     * zero, which it isn't for the decimal type.
+     */
+    if (n <= 0)
+        return;
+    data[0] = 0;
+    int4 done = 1;
+    while (done < n) {
+        int4 c = done < n - done ? done : n - done;
+        memcpy(data + done, data, c * sizeof(phloat));
+        done += c;
+    }
+}
+
 vartype *new_realmatrix(int4 rows, int4 columns) {
     double d_bytes = ((double) rows) * ((double) columns) * sizeof(phloat);
     if (((double) (int4) d_bytes) != d_bytes)
         return NULL;
 
-    vartype_realmatrix *rm = (vartype_realmatrix *)
-                                        malloc(sizeof(vartype_realmatrix));
+    vartype_realmatrix *rm = (vartype_realmatrix *) pool_alloc(&realmatrixpool);
     if (rm == NULL)
         return NULL;
-    int4 i, sz;
-    rm->type = TYPE_REALMATRIX;
-    rm->rows = rows;
-    rm->columns = columns;
-    sz = rows * columns;
-    rm->array = (realmatrix_data *) malloc(sizeof(realmatrix_data));
+    int4 sz = rows * columns;
+    rm->array = new_realmatrix_data(sz);
     if (rm->array == NULL) {
-        free(rm);
-        return NULL;
-    }
-    rm->array->data = (phloat *) malloc(sz * sizeof(phloat));
-    if (rm->array->data == NULL) {
-        /* Oops */
-        free(rm->array);
-        free(rm);
-        return NULL;
-    }
-    rm->array->is_string = (char *) malloc(sz);
-    if (rm->array->is_string == NULL) {
-        /* Oops */
-        free(rm->array->data);
-        free(rm->array);
-        free(rm);
+        pool_free(&realmatrixpool, rm);
         return NULL;
     }
-    for (i = 0; i < sz; i++)
-        rm->array->data[i] = 0;
-    for (i = 0; i < sz; i++)
-        rm->array->is_string[i] = 0;
-    rm->array->refcount = 1;
+    rm->type = TYPE_REALMATRIX;
+    rm->rows = rows;
+    rm->columns = columns;
+    clear_phloats(matrix_data(rm->array), sz);
     return (vartype *) rm;
 }
 
@@ -145,29 +670,19 @@ vartype *new_complexmatrix(int4 rows, int4 columns) {
         return NULL;
 
     vartype_complexmatrix *cm = (vartype_complexmatrix *)
-                                        malloc(sizeof(vartype_complexmatrix));
+                                        pool_alloc(&complexmatrixpool);
     if (cm == NULL)
         return NULL;
-    int4 i, sz;
-    cm->type = TYPE_COMPLEXMATRIX;
-    cm->rows = rows;
-    cm->columns = columns;
-    sz = rows * columns * 2;
-    cm->array = (complexmatrix_data *) malloc(sizeof(complexmatrix_data));
+    int4 sz = rows * columns;
+    cm->array = new_complexmatrix_data(sz);
     if (cm->array == NULL) {
-        free(cm);
-        return NULL;
-    }
-    cm->array->data = (phloat *) malloc(sz * sizeof(phloat));
-    if (cm->array->data == NULL) {
-        /* Oops */
-        free(cm->array);
-        free(cm);
+        pool_free(&complexmatrixpool, cm);
         return NULL;
     }
-    for (i = 0; i < sz; i++)
-        cm->array->data[i] = 0;
-    cm->array->refcount = 1;
+    cm->type = TYPE_COMPLEXMATRIX;
+    cm->rows = rows;
+    cm->columns = columns;
+    clear_phloats(matrix_data(cm->array), sz * 2);
     return (vartype *) cm;
 }
 
@@ -175,7 +690,7 @@ vartype *new_matrix_alias(vartype *m) {
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm1 = (vartype_realmatrix *) m;
         vartype_realmatrix *rm2 = (vartype_realmatrix *)
-                                        malloc(sizeof(vartype_realmatrix));
+                                        pool_alloc(&realmatrixpool);
         if (rm2 == NULL)
             return NULL;
         *rm2 = *rm1;
@@ -184,7 +699,7 @@ vartype *new_matrix_alias(vartype *m) {
     } else if (m->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm1 = (vartype_complexmatrix *) m;
         vartype_complexmatrix *cm2 = (vartype_complexmatrix *)
-                                        malloc(sizeof(vartype_complexmatrix));
+                                        pool_alloc(&complexmatrixpool);
         if (cm2 == NULL)
             return NULL;
         *cm2 = *cm1;
@@ -197,63 +712,68 @@ vartype *new_matrix_alias(vartype *m) {
 void free_vartype(vartype *v) {
     if (v == NULL)
         return;
+#ifdef VARTYPE_DEBUG
+    if (vt_header(v) == NULL)
+        return;
+#endif
     switch (v->type) {
-        case TYPE_REAL: {
-            pool_real *r = (pool_real *) v;
-            r->next = realpool;
-            realpool = r;
+        case TYPE_REAL:
+            pool_free(&realpool, v);
             break;
-        }
-        case TYPE_COMPLEX: {
-            pool_complex *c = (pool_complex *) v;
-            c->next = complexpool;
-            complexpool = c;
+        case TYPE_COMPLEX:
+            pool_free(&complexpool, v);
             break;
-        }
-        case TYPE_STRING: {
-            pool_string *s = (pool_string *) v;
-            s->next = stringpool;
-            stringpool = s;
+        case TYPE_STRING:
+            pool_free(&stringpool, v);
             break;
-        }
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
-            if (--(rm->array->refcount) == 0) {
-                free(rm->array->data);
-                free(rm->array->is_string);
-                free(rm->array);
-            }
-            free(rm);
+            if (--(rm->array->refcount) == 0)
+                free_realmatrix_data(rm->array);
+            pool_free(&realmatrixpool, rm);
             break;
         }
         case TYPE_COMPLEXMATRIX: {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
-            if (--(cm->array->refcount) == 0) {
-                free(cm->array->data);
-                free(cm->array);
-            }
-            free(cm);
+            if (--(cm->array->refcount) == 0)
+                free_complexmatrix_data(cm->array);
+            pool_free(&complexmatrixpool, cm);
             break;
         }
     }
 }
 
 void clean_vartype_pools() {
-    while (realpool != NULL) {
-        pool_real *r = realpool;
-        realpool = r->next;
-        free(r);
-    }
-    while (complexpool != NULL) {
-        pool_complex *c = complexpool;
-        complexpool = c->next;
-        free(c);
-    }
-    while (stringpool != NULL) {
-        pool_string *s = stringpool;
-        stringpool = s->next;
-        free(s);
-    }
+    pool_clean(&realpool);
+    pool_clean(&complexpool);
+    pool_clean(&stringpool);
+    pool_clean(&realmatrixpool);
+    pool_clean(&complexmatrixpool);
+}
+
+void warm_vartype_pools(int4 reals, int4 complexes, int4 strings) {
+#ifndef VARTYPE_DEBUG
+    if (realpool.free < reals)
+        pool_grow(&realpool, reals - realpool.free);
+    if (complexpool.free < complexes)
+        pool_grow(&complexpool, complexes - complexpool.free);
+    if (stringpool.free < strings)
+        pool_grow(&stringpool, strings - stringpool.free);
+#endif
+}
+
+void get_vartype_pool_stats(vartype_pool_stats *reals,
+                            vartype_pool_stats *complexes,
+                            vartype_pool_stats *strings) {
+    pool_stats(&realpool, reals);
+    pool_stats(&complexpool, complexes);
+    pool_stats(&stringpool, strings);
+}
+
+int8 vartype_pools_mem_usage() {
+    /* All pools, including the ones for matrix headers */
+    return (int8) realpool.bytes + complexpool.bytes + stringpool.bytes
+            + realmatrixpool.bytes + complexmatrixpool.bytes;
 }
 
 vartype *dup_vartype(const vartype *v) {
@@ -271,7 +791,7 @@ vartype *dup_vartype(const vartype *v) {
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
             vartype_realmatrix *rm2 = (vartype_realmatrix *)
-                                        malloc(sizeof(vartype_realmatrix));
+                                        pool_alloc(&realmatrixpool);
             if (rm2 == NULL)
                 return NULL;
             rm2->type = TYPE_REALMATRIX;
@@ -284,7 +804,7 @@ vartype *dup_vartype(const vartype *v) {
         case TYPE_COMPLEXMATRIX: {
             vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
             vartype_complexmatrix *cm2 = (vartype_complexmatrix *)
-                                        malloc(sizeof(vartype_complexmatrix));
+                                        pool_alloc(&complexmatrixpool);
             if (cm2 == NULL)
                 return NULL;
             cm2->type = TYPE_COMPLEXMATRIX;
@@ -304,34 +824,20 @@ vartype *dup_vartype(const vartype *v) {
 }
 
 int disentangle(vartype *v) {
+    /* Makes sure the matrix has its array to itself, so that it can be
+     * changed in place. A copy in progress may be left unfinished, since
+     * matrix_data() will finish it.
+     */
     switch (v->type) {
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
             if (rm->array->refcount == 1)
                 return 1;
             else {
-                realmatrix_data *md = (realmatrix_data *)
-                                        malloc(sizeof(realmatrix_data));
+                realmatrix_data *md = start_copy(rm->array);
                 if (md == NULL)
                     return 0;
-                int4 sz = rm->rows * rm->columns;
-                int4 i;
-                md->data = (phloat *) malloc(sz * sizeof(phloat));
-                if (md->data == NULL) {
-                    free(md);
-                    return 0;
-                }
-                md->is_string = (char *) malloc(sz);
-                if (md->is_string == NULL) {
-                    free(md->data);
-                    free(md);
-                    return 0;
-                }
-                for (i = 0; i < sz; i++)
-                    md->data[i] = rm->array->data[i];
-                for (i = 0; i < sz; i++)
-                    md->is_string[i] = rm->array->is_string[i];
-                md->refcount = 1;
+                finish_copy(md);
                 rm->array->refcount--;
                 rm->array = md;
                 return 1;
@@ -342,20 +848,10 @@ int disentangle(vartype *v) {
             if (cm->array->refcount == 1)
                 return 1;
             else {
-                complexmatrix_data *md = (complexmatrix_data *)
-                                            malloc(sizeof(complexmatrix_data));
+                complexmatrix_data *md = start_copy(cm->array);
                 if (md == NULL)
                     return 0;
-                int4 sz = cm->rows * cm->columns * 2;
-                int4 i;
-                md->data = (phloat *) malloc(sz * sizeof(phloat));
-                if (md->data == NULL) {
-                    free(md);
-                    return 0;
-                }
-                for (i = 0; i < sz; i++)
-                    md->data[i] = cm->array->data[i];
-                md->refcount = 1;
+                finish_copy(md);
                 cm->array->refcount--;
                 cm->array = md;
                 return 1;
@@ -369,8 +865,228 @@ int disentangle(vartype *v) {
     }
 }
 
+int disentangle_element(vartype *v, int4 n) {
+    /* Like disentangle(), but for changing element n only: if the matrix
+     * is shared, it gets a copy in progress, and only the chunk containing
+     * element n is copied. Afterwards, matrix_element() points into the
+     * matrix's own array, and set_is_string() can be used, for element n.
+     */
+    switch (v->type) {
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            if (rm->array->refcount > 1) {
+                realmatrix_data *md = start_copy(rm->array);
+                if (md == NULL)
+                    return 0;
+                rm->array->refcount--;
+                rm->array = md;
+            }
+            realmatrix_data *array = rm->array;
+            if (array->source != NULL && !CHUNK_COPIED(array, n)) {
+                copy_chunk(array, array->source, n / MATRIX_CHUNK);
+                if (array->chunks_left == 0)
+                    end_copy(array);
+            }
+            return 1;
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            if (cm->array->refcount > 1) {
+                complexmatrix_data *md = start_copy(cm->array);
+                if (md == NULL)
+                    return 0;
+                cm->array->refcount--;
+                cm->array = md;
+            }
+            complexmatrix_data *array = cm->array;
+            if (array->source != NULL && !CHUNK_COPIED(array, n)) {
+                copy_chunk(array, array->source, n / MATRIX_CHUNK);
+                if (array->chunks_left == 0)
+                    end_copy(array);
+            }
+            return 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+static bool same_phloat(const phloat &a, const phloat &b) {
+    /* Compares representations, not values: storing 0 over -0, or 1.0
+     * over 1 in decimal, is still a change.
+     */
+    return memcmp(&a, &b, sizeof(phloat)) == 0;
+}
+
+int element_unchanged(const vartype *m, int4 n, const vartype *v) {
+    /* Returns 1 if storing 'v' in element 'n' of matrix 'm' would leave the
+     * element as it is. Element stores use this to skip
+     * disentangle_element() when the matrix is shared, so that e.g.
+     * stepping through a matrix with J+ in the matrix editor doesn't start
+     * a copy: the value in X, written back on every step, is usually the
+     * one that was recalled from it.
+     */
+    if (m->type == TYPE_REALMATRIX) {
+        realmatrix_data *array = ((const vartype_realmatrix *) m)->array;
+        if (v->type == TYPE_REAL)
+            return !IS_STRING(array, n)
+                    && same_phloat(*matrix_element(array, n),
+                                   ((const vartype_real *) v)->x);
+        else if (v->type == TYPE_STRING) {
+            const vartype_string *s = (const vartype_string *) v;
+            phloat *d = matrix_element(array, n);
+            return IS_STRING(array, n)
+                    && phloat_length(*d) == s->length
+                    && memcmp(phloat_text(*d), s->text, s->length) == 0;
+        } else
+            return 0;
+    } else if (m->type == TYPE_COMPLEXMATRIX) {
+        const phloat *d =
+                matrix_element(((const vartype_complexmatrix *) m)->array, n);
+        if (v->type == TYPE_REAL) {
+            phloat zero = 0;
+            return same_phloat(d[0], ((const vartype_real *) v)->x)
+                    && same_phloat(d[1], zero);
+        } else if (v->type == TYPE_COMPLEX) {
+            const vartype_complex *c = (const vartype_complex *) v;
+            return same_phloat(d[0], c->re) && same_phloat(d[1], c->im);
+        } else
+            return 0;
+    } else
+        return 0;
+}
+
+/* Hashed index of the visible variables, mapping each name to its position
+ * in vars. Since there is at most one visible variable with any given name,
+ * hidden ones don't need to be in the index, and the (name, level) pairs
+ * never collide: when a local hides a variable, it simply takes over its
+ * entry, and gives it back when it goes away.
+ * Deleted entries are left as tombstones; when there are too many of those,
+ * or when vars is replaced wholesale, the index is discarded and rebuilt by
+ * the next lookup_var().
+ */
+#define VAR_INDEX_EMPTY -1
+#define VAR_INDEX_DELETED -2
+static int *var_index = NULL;
+static int var_index_size = 0;
+static int var_index_fill = 0;
+static bool var_index_valid = false;
+
+static int var_hash(const char *name, int namelength) {
+    uint4 h = 2166136261u;
+    for (int i = 0; i < namelength; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return (int) (h & (var_index_size - 1));
+}
+
+static int var_index_slot(const char *name, int namelength) {
+    /* Returns the slot holding the entry for 'name', or -1 if there is none */
+    int mask = var_index_size - 1;
+    int slot = var_hash(name, namelength);
+    while (true) {
+        int idx = var_index[slot];
+        if (idx == VAR_INDEX_EMPTY)
+            return -1;
+        if (idx != VAR_INDEX_DELETED
+                && string_equals(vars[idx].name, vars[idx].length, name, namelength))
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+}
+
+void invalidate_var_index() {
+    free(var_index);
+    var_index = NULL;
+    var_index_size = 0;
+    var_index_fill = 0;
+    var_index_valid = false;
+}
+
+static bool build_var_index() {
+    int size = 64;
+    while (size < vars_count * 4)
+        size <<= 1;
+    free(var_index);
+    var_index = (int *) malloc(size * sizeof(int));
+    if (var_index == NULL) {
+        invalidate_var_index();
+        return false;
+    }
+    var_index_size = size;
+    var_index_fill = 0;
+    for (int i = 0; i < size; i++)
+        var_index[i] = VAR_INDEX_EMPTY;
+    var_index_valid = true;
+    for (int i = 0; i < vars_count; i++)
+        if (!vars[i].hidden)
+            var_index_update(i);
+    return var_index_valid;
+}
+
+void var_index_update(int varindex) {
+    /* Points the entry for the name of vars[varindex] at varindex, adding
+     * the entry if necessary. Called when a variable is created, moved, or
+     * unhidden.
+     */
+    if (!var_index_valid)
+        return;
+    const char *name = vars[varindex].name;
+    int namelength = vars[varindex].length;
+    int mask = var_index_size - 1;
+    int slot = var_hash(name, namelength);
+    int free_slot = -1;
+    while (true) {
+        int idx = var_index[slot];
+        if (idx == VAR_INDEX_EMPTY)
+            break;
+        if (idx == VAR_INDEX_DELETED) {
+            if (free_slot == -1)
+                free_slot = slot;
+        } else if (string_equals(vars[idx].name, vars[idx].length, name, namelength)) {
+            var_index[slot] = varindex;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (free_slot == -1) {
+        if ((var_index_fill + 1) * 2 > var_index_size) {
+            /* Don't rebuild here; vars may be in the middle of being
+             * rearranged. The next lookup will take care of it.
+             */
+            invalidate_var_index();
+            return;
+        }
+        free_slot = slot;
+        var_index_fill++;
+    }
+    var_index[free_slot] = varindex;
+}
+
+void var_index_remove(int varindex) {
+    /* Removes the entry for vars[varindex]; called while its name is still
+     * intact.
+     */
+    if (!var_index_valid)
+        return;
+    int slot = var_index_slot(vars[varindex].name, vars[varindex].length);
+    if (slot != -1 && var_index[slot] == varindex)
+        var_index[slot] = VAR_INDEX_DELETED;
+}
+
+int8 vars_mem_usage() {
+    /* The variable table and its index; the values are accounted for by
+     * the vartype pools and get_matrix_data_stats().
+     */
+    return (int8) vars_capacity * sizeof(var_struct)
+            + (int8) var_index_size * sizeof(int);
+}
+
 int lookup_var(const char *name, int namelength) {
     int i, j;
+    if (var_index_valid || build_var_index()) {
+        int slot = var_index_slot(name, namelength);
+        return slot == -1 ? -1 : var_index[slot];
+    }
     for (i = vars_count - 1; i >= 0; i--) {
         if (vars[i].hidden)
             continue;
@@ -394,14 +1110,21 @@ vartype *recall_var(const char *name, int namelength) {
 }
 
 bool ensure_var_space(int n) {
-    int nc = vars_count + n;
-    if (nc > vars_capacity) {
-        var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
-        if (nv == NULL)
-            return false;
-        vars_capacity = nc;
-        vars = nv;
-    }
+    /* Makes room for n more variables. The capacity is doubled, rather
+     * than grown to fit, so creating many variables one at a time doesn't
+     * keep reallocating.
+     */
+    int needed = vars_count + n;
+    if (needed <= vars_capacity)
+        return true;
+    int nc = vars_capacity < 25 ? 25 : vars_capacity;
+    while (nc < needed)
+        nc <<= 1;
+    var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
+    if (nv == NULL)
+        return false;
+    vars_capacity = nc;
+    vars = nv;
     return true;
 }
 
@@ -409,14 +1132,8 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
     int varindex = lookup_var(name, namelength);
     int i;
     if (varindex == -1) {
-        if (vars_count == vars_capacity) {
-            int nc = vars_capacity + 25;
-            var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
-            if (nv == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            vars_capacity = nc;
-            vars = nv;
-        }
+        if (!ensure_var_space(1))
+            return ERR_INSUFFICIENT_MEMORY;
         varindex = vars_count++;
         vars[varindex].length = namelength;
         for (i = 0; i < namelength; i++)
@@ -424,15 +1141,12 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
         vars[varindex].level = local ? get_rtn_level() : -1;
         vars[varindex].hidden = false;
         vars[varindex].hiding = false;
+        if (local)
+            update_local_count(1);
+        var_index_update(varindex);
     } else if (local && vars[varindex].level < get_rtn_level()) {
-        if (vars_count == vars_capacity) {
-            int nc = vars_capacity + 25;
-            var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
-            if (nv == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            vars_capacity = nc;
-            vars = nv;
-        }
+        if (!ensure_var_space(1))
+            return ERR_INSUFFICIENT_MEMORY;
         vars[varindex].hidden = true;
         varindex = vars_count++;
         vars[varindex].length = namelength;
@@ -441,6 +1155,8 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
         vars[varindex].level = get_rtn_level();
         vars[varindex].hidden = false;
         vars[varindex].hiding = true;
+        update_local_count(1);
+        var_index_update(varindex);
         push_indexed_matrix(name, namelength);
     } else {
         if (matedit_mode == 1 &&
@@ -467,16 +1183,23 @@ void purge_var(const char *name, int namelength) {
     if (matedit_mode == 1 && string_equals(matedit_name, matedit_length, name, namelength))
         matedit_mode = 0;
     free_vartype(vars[varindex].value);
+    var_index_remove(varindex);
     if (vars[varindex].hiding) {
         for (int i = varindex - 1; i >= 0; i--)
             if (vars[i].hidden && string_equals(vars[i].name, vars[i].length, name, namelength)) {
                 vars[i].hidden = false;
+                var_index_update(i);
                 break;
             }
         pop_indexed_matrix(name, namelength);
     }
-    for (int i = varindex; i < vars_count - 1; i++)
+    if (vars[varindex].level != -1)
+        update_local_count(-1);
+    for (int i = varindex; i < vars_count - 1; i++) {
         vars[i] = vars[i + 1];
+        if (!vars[i].hidden)
+            var_index_update(i);
+    }
     vars_count--;
     update_catalog();
 }
@@ -486,6 +1209,8 @@ void purge_all_vars() {
     for (i = 0; i < vars_count; i++)
         free_vartype(vars[i].value);
     vars_count = 0;
+    invalidate_local_counts();
+    invalidate_var_index();
 }
 
 int vars_exist(int real, int cpx, int matrix) {
@@ -517,12 +1242,7 @@ int vars_exist(int real, int cpx, int matrix) {
 }
 
 int contains_no_strings(const vartype_realmatrix *rm) {
-    int4 size = rm->rows * rm->columns;
-    int4 i;
-    for (i = 0; i < size; i++)
-        if (rm->array->is_string[i])
-            return 0;
-    return 1;
+    return rm->array->string_count == 0;
 }
 
 int matrix_copy(vartype *dst, const vartype *src) {
@@ -534,10 +1254,9 @@ int matrix_copy(vartype *dst, const vartype *src) {
             if (s->rows != d->rows || s->columns != d->columns)
                 return ERR_DIMENSION_ERROR;
             size = s->rows * s->columns;
-            for (i = 0; i < size; i++) {
-                d->array->is_string[i] = s->array->is_string[i];
-                d->array->data[i] = s->array->data[i];
-            }
+            copy_is_string(d->array, 0, s->array, 0, size);
+            for (i = 0; i < size; i++)
+                matrix_data(d->array)[i] = matrix_data(s->array)[i];
             return ERR_NONE;
         } else if (dst->type == TYPE_COMPLEXMATRIX) {
             vartype_complexmatrix *d = (vartype_complexmatrix *) dst;
@@ -547,8 +1266,8 @@ int matrix_copy(vartype *dst, const vartype *src) {
                 return ERR_ALPHA_DATA_IS_INVALID;
             size = s->rows * s->columns;
             for (i = 0; i < size; i++) {
-                d->array->data[2 * i] = s->array->data[i];
-                d->array->data[2 * i + 1] = 0;
+                matrix_data(d->array)[2 * i] = matrix_data(s->array)[i];
+                matrix_data(d->array)[2 * i + 1] = 0;
             }
             return ERR_NONE;
         } else
@@ -561,7 +1280,7 @@ int matrix_copy(vartype *dst, const vartype *src) {
             return ERR_DIMENSION_ERROR;
         size = s->rows * s->columns * 2;
         for (i = 0; i < size; i++)
-            d->array->data[i] = s->array->data[i];
+            matrix_data(d->array)[i] = matrix_data(s->array)[i];
         return ERR_NONE;
     } else
         return ERR_INVALID_TYPE;
@@ -23,13 +23,86 @@
 vartype *new_real(phloat value);
 vartype *new_complex(phloat re, phloat im);
 vartype *new_string(const char *s, int slen);
+realmatrix_data *new_realmatrix_data(int4 size);
+complexmatrix_data *new_complexmatrix_data(int4 size);
+void free_realmatrix_data(realmatrix_data *array);
+void free_complexmatrix_data(complexmatrix_data *array);
+void get_matrix_data_stats(int4 *blocks, int8 *bytes);
+void finish_copy(realmatrix_data *array);
+void finish_copy(complexmatrix_data *array);
+
+/* The elements of a matrix, in one piece; if the array is a copy in
+ * progress (see disentangle_element()), this finishes it first.
+ */
+inline phloat *matrix_data(realmatrix_data *array) {
+    if (array->source != NULL)
+        finish_copy(array);
+    return array->data;
+}
+
+inline phloat *matrix_data(complexmatrix_data *array) {
+    if (array->source != NULL)
+        finish_copy(array);
+    return array->data;
+}
+
+/* Element i of a matrix, without finishing a copy in progress; for complex
+ * matrices, its real part, followed by its imaginary part. To change it,
+ * call disentangle_element() first, after which this points into the
+ * matrix's own array.
+ */
+inline phloat *matrix_element(realmatrix_data *array, int4 i) {
+    if (array->source != NULL && !CHUNK_COPIED(array, i))
+        return array->source->data + i;
+    return array->data + i;
+}
+
+inline phloat *matrix_element(complexmatrix_data *array, int4 i) {
+    if (array->source != NULL && !CHUNK_COPIED(array, i))
+        return array->source->data + 2 * i;
+    return array->data + 2 * i;
+}
+
+void set_is_string(realmatrix_data *array, int4 i, bool s);
+void copy_is_string(realmatrix_data *dst, int4 dstoff,
+                    const realmatrix_data *src, int4 srcoff, int4 n);
+void clear_is_string(realmatrix_data *array, int4 off, int4 n);
+void unpack_is_string(char *dst, const realmatrix_data *src, int4 n);
+void pack_is_string(realmatrix_data *dst, const char *src, int4 n);
+void clear_phloats(phloat *data, int4 n);
 vartype *new_realmatrix(int4 rows, int4 columns);
 vartype *new_complexmatrix(int4 rows, int4 columns);
 vartype *new_matrix_alias(vartype *m);
 void free_vartype(vartype *v);
 void clean_vartype_pools();
+
+#ifdef VARTYPE_DEBUG
+void vartype_debug_origin(int cmd, int prgm, int4 pc);
+void vartype_debug_report();
+#define VARTYPE_ORIGIN(cmd, prgm, pc) vartype_debug_origin(cmd, prgm, pc)
+#else
+#define VARTYPE_ORIGIN(cmd, prgm, pc)
+#endif
+void warm_vartype_pools(int4 reals, int4 complexes, int4 strings);
+
+typedef struct {
+    int4 live;  /* instances in use */
+    int4 free;  /* instances available for reuse */
+    int4 bytes; /* memory held by the pool, in use or not */
+} vartype_pool_stats;
+
+void get_vartype_pool_stats(vartype_pool_stats *reals,
+                            vartype_pool_stats *complexes,
+                            vartype_pool_stats *strings);
+int8 vartype_pools_mem_usage();
 vartype *dup_vartype(const vartype *v);
 int disentangle(vartype *v);
+int disentangle_element(vartype *v, int4 n);
+int element_unchanged(const vartype *m, int4 n, const vartype *v);
+void invalidate_var_index();
+void var_index_update(int varindex);
+void var_index_remove(int varindex);
+int8 vars_mem_usage();
 int lookup_var(const char *name, int namelength);
 vartype *recall_var(const char *name, int namelength);
 bool ensure_var_space(int n);
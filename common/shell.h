@@ -80,7 +80,9 @@ void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad);
  *
  * Callback used by the emulator core to check for pending events.
  * It calls this periodically during long operations, such as running a
- * user program, or the solver, etc. The shell should not handle any events
+ * user program, or the solver, etc. (How often it is called while a program
+ * is running is controlled by core_settings.cpu_slice_ms and
+ * core_settings.cpu_slice_lines.) The shell should not handle any events
  * in this call! If there are pending events, it should return 1; the currently
  * active invocation of core_keydown() or core_keyup() will then return
  * immediately (with a return value of 1, to indicate that it would like to get